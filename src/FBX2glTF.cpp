@@ -6,9 +6,11 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <sstream>
 #include <unordered_map>
 #include <vector>
 
@@ -92,6 +94,51 @@ int main(int argc, char* argv[])
 		   "Whether to use 32-bit indices.")
 	   ->type_name("(never|auto|always)");
 
+	app.add_flag(
+		"--optimize-vertex-cache",
+		gltfOptions.optimizeVertexCache,
+		"Reorder triangles for the GPU's post-transform vertex cache.");
+
+	app.add_flag(
+		"--optimize-overdraw",
+		gltfOptions.optimizeOverdraw,
+		"Reorder triangle clusters so that outward-facing geometry is drawn first.");
+
+	app.add_flag(
+		"--optimize-vertex-fetch",
+		gltfOptions.optimizeVertexFetch,
+		"Reorder vertices in the order the triangles first use them.");
+
+	app.add_option(
+		   "--lod-ratios",
+		   [&](std::vector<std::string> values) -> bool
+		   {
+			   gltfOptions.lodRatios.clear();
+			   for (const std::string& value : values)
+			   {
+				   std::stringstream stream(value);
+				   std::string item;
+				   while (std::getline(stream, item, ','))
+				   {
+					   char* end = nullptr;
+					   const float ratio = strtof(item.c_str(), &end);
+					   if (end == item.c_str() || *end != '\0' || ratio <= 0.0f || ratio >= 1.0f ||
+						   (!gltfOptions.lodRatios.empty() && ratio >= gltfOptions.lodRatios.back()))
+					   {
+						   fmt::printf(
+							   "Invalid --lod-ratios value: %s (expected decreasing ratios between 0 and 1)\n",
+							   item);
+						   throw CLI::RuntimeError(1);
+					   }
+					   gltfOptions.lodRatios.push_back(ratio);
+				   }
+			   }
+			   return true;
+		   },
+		   "Generate simplified levels of detail with these triangle ratios, e.g. 0.5,0.25.")
+	   ->type_size(-1)
+	   ->type_name("RATIO,...");
+
 	app.add_option(
 		   "--compute-normals",
 		   [&](std::vector<std::string> choices) -> bool
@@ -125,6 +172,74 @@ int main(int argc, char* argv[])
 		   "When to compute vertex normals from mesh geometry.")
 	   ->type_name("(never|broken|missing|always)");
 
+	app.add_option(
+		   "--compute-tangents",
+		   [&](std::vector<std::string> choices) -> bool
+		   {
+			   for (const std::string choice : choices)
+			   {
+				   if (choice == "never")
+				   {
+					   gltfOptions.computeTangents = ComputeTangentsOption::NEVER;
+				   }
+				   else if (choice == "missing")
+				   {
+					   gltfOptions.computeTangents = ComputeTangentsOption::MISSING;
+				   }
+				   else if (choice == "always")
+				   {
+					   gltfOptions.computeTangents = ComputeTangentsOption::ALWAYS;
+				   }
+				   else
+				   {
+					   fmt::printf("Unknown --compute-tangents option: %s\n", choice);
+					   throw CLI::RuntimeError(1);
+				   }
+			   }
+			   return true;
+		   },
+		   "When to compute vertex tangents from normals and UV0.")
+	   ->type_name("(never|missing|always)");
+
+	app.add_flag(
+		"--interleave",
+		gltfOptions.interleave,
+		"Interleave the vertex attributes of each mesh primitive in a single buffer view.");
+
+	app.add_flag(
+		   "--dedupe-accessors",
+		   gltfOptions.dedupeAccessors,
+		   "Store identical accessor data, like shared inverse bind matrices or keyframe times, only once.");
+
+	app.add_option(
+		   "--dedupe-meshes",
+		   [&](std::vector<std::string> choices) -> bool
+		   {
+			   for (const std::string choice : choices)
+			   {
+				   if (choice == "never")
+				   {
+					   gltfOptions.dedupeMeshes = DedupeMeshesOption::NEVER;
+				   }
+				   else if (choice == "exact")
+				   {
+					   gltfOptions.dedupeMeshes = DedupeMeshesOption::EXACT;
+				   }
+				   else if (choice == "translated")
+				   {
+					   gltfOptions.dedupeMeshes = DedupeMeshesOption::TRANSLATED;
+				   }
+				   else
+				   {
+					   fmt::printf("Unknown --dedupe-meshes option: %s\n", choice);
+					   throw CLI::RuntimeError(1);
+				   }
+			   }
+			   return true;
+		   },
+		   "Merge meshes with identical geometry, optionally up to a translation.")
+	   ->type_name("(never|exact|translated)");
+
 	app.add_option(
 		   "--anim-framerate",
 		   [&](std::vector<std::string> choices) -> bool
@@ -143,16 +258,134 @@ int main(int argc, char* argv[])
 				   {
 					   gltfOptions.animationFramerate = AnimationFramerateOptions::BAKE60;
 				   }
+				   else if (choice == "source")
+				   {
+					   gltfOptions.animationFramerate = AnimationFramerateOptions::SOURCE;
+				   }
+				   else
+				   {
+					   char* end = nullptr;
+					   const double framerate = strtod(choice.c_str(), &end);
+					   if (end == choice.c_str() || *end != '\0' || !(framerate > 0.0 && framerate <= 1000.0))
+					   {
+						   fmt::printf("Unknown --anim-framerate: %s\n", choice);
+						   throw CLI::RuntimeError(1);
+					   }
+					   gltfOptions.animationFramerate = AnimationFramerateOptions::CUSTOM;
+					   gltfOptions.customAnimationFramerate = framerate;
+				   }
+			   }
+			   return true;
+		   },
+		   "Select baked animation framerate: 24, 30 or 60 fps, the framerate of the FBX scene, or any "
+		   "number of frames per second.")
+	   ->type_name("(bake24|bake30|bake60|source|FPS)");
+
+	app.add_flag(
+		   "--anim-adaptive",
+		   gltfOptions.adaptiveAnimationSampling,
+		   "Sample baked animations up to 8 times more densely where interpolating between frames "
+		   "misses the curve by more than the --keyframe-tolerances.");
+
+	app.add_option(
+		   "--anim-evaluator",
+		   [&](std::vector<std::string> choices) -> bool
+		   {
+			   for (const std::string choice : choices)
+			   {
+				   if (choice == "sdk")
+				   {
+					   gltfOptions.animationEvaluator = AnimationEvaluatorOption::SDK;
+				   }
+				   else if (choice == "native")
+				   {
+					   gltfOptions.animationEvaluator = AnimationEvaluatorOption::NATIVE;
+				   }
+				   else if (choice == "validate")
+				   {
+					   gltfOptions.animationEvaluator = AnimationEvaluatorOption::VALIDATE;
+				   }
+				   else
+				   {
+					   fmt::printf("Unknown --anim-evaluator: %s\n", choice);
+					   throw CLI::RuntimeError(1);
+				   }
+			   }
+			   return true;
+		   },
+		   "How to evaluate node transforms when baking animations: with the FBX SDK, natively on all "
+		   "threads, or with the SDK while checking the native results against it.")
+	   ->type_name("(sdk|native|validate)");
+
+	app.add_option(
+		   "--anim-keys",
+		   [&](std::vector<std::string> choices) -> bool
+		   {
+			   for (const std::string choice : choices)
+			   {
+				   if (choice == "baked")
+				   {
+					   gltfOptions.animationKeys = AnimationKeysOption::BAKED;
+				   }
+				   else if (choice == "native")
+				   {
+					   gltfOptions.animationKeys = AnimationKeysOption::NATIVE;
+				   }
 				   else
 				   {
-					   fmt::printf("Unknown --anim-framerate: %s\n", choice);
+					   fmt::printf("Unknown --anim-keys: %s\n", choice);
 					   throw CLI::RuntimeError(1);
 				   }
 			   }
 			   return true;
 		   },
-		   "Select baked animation framerate.")
-	   ->type_name("(bake24|bake30|bake60)");
+		   "Bake animations at a fixed framerate, or write out the FBX keys where glTF interpolation "
+		   "reproduces them exactly.")
+	   ->type_name("(baked|native)");
+
+	app.add_flag(
+		"--reduce-keyframes",
+		gltfOptions.keyframeReduction.enabled,
+		"Drop baked animation keyframes that interpolating their neighbours reproduces.");
+
+	app.add_option(
+		   "--keyframe-tolerances",
+		   [&](std::vector<std::string> values) -> bool
+		   {
+			   std::vector<float> tolerances;
+			   for (const std::string& value : values)
+			   {
+				   std::stringstream stream(value);
+				   std::string item;
+				   while (std::getline(stream, item, ','))
+				   {
+					   char* end = nullptr;
+					   const float tolerance = strtof(item.c_str(), &end);
+					   if (end == item.c_str() || *end != '\0' || tolerance < 0.0f)
+					   {
+						   tolerances.clear();
+						   break;
+					   }
+					   tolerances.push_back(tolerance);
+				   }
+			   }
+			   if (tolerances.size() != 3)
+			   {
+				   fmt::printf(
+					   "Invalid --keyframe-tolerances value (expected three non-negative numbers: "
+					   "translation, rotation in degrees, scale ratio)\n");
+				   throw CLI::RuntimeError(1);
+			   }
+			   gltfOptions.keyframeReduction.enabled = true;
+			   gltfOptions.keyframeReduction.translation = tolerances[0];
+			   gltfOptions.keyframeReduction.rotationDegrees = tolerances[1];
+			   gltfOptions.keyframeReduction.scaleRatio = tolerances[2];
+			   return true;
+		   },
+		   "Tolerances of --reduce-keyframes, which they imply: translation in scene units, rotation in "
+		   "degrees and scale as a ratio, e.g. 0.0001,0.05,0.001.")
+	   ->type_size(-1)
+	   ->type_name("POS,DEG,RATIO");
 
 	const auto opt_flip_u = app.add_flag("--flip-u", "Flip all U texture coordinates.");
 	const auto opt_no_flip_u = app.add_flag("--no-flip-u", "Don't flip U texture coordinates.");
@@ -180,6 +413,13 @@ int main(int argc, char* argv[])
 		gltfOptions.useBlendShapeTangents,
 		"Include blend shape tangents, if reported present by the FBX SDK.");
 
+	app.add_option(
+		   "--blend-shape-epsilon",
+		   gltfOptions.blendShapeEpsilon,
+		   "Drop blend shape offsets whose components are all within this distance of zero.",
+		   true)
+	   ->check(CLI::Range(0.0f, 1000000.0f));
+
 	app.add_option(
 		   "-k,--keep-attribute",
 		   [&](std::vector<std::string> attributes) -> bool
@@ -284,6 +524,97 @@ int main(int argc, char* argv[])
 	   ->check(CLI::Range(1, 32))
 	   ->group("Draco");
 
+	app.add_flag(
+		   "--meshopt",
+		   gltfOptions.meshoptCompression,
+		   "Compress vertex, index and animation data with EXT_meshopt_compression.")
+	   ->group("Meshopt");
+
+	app.add_flag(
+		   "--quantize",
+		   gltfOptions.quantize.enabled,
+		   "Store vertex positions, normals, tangents and UVs as integers (KHR_mesh_quantization).")
+	   ->group("Quantization");
+
+	app.add_option(
+		   "--quantize-bits-for-normals",
+		   [&](std::vector<std::string> choices) -> bool
+		   {
+			   for (const std::string choice : choices)
+			   {
+				   if (choice == "8")
+				   {
+					   gltfOptions.quantize.bitsNormal = 8;
+				   }
+				   else if (choice == "16")
+				   {
+					   gltfOptions.quantize.bitsNormal = 16;
+				   }
+				   else
+				   {
+					   fmt::printf("Unknown --quantize-bits-for-normals option: %s\n", choice);
+					   throw CLI::RuntimeError(1);
+				   }
+			   }
+			   return true;
+		   },
+		   "How many bits to quantize normals and tangents to.")
+	   ->type_name("(8|16)")
+	   ->group("Quantization");
+
+	app.add_flag(
+		   "--quantize-animations",
+		   gltfOptions.quantizeAnimations.enabled,
+		   "Store animated rotations and morph target weights as normalized integers.")
+	   ->group("Quantization");
+
+	app.add_option(
+		   "--quantize-bits-for-weights",
+		   [&](std::vector<std::string> choices) -> bool
+		   {
+			   for (const std::string choice : choices)
+			   {
+				   if (choice == "8")
+				   {
+					   gltfOptions.quantizeAnimations.bitsWeight = 8;
+				   }
+				   else if (choice == "16")
+				   {
+					   gltfOptions.quantizeAnimations.bitsWeight = 16;
+				   }
+				   else
+				   {
+					   fmt::printf("Unknown --quantize-bits-for-weights option: %s\n", choice);
+					   throw CLI::RuntimeError(1);
+				   }
+			   }
+			   return true;
+		   },
+		   "How many bits to quantize animated morph target weights to.")
+	   ->type_name("(8|16)")
+	   ->group("Quantization");
+
+	app.add_flag(
+		   "--quantize-translations",
+		   gltfOptions.quantizeAnimations.translations,
+		   "Round animated translations and scales to 16 significant bits, so that --meshopt compresses "
+		   "them better.")
+	   ->group("Quantization");
+
+	app.add_flag(
+		   "--instancing",
+		   gltfOptions.instancing.enabled,
+		   "Merge static sibling nodes that share a mesh into one node (EXT_mesh_gpu_instancing).")
+	   ->group("Instancing");
+
+	app.add_option(
+		   "--instancing-min-instances",
+		   gltfOptions.instancing.minInstances,
+		   "How many sibling nodes must share a mesh before they are merged.",
+		   true)
+	   ->check(CLI::Range(2, 1000000))
+	   ->group("Instancing");
+
 	CLI11_PARSE(app, argc, argv);
 
 	bool do_flip_u = false;
@@ -333,6 +664,27 @@ int main(int argc, char* argv[])
 		fmt::printf("Note: Ignoring --embed; it's meaningless with --binary.\n");
 	}
 
+	if (gltfOptions.draco.enabled && !gltfOptions.lodRatios.empty())
+	{
+		// each Draco primitive carries its own copy of the vertices, so levels can't share them
+		fmt::printf("Note: Ignoring --lod-ratios; it's not supported with --draco.\n");
+		gltfOptions.lodRatios.clear();
+	}
+
+	if (gltfOptions.draco.enabled && gltfOptions.quantize.enabled)
+	{
+		// Draco quantizes attributes itself, see the --draco-bits-for-* options
+		fmt::printf("Note: Ignoring --quantize; it's not supported with --draco.\n");
+		gltfOptions.quantize.enabled = false;
+	}
+
+	if (gltfOptions.draco.enabled && gltfOptions.interleave)
+	{
+		// Draco primitives have no vertex buffer views at all
+		fmt::printf("Note: Ignoring --interleave; it's meaningless with --draco.\n");
+		gltfOptions.interleave = false;
+	}
+
 	if (outputPath.empty())
 	{
 		// if -o is not given, default to the basename of the .fbx
@@ -386,7 +738,47 @@ int main(int argc, char* argv[])
 		raw.TransformTextures(texturesTransforms);
 	}
 	raw.Condense();
-	raw.TransformGeometry(gltfOptions.computeNormals);
+	if (gltfOptions.dedupeMeshes != DedupeMeshesOption::NEVER)
+	{
+		const RawDedupStats stats =
+			raw.DeduplicateSurfaces(gltfOptions.dedupeMeshes == DedupeMeshesOption::TRANSLATED);
+		if (verboseOutput)
+		{
+			fmt::printf(
+				"Mesh deduplication: merged %d meshes, dropping %d triangles and %d vertices (%lu KB).\n",
+				stats.mergedSurfaces,
+				stats.droppedTriangles,
+				stats.droppedVertices,
+				(unsigned long)(stats.droppedBytes / 1024));
+		}
+	}
+	if (gltfOptions.keyframeReduction.enabled)
+	{
+		const RawKeyframeStats stats = raw.ReduceKeyframes(
+			gltfOptions.keyframeReduction.translation,
+			gltfOptions.keyframeReduction.rotationDegrees,
+			gltfOptions.keyframeReduction.scaleRatio);
+		if (verboseOutput)
+		{
+			fmt::printf(
+				"Keyframe reduction: %lu -> %lu keyframes, %lu KB -> %lu KB of animation data.\n",
+				(unsigned long)stats.keyframesBefore,
+				(unsigned long)stats.keyframesAfter,
+				(unsigned long)(stats.bytesBefore / 1024),
+				(unsigned long)(stats.bytesAfter / 1024));
+		}
+	}
+	raw.TransformGeometry(gltfOptions.computeNormals, gltfOptions.computeTangents);
+	if (verboseOutput)
+	{
+		raw.PrintVertexTableStats("Vertex welding");
+		fmt::printf(
+			"Vertex storage: %d vertices in %lu KB, %lu morph target deltas in %lu KB.\n",
+			raw.GetVertexCount(),
+			(unsigned long)(raw.GetVertexStore().GetMemoryUsage() / 1024),
+			(unsigned long)raw.GetBlendDeltas().Size(),
+			(unsigned long)(raw.GetBlendDeltas().GetMemoryUsage() / 1024));
+	}
 
 	std::ofstream outStream; // note: auto-flushes in destructor
 	const auto streamStart = outStream.tellp();
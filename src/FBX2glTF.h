@@ -10,6 +10,7 @@
 
 #include <climits>
 #include <string>
+#include <vector>
 
 #if defined(_WIN32)
 // Tell Windows not to define min() and max() macros
@@ -67,6 +68,30 @@ enum class ComputeNormalsOption
 	ALWAYS // compute a new normal for every vertex, obliterating whatever may have been there before
 };
 
+/**
+ * When to (re-)compute vertex tangents from normals and UV0.
+ */
+enum class ComputeTangentsOption
+{
+	NEVER,
+	// keep whatever tangents the FBX provides
+	MISSING,
+	// compute tangents for vertices that lack them, including meshes without a tangent layer
+	ALWAYS // compute a new tangent for every vertex, replacing any from the FBX
+};
+
+/**
+ * Whether to merge FBX meshes with identical geometry into a single glTF mesh.
+ */
+enum class DedupeMeshesOption
+{
+	NEVER,
+	// merge meshes whose triangles, materials and vertices are exactly the same
+	EXACT,
+	// also merge meshes that differ by a translation, moving it into the nodes that hold them
+	TRANSLATED
+};
+
 enum class UseLongIndicesOptions
 {
 	NEVER,
@@ -85,6 +110,28 @@ enum class AnimationFramerateOptions
 	// bake animations at 30 fps
 	BAKE60,
 	// bake animations at 60 fps
+	SOURCE,
+	// bake animations at the frame rate of the FBX scene's time mode
+	CUSTOM,
+	// bake animations at GltfOptions::customAnimationFramerate
+};
+
+enum class AnimationEvaluatorOption
+{
+	SDK,
+	// evaluate node transforms with the FBX SDK, one at a time
+	NATIVE,
+	// evaluate the nodes we can on all threads, from a copy of their curves
+	VALIDATE,
+	// evaluate with the FBX SDK, and report how far the native evaluator would be off
+};
+
+enum class AnimationKeysOption
+{
+	BAKED,
+	// sample every animated property at the baking framerate
+	NATIVE,
+	// write out the FBX keys of properties that a glTF sampler reproduces exactly
 };
 
 /**
@@ -118,6 +165,35 @@ struct GltfOptions
 		int quantBitsGeneric = 8;
 	} draco;
 
+	/** Whether and how to store vertex attributes as integers, with KHR_mesh_quantization. */
+	struct
+	{
+		bool enabled = false;
+		int bitsNormal = 8;
+	} quantize;
+
+	/** Whether and how to shrink animation sampler outputs. */
+	struct
+	{
+		bool enabled = false; // rotations and morph target weights become normalized integers
+		int bitsWeight = 8;
+		bool translations = false; // round translations and scales to fewer significant bits
+	} quantizeAnimations;
+
+	/** Whether and when to draw static sibling nodes that share a mesh with EXT_mesh_gpu_instancing. */
+	struct
+	{
+		bool enabled = false;
+		int minInstances = 2;
+	} instancing;
+
+	/** Whether to compress buffer views with EXT_meshopt_compression, which decodes quickly. */
+	bool meshoptCompression{false};
+	/** Whether accessors with the same type and data share their buffer view, or are reused. */
+	bool dedupeAccessors{false};
+	/** Whether to interleave the vertex attributes of each primitive in a single buffer view. */
+	bool interleave{false};
+
 	/** Whether to include FBX User Properties as 'extras' metadata in glTF nodes. */
 	bool enableUserProperties{true};
 
@@ -131,10 +207,43 @@ struct GltfOptions
 	bool useBlendShapeNormals{false};
 	/** Whether to include blend shape tangents, if present according to the SDK. */
 	bool useBlendShapeTangents{false};
+	/** Blend shape offsets no larger than this are dropped, and with them any channel left empty. */
+	float blendShapeEpsilon{0.0f};
 	/** When to compute vertex normals from geometry. */
 	ComputeNormalsOption computeNormals = ComputeNormalsOption::BROKEN;
+	/** When to compute vertex tangents from normals and UV0. */
+	ComputeTangentsOption computeTangents = ComputeTangentsOption::NEVER;
+	/** Whether to merge meshes with the same geometry. */
+	DedupeMeshesOption dedupeMeshes = DedupeMeshesOption::NEVER;
+	/** Whether to reorder triangles for the post-transform vertex cache. */
+	bool optimizeVertexCache{false};
+	/** Whether to reorder triangle clusters to reduce overdraw, at a slight vertex cache cost. */
+	bool optimizeOverdraw{false};
+	/** Whether to renumber vertices in the order the index buffer first uses them. */
+	bool optimizeVertexFetch{false};
+	/** Triangle ratios of the simplified levels of detail to generate, in decreasing order. */
+	std::vector<float> lodRatios;
 	/** When to use 32-bit indices. */
 	UseLongIndicesOptions useLongIndices = UseLongIndicesOptions::AUTO;
 	/** Select baked animation framerate. */
 	AnimationFramerateOptions animationFramerate = AnimationFramerateOptions::BAKE24;
+	/** The baked animation framerate, in frames per second, for AnimationFramerateOptions::CUSTOM. */
+	double customAnimationFramerate{24.0};
+	/** Whether to sample baked animations more densely between frames where they curve sharply. */
+	bool adaptiveAnimationSampling{false};
+	/** How to evaluate node transforms while baking animations. */
+	AnimationEvaluatorOption animationEvaluator = AnimationEvaluatorOption::SDK;
+	/** Whether to bake all animation keys, or keep the FBX keys where possible. */
+	AnimationKeysOption animationKeys = AnimationKeysOption::BAKED;
+	/**
+	 * Whether and how closely to drop baked keyframes that interpolation reproduces. Adaptive
+	 * sampling adds keyframes where interpolation misses by more than the same tolerances.
+	 */
+	struct
+	{
+		bool enabled = false;
+		float translation = 0.0001f; // in scene units
+		float rotationDegrees = 0.05f;
+		float scaleRatio = 0.001f;
+	} keyframeReduction;
 };
@@ -14,7 +14,9 @@
 #include <cstdint>
 #include <cstdio>
 #include <fstream>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <unordered_map>
@@ -22,10 +24,13 @@
 
 #include "FBX2glTF.h"
 
+#include "raw/KeyframeReducer.hpp"
 #include "raw/RawModel.hpp"
 #include "utils/File_Utils.hpp"
 #include "utils/String_Utils.hpp"
+#include "utils/Thread_Utils.hpp"
 
+#include "FbxAnimationAccess.hpp"
 #include "FbxBlendShapesAccess.hpp"
 #include "FbxLayerElementAccess.hpp"
 #include "FbxSkinningAccess.hpp"
@@ -334,6 +339,7 @@ static void ReadMesh(
 		}
 
 		RawVertex rawVertices[3];
+		std::vector<RawBlendDelta> rawBlendDeltas[3];
 
 		for (int vertexIndex = 0; vertexIndex < 3; vertexIndex++, polygonVertexIndex++)
 		{
@@ -412,12 +418,15 @@ static void ReadMesh(
 			if (!targetShapes.empty())
 			{
 				vertex.blendSurfaceIx = rawSurfaceIndex;
-				for (const auto* targetShape : targetShapes)
+				for (size_t targetIx = 0; targetIx < targetShapes.size(); targetIx++)
 				{
-					RawBlendVertex blendVertex;
+					const auto* targetShape = targetShapes[targetIx];
+					RawBlendDelta blendDelta;
+					blendDelta.vertexIndex = -1;
+					blendDelta.channelIndex = (int)targetIx;
 					// The morph target data must be transformed just as with the vertex positions above.
 					const FbxVector4& shapePosition = transform.MultNormalize(targetShape->positions[controlPointIndex]);
-					blendVertex.position = toVec3f(shapePosition - fbxPosition) * scaleFactor;
+					blendDelta.position = toVec3f(shapePosition - fbxPosition) * scaleFactor;
 
 					if (targetShape->normals.LayerPresent())
 					{
@@ -428,7 +437,7 @@ static void ReadMesh(
 							FbxVector4(0.0f, 0.0f, 0.0f, 0.0f),
 							inverseTransposeTransform,
 							true);
-						blendVertex.normal = toVec3f(normal - fbxNormal);
+						blendDelta.normal = toVec3f(normal - fbxNormal);
 					}
 
 					if (targetShape->tangents.LayerPresent())
@@ -440,11 +449,18 @@ static void ReadMesh(
 							FbxVector4(0.0f, 0.0f, 0.0f, 0.0f),
 							inverseTransposeTransform,
 							true);
-						blendVertex.tangent = toVec4f(tangent - fbxTangent);
+						blendDelta.tangent = toVec4f(tangent - fbxTangent);
 					}
 
-					vertex.blends.push_back(blendVertex);
+					// only non-zero offsets are stored
+					if (!blendDelta.IsZero())
+					{
+						rawBlendDeltas[vertexIndex].push_back(blendDelta);
+					}
 				}
+				const std::vector<RawBlendDelta>& deltas = rawBlendDeltas[vertexIndex];
+				vertex.blendFingerprint =
+					RawBlendDeltaStore::Fingerprint(deltas.data(), deltas.data() + deltas.size());
 			}
 			else
 			{
@@ -508,7 +524,10 @@ static void ReadMesh(
 
 		int rawVertexIndices[3];
 		for (int vertexIndex = 0; vertexIndex < 3; vertexIndex++)
-			rawVertexIndices[vertexIndex] = raw.AddVertex(rawVertices[vertexIndex]);
+		{
+			// a welded vertex already carries identical deltas
+			rawVertexIndices[vertexIndex] = raw.AddVertex(rawVertices[vertexIndex], rawBlendDeltas[vertexIndex]);
+		}
 
 		const int rawMaterialIndex = raw.AddMaterial(
 			materialId,
@@ -846,22 +865,386 @@ static void ReadNodeHierarchy(
 	}
 }
 
-static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& options)
+// add pNode and its descendants to animatedNodes where an animated parent moves their local transform
+static void AddInheritedMotion(
+	FbxNode* pNode,
+	bool parentAnimated,
+	std::set<FbxNode*>& animatedNodes,
+	std::set<FbxNode*>& drivenNodes)
+{
+	if (parentAnimated && pNode->GetTransform().GetInheritType() != FbxTransform::eInheritRSrs)
+	{
+		animatedNodes.insert(pNode);
+		drivenNodes.insert(pNode);
+	}
+	const bool animated = animatedNodes.count(pNode) > 0;
+	for (int childIx = 0; childIx < pNode->GetChildCount(); childIx++)
+	{
+		AddInheritedMotion(pNode->GetChild(childIx), animated, animatedNodes, drivenNodes);
+	}
+}
+
+/**
+ * The nodes whose local transform may change during an animation stack: the targets of its
+ * animation curves, nodes that constraints or characters drive, and nodes whose inherit type
+ * compensates for the motion of an animated parent. Everything else needs no sampling. Those
+ * that move for any other reason than their own curves are also added to drivenNodes.
+ */
+static std::set<FbxNode*>
+FindAnimatedNodes(FbxScene* pScene, FbxAnimStack* pAnimStack, std::set<FbxNode*>& drivenNodes)
+{
+	std::set<FbxNode*> animatedNodes;
+	for (int layerIx = 0; layerIx < pAnimStack->GetMemberCount<FbxAnimLayer>(); layerIx++)
+	{
+		FbxAnimLayer* layer = pAnimStack->GetMember<FbxAnimLayer>(layerIx);
+		for (int curveNodeIx = 0; curveNodeIx < layer->GetMemberCount<FbxAnimCurveNode>(); curveNodeIx++)
+		{
+			FbxAnimCurveNode* curveNode = layer->GetMember<FbxAnimCurveNode>(curveNodeIx);
+			bool hasKeys = false;
+			for (unsigned int channelIx = 0; channelIx < curveNode->GetChannelsCount() && !hasKeys; channelIx++)
+			{
+				for (int curveIx = 0; curveIx < curveNode->GetCurveCount(channelIx); curveIx++)
+				{
+					FbxAnimCurve* curve = curveNode->GetCurve(channelIx, curveIx);
+					if (curve != nullptr && curve->KeyGetCount() > 0)
+					{
+						hasKeys = true;
+						break;
+					}
+				}
+			}
+			if (!hasKeys)
+			{
+				continue;
+			}
+			for (int propIx = 0; propIx < curveNode->GetDstPropertyCount(); propIx++)
+			{
+				FbxNode* pNode = FbxCast<FbxNode>(curveNode->GetDstProperty(propIx).GetFbxObject());
+				if (pNode != nullptr)
+				{
+					animatedNodes.insert(pNode);
+				}
+			}
+		}
+	}
+
+	for (int constraintIx = 0; constraintIx < pScene->GetSrcObjectCount<FbxConstraint>(); constraintIx++)
+	{
+		FbxConstraint* constraint = pScene->GetSrcObject<FbxConstraint>(constraintIx);
+		FbxNode* pNode = FbxCast<FbxNode>(constraint->GetConstrainedObject());
+		if (pNode != nullptr && constraint->Active.Get())
+		{
+			animatedNodes.insert(pNode);
+			drivenNodes.insert(pNode);
+		}
+	}
+	for (int characterIx = 0; characterIx < pScene->GetCharacterCount(); characterIx++)
+	{
+		FbxCharacter* character = pScene->GetCharacter(characterIx);
+		for (int nodeId = 0; nodeId < FbxCharacter::eCharacterLastNodeId; nodeId++)
+		{
+			FbxCharacterLink link;
+			if (character->GetCharacterLink((FbxCharacter::ENodeId)nodeId, &link) && link.mNode != nullptr)
+			{
+				animatedNodes.insert(link.mNode);
+				drivenNodes.insert(link.mNode);
+			}
+		}
+	}
+
+	AddInheritedMotion(pScene->GetRootNode(), false, animatedNodes, drivenNodes);
+	return animatedNodes;
+}
+
+// a local transform as computed by FbxAnimationAccess
+struct NativeSample
+{
+	FbxVector4 translation;
+	FbxQuaternion rotation;
+	FbxVector4 scale;
+};
+
+// native translations and scales may differ by this fraction of their magnitude (or of 1, if less)
+static const double NATIVE_RELATIVE_TOLERANCE = 1e-4;
+static const double NATIVE_ROTATION_TOLERANCE_DEGREES = 0.01;
+
+// How closely native samples match the FBX SDK, for --anim-evaluator validate.
+struct NativeValidationStats
+{
+	size_t sampleCount = 0;
+	size_t mismatchCount = 0;
+	double maxTranslationError = 0.0;
+	double maxRotationError = 0.0;
+	double maxScaleError = 0.0;
+
+	void Add(const NativeSample& native, const NativeSample& reference)
+	{
+		double translationError = 0.0;
+		double scaleError = 0.0;
+		bool mismatch = false;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const double dt = fabs(native.translation[axis] - reference.translation[axis]);
+			const double ds = fabs(native.scale[axis] - reference.scale[axis]);
+			mismatch |= dt > NATIVE_RELATIVE_TOLERANCE * std::max(1.0, fabs(reference.translation[axis]));
+			mismatch |= ds > NATIVE_RELATIVE_TOLERANCE * std::max(1.0, fabs(reference.scale[axis]));
+			translationError = std::max(translationError, dt);
+			scaleError = std::max(scaleError, ds);
+		}
+		double dot = 0.0;
+		for (int ix = 0; ix < 4; ix++)
+		{
+			dot += native.rotation[ix] * reference.rotation[ix];
+		}
+		const double rotationError = 2.0 * acos(std::min(fabs(dot), 1.0)) * 180.0 / M_PI;
+		mismatch |= rotationError > NATIVE_ROTATION_TOLERANCE_DEGREES;
+
+		sampleCount++;
+		mismatchCount += mismatch ? 1 : 0;
+		maxTranslationError = std::max(maxTranslationError, translationError);
+		maxRotationError = std::max(maxRotationError, rotationError);
+		maxScaleError = std::max(maxScaleError, scaleError);
+	}
+};
+
+/**
+ * For --anim-keys native: copies the FBX keys of a property into the channel if a glTF sampler
+ * reproduces them, with times relative to the start of the animation. Returns false if the
+ * property must be baked instead; isAnimated tells whether the keys leave its static value.
+ */
+static bool ReadNativeKeys(
+	const FbxAnimationAccess& animationAccess,
+	FbxNode* pNode,
+	const FbxAnimationAccess::Property property,
+	const double startTime,
+	const FbxDouble4& staticValue,
+	const double epsilon,
+	RawChannel& channel,
+	bool& isAnimated)
+{
+	FbxAnimationAccess::SamplerKeys keys;
+	if (!animationAccess.ConvertKeys(pNode, property, keys))
+	{
+		return false;
+	}
+	const bool isCubic = keys.interpolation == FbxAnimationAccess::SamplerKeys::CUBICSPLINE;
+	const int componentCount = (property == FbxAnimationAccess::ROTATION) ? 4 : 3;
+
+	isAnimated = false;
+	for (size_t valueIx = 0; valueIx < keys.values.size() && !isAnimated; valueIx++)
+	{
+		const bool isTangent = isCubic && valueIx % 3 != 1;
+		for (int ix = 0; ix < componentCount; ix++)
+		{
+			isAnimated |= fabs(keys.values[valueIx][ix] - (isTangent ? 0.0 : staticValue[ix])) > epsilon;
+		}
+	}
+	if (!isAnimated)
+	{
+		return true;
+	}
+
+	RawInterpolation interpolation = RAW_INTERPOLATION_LINEAR;
+	if (keys.interpolation == FbxAnimationAccess::SamplerKeys::STEP)
+	{
+		interpolation = RAW_INTERPOLATION_STEP;
+	}
+	else if (isCubic)
+	{
+		interpolation = RAW_INTERPOLATION_CUBICSPLINE;
+	}
+	std::vector<float> times;
+	times.reserve(keys.times.size());
+	for (const double time : keys.times)
+	{
+		times.push_back((float)(time - startTime));
+	}
+
+	for (const FbxDouble4& value : keys.values)
+	{
+		switch (property)
+		{
+		case FbxAnimationAccess::TRANSLATION:
+			channel.translations.push_back(toVec3f(FbxVector4(value[0], value[1], value[2])) * scaleFactor);
+			break;
+		case FbxAnimationAccess::ROTATION:
+			channel.rotations.push_back(toQuatf(FbxQuaternion(value[0], value[1], value[2], value[3])));
+			break;
+		case FbxAnimationAccess::SCALING:
+			channel.scales.push_back(toVec3f(FbxVector4(value[0], value[1], value[2])));
+			break;
+		}
+	}
+	switch (property)
+	{
+	case FbxAnimationAccess::TRANSLATION:
+		channel.translationTimes = std::move(times);
+		channel.translationInterpolation = interpolation;
+		break;
+	case FbxAnimationAccess::ROTATION:
+		channel.rotationTimes = std::move(times);
+		channel.rotationInterpolation = interpolation;
+		break;
+	case FbxAnimationAccess::SCALING:
+		channel.scaleTimes = std::move(times);
+		channel.scaleInterpolation = interpolation;
+		break;
+	}
+	return true;
+}
+
+/**
+ * Converts between frames and times at the baking framerate, which need not be one of the
+ * FbxTime::EMode rates. Times are rounded to whole ticks, so that a key that falls on a frame is
+ * sampled exactly at its own time.
+ */
+struct FrameClock
+{
+	double framesPerSecond;
+
+	FbxTime GetTime(const double frame) const
+	{
+		FbxTime time;
+		time.Set((FbxLongLong)std::llround(frame * (double)FBXSDK_TC_SECOND / framesPerSecond));
+		return time;
+	}
+
+	double GetFrame(const FbxTime time) const
+	{
+		return (double)time.Get() * framesPerSecond / (double)FBXSDK_TC_SECOND;
+	}
+
+	// the last frame at or before the time, and the first frame at or after it
+	FbxLongLong GetFrameBefore(const FbxTime time) const
+	{
+		return (FbxLongLong)std::floor(GetFrame(time) + 1e-6);
+	}
+
+	FbxLongLong GetFrameAfter(const FbxTime time) const
+	{
+		return (FbxLongLong)std::ceil(GetFrame(time) - 1e-6);
+	}
+};
+
+static double GetAnimationFramerate(FbxScene* pScene, const GltfOptions& options)
 {
-	FbxTime::EMode eMode = FbxTime::eFrames24;
 	switch (options.animationFramerate)
 	{
 	case AnimationFramerateOptions::BAKE24:
-		eMode = FbxTime::eFrames24;
-		break;
+		return 24.0;
 	case AnimationFramerateOptions::BAKE30:
-		eMode = FbxTime::eFrames30;
-		break;
+		return 30.0;
 	case AnimationFramerateOptions::BAKE60:
-		eMode = FbxTime::eFrames60;
+		return 60.0;
+	case AnimationFramerateOptions::CUSTOM:
+		return options.customAnimationFramerate;
+	case AnimationFramerateOptions::SOURCE:
 		break;
 	}
+	FbxGlobalSettings& settings = pScene->GetGlobalSettings();
+	const FbxTime::EMode timeMode = settings.GetTimeMode();
+	const double framerate =
+		(timeMode == FbxTime::eCustom) ? settings.GetCustomFrameRate() : FbxTime::GetFrameRate(timeMode);
+	if (framerate <= 0.0)
+	{
+		fmt::printf("Warning: the FBX scene has no frame rate, baking animations at 24 fps.\n");
+		return 24.0;
+	}
+	return framerate;
+}
+
+// how many times --anim-adaptive may halve the interval between two baked frames
+static const int ADAPTIVE_MAX_SUBDIVISIONS = 3;
+
+/**
+ * Samples a property halfway between frameA and frameB, unless fits(a, b, halfway) says that
+ * interpolating between a and b comes close enough, and then does the same for both halves. The
+ * samples kept are appended in order of time.
+ */
+template <typename T, typename Sample, typename Fits>
+static void SubdivideSamples(
+	const double frameA,
+	const T& a,
+	const double frameB,
+	const T& b,
+	const int depth,
+	const Sample& sample,
+	const Fits& fits,
+	std::vector<double>& frames,
+	std::vector<T>& values)
+{
+	if (depth == 0)
+	{
+		return;
+	}
+	const double frame = (frameA + frameB) * 0.5;
+	const T value = sample(frame);
+	if (fits(a, b, value))
+	{
+		return;
+	}
+	SubdivideSamples(frameA, a, frame, value, depth - 1, sample, fits, frames, values);
+	frames.push_back(frame);
+	values.push_back(value);
+	SubdivideSamples(frame, value, frameB, b, depth - 1, sample, fits, frames, values);
+}
+
+/**
+ * For --anim-adaptive: refines a property baked at every frame of an animation, where
+ * interpolating between two frames misses the curve; sample(frame) counts frames from the start
+ * of the animation. If that adds any samples, the values are replaced and the property gets times
+ * of its own. Returns the number of samples added.
+ */
+template <typename T, typename Sample, typename Fits>
+static size_t RefineSamples(
+	std::vector<T>& values,
+	std::vector<float>& times,
+	const FrameClock& clock,
+	const Sample& sample,
+	const Fits& fits)
+{
+	std::vector<double> refinedFrames;
+	std::vector<T> refinedValues;
+	for (size_t ix = 0; ix < values.size(); ix++)
+	{
+		const double frame = (double)ix;
+		if (ix > 0)
+		{
+			SubdivideSamples(
+				frame - 1.0,
+				values[ix - 1],
+				frame,
+				values[ix],
+				ADAPTIVE_MAX_SUBDIVISIONS,
+				sample,
+				fits,
+				refinedFrames,
+				refinedValues);
+		}
+		refinedFrames.push_back(frame);
+		refinedValues.push_back(values[ix]);
+	}
+	const size_t addedCount = refinedValues.size() - values.size();
+	if (addedCount > 0)
+	{
+		values.swap(refinedValues);
+		times.clear();
+		for (const double frame : refinedFrames)
+		{
+			times.push_back((float)clock.GetTime(frame).GetSecondDouble());
+		}
+	}
+	return addedCount;
+}
+
+static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& options)
+{
+	const FrameClock clock{GetAnimationFramerate(pScene, options)};
 	const double epsilon = 1e-5f;
+	if (verboseOutput)
+	{
+		fmt::printf("Baking animations at %g frames per second.\n", clock.framesPerSecond);
+	}
 
 	const int animationCount = pScene->GetSrcObjectCount<FbxAnimStack>();
 	for (int animIx = 0; animIx < animationCount; animIx++)
@@ -904,8 +1287,8 @@ static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& o
 					// simply take the interval as first key to last key
 					int firstKeyIndex = 0;
 					int lastKeyIndex = std::max(firstKeyIndex, curve->KeyGetCount() - 1);
-					FbxLongLong firstCurveFrame = curve->KeyGetTime(firstKeyIndex).GetFrameCount(eMode);
-					FbxLongLong lastCurveFrame = curve->KeyGetTime(lastKeyIndex).GetFrameCount(eMode);
+					FbxLongLong firstCurveFrame = clock.GetFrameBefore(curve->KeyGetTime(firstKeyIndex));
+					FbxLongLong lastCurveFrame = clock.GetFrameAfter(curve->KeyGetTime(lastKeyIndex));
 
 					// the final interval is the union of all node curve intervals
 					if (firstFrameIndex == -1 || firstCurveFrame < firstFrameIndex)
@@ -935,22 +1318,82 @@ static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& o
 
 		for (FbxLongLong frameIndex = firstFrameIndex; frameIndex <= lastFrameIndex; frameIndex++)
 		{
-			FbxTime pTime;
 			// first frame is always at t = 0.0
-			pTime.SetFrame(frameIndex - firstFrameIndex, eMode);
+			const FbxTime pTime = clock.GetTime((double)(frameIndex - firstFrameIndex));
 			animation.times.emplace_back((float)pTime.GetSecondDouble());
 		}
 
 		size_t totalSizeInBytes = 0;
+		std::set<FbxNode*> drivenNodes;
+		const std::set<FbxNode*> animatedNodes = FindAnimatedNodes(pScene, pAnimStack, drivenNodes);
+		int sampledNodes = 0;
+		size_t skippedEvaluations = 0;
+
+		// the native evaluator samples the nodes it supports up front, on all threads
+		const size_t frameCount = (size_t)(lastFrameIndex - firstFrameIndex + 1);
+		std::unordered_map<FbxNode*, size_t> nativeSampleOffsets;
+		std::vector<NativeSample> nativeSamples;
+		std::unique_ptr<FbxAnimationAccess> animationAccess;
+		std::set<FbxNode*> curveDrivenNodes;
+		if (options.animationEvaluator != AnimationEvaluatorOption::SDK ||
+			options.animationKeys == AnimationKeysOption::NATIVE)
+		{
+			std::set_difference(
+				animatedNodes.begin(),
+				animatedNodes.end(),
+				drivenNodes.begin(),
+				drivenNodes.end(),
+				std::inserter(curveDrivenNodes, curveDrivenNodes.end()));
+			animationAccess.reset(new FbxAnimationAccess(pAnimStack, curveDrivenNodes));
+		}
+		if (options.animationEvaluator != AnimationEvaluatorOption::SDK)
+		{
+			std::vector<FbxNode*> nativeNodes;
+			for (FbxNode* pNode : curveDrivenNodes)
+			{
+				if (animationAccess->Supports(pNode))
+				{
+					nativeSampleOffsets[pNode] = nativeNodes.size() * frameCount;
+					nativeNodes.push_back(pNode);
+				}
+			}
+			std::vector<double> frameTimes(frameCount);
+			for (size_t frameIx = 0; frameIx < frameCount; frameIx++)
+			{
+				frameTimes[frameIx] =
+					clock.GetTime((double)(firstFrameIndex + (FbxLongLong)frameIx)).GetSecondDouble();
+			}
+
+			nativeSamples.resize(nativeNodes.size() * frameCount);
+			ThreadUtils::ParallelForBlocks(
+				nativeSamples.size(), 256, [&](const size_t begin, const size_t end) {
+					for (size_t sampleIx = begin; sampleIx < end; sampleIx++)
+					{
+						const FbxAMatrix localTransform = animationAccess->EvaluateLocalTransform(
+							nativeNodes[sampleIx / frameCount], frameTimes[sampleIx % frameCount]);
+						nativeSamples[sampleIx] =
+							NativeSample{localTransform.GetT(), localTransform.GetQ(), localTransform.GetS()};
+					}
+				});
+			if (verboseOutput)
+			{
+				fmt::printf(
+					"animation %d: native evaluator sampled %lu of %lu animated nodes on all threads\n",
+					animIx,
+					(unsigned long)nativeNodes.size(),
+					(unsigned long)animatedNodes.size());
+			}
+		}
+		NativeValidationStats validation;
+		const FbxTime startTime = clock.GetTime((double)firstFrameIndex);
+		size_t adaptiveSamples = 0;
+		int bakedProperties = 0;
+		int nativeProperties = 0;
 
 		const int nodeCount = pScene->GetNodeCount();
 		for (int nodeIndex = 0; nodeIndex < nodeCount; nodeIndex++)
 		{
 			FbxNode* pNode = pScene->GetNode(nodeIndex);
-			const FbxAMatrix baseTransform = pNode->EvaluateLocalTransform();
-			const FbxVector4 baseTranslation = baseTransform.GetT();
-			const FbxQuaternion baseRotation = baseTransform.GetQ();
-			const FbxVector4 baseScaling = computeLocalScale(pNode);
 			bool hasTranslation = false;
 			bool hasRotation = false;
 			bool hasScale = false;
@@ -959,33 +1402,196 @@ static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& o
 			RawChannel channel;
 			channel.nodeIndex = raw.GetNodeById(pNode->GetUniqueID());
 
-			for (FbxLongLong frameIndex = firstFrameIndex; frameIndex <= lastFrameIndex; frameIndex++)
+			// nodes without motion of their own may still carry blend shape animation
+			const bool isAnimated = animatedNodes.count(pNode) > 0;
+			if (isAnimated)
 			{
-				FbxTime pTime;
-				pTime.SetFrame(frameIndex, eMode);
-
-				const FbxAMatrix localTransform = pNode->EvaluateLocalTransform(pTime);
-				const FbxVector4 localTranslation = localTransform.GetT();
-				const FbxQuaternion localRotation = localTransform.GetQ();
-				const FbxVector4 localScale = computeLocalScale(pNode, pTime);
-
-				hasTranslation |=
-				(fabs(localTranslation[0] - baseTranslation[0]) > epsilon ||
-					fabs(localTranslation[1] - baseTranslation[1]) > epsilon ||
-					fabs(localTranslation[2] - baseTranslation[2]) > epsilon);
-				hasRotation |=
-				(fabs(localRotation[0] - baseRotation[0]) > epsilon ||
-					fabs(localRotation[1] - baseRotation[1]) > epsilon ||
-					fabs(localRotation[2] - baseRotation[2]) > epsilon ||
-					fabs(localRotation[3] - baseRotation[3]) > epsilon);
-				hasScale |=
-				(fabs(localScale[0] - baseScaling[0]) > epsilon ||
-					fabs(localScale[1] - baseScaling[1]) > epsilon ||
-					fabs(localScale[2] - baseScaling[2]) > epsilon);
-
-				channel.translations.push_back(toVec3f(localTranslation) * scaleFactor);
-				channel.rotations.push_back(toQuatf(localRotation));
-				channel.scales.push_back(toVec3f(localScale));
+				sampledNodes++;
+			}
+			else
+			{
+				skippedEvaluations += (size_t)(lastFrameIndex - firstFrameIndex + 1);
+			}
+			const FbxAMatrix baseTransform = isAnimated ? pNode->EvaluateLocalTransform() : FbxAMatrix();
+			const FbxVector4 baseTranslation = baseTransform.GetT();
+			const FbxQuaternion baseRotation = baseTransform.GetQ();
+			const FbxVector4 baseScaling = isAnimated ? computeLocalScale(pNode) : FbxVector4();
+			const auto nativeIter = nativeSampleOffsets.find(pNode);
+			const NativeSample* native =
+				(nativeIter != nativeSampleOffsets.end()) ? &nativeSamples[nativeIter->second] : nullptr;
+
+			// properties whose FBX keys a glTF sampler reproduces are not baked
+			bool nativeTranslation = false;
+			bool nativeRotation = false;
+			bool nativeScale = false;
+			if (isAnimated && options.animationKeys == AnimationKeysOption::NATIVE &&
+				animationAccess->Supports(pNode))
+			{
+				const double startSeconds = startTime.GetSecondDouble();
+				nativeTranslation = ReadNativeKeys(
+					*animationAccess,
+					pNode,
+					FbxAnimationAccess::TRANSLATION,
+					startSeconds,
+					baseTranslation,
+					epsilon,
+					channel,
+					hasTranslation);
+				nativeRotation = ReadNativeKeys(
+					*animationAccess,
+					pNode,
+					FbxAnimationAccess::ROTATION,
+					startSeconds,
+					baseRotation,
+					epsilon,
+					channel,
+					hasRotation);
+				nativeScale = ReadNativeKeys(
+					*animationAccess,
+					pNode,
+					FbxAnimationAccess::SCALING,
+					startSeconds,
+					baseScaling,
+					epsilon,
+					channel,
+					hasScale);
+			}
+			if (isAnimated)
+			{
+				nativeProperties += (nativeTranslation ? 1 : 0) + (nativeRotation ? 1 : 0) + (nativeScale ? 1 : 0);
+				bakedProperties += (nativeTranslation ? 0 : 1) + (nativeRotation ? 0 : 1) + (nativeScale ? 0 : 1);
+			}
+			const bool needsBaking = isAnimated && !(nativeTranslation && nativeRotation && nativeScale);
+
+			for (FbxLongLong frameIndex = firstFrameIndex; needsBaking && frameIndex <= lastFrameIndex;
+				 frameIndex++)
+			{
+				FbxVector4 localTranslation;
+				FbxQuaternion localRotation;
+				FbxVector4 localScale;
+				if (native != nullptr && options.animationEvaluator == AnimationEvaluatorOption::NATIVE)
+				{
+					const NativeSample& sample = native[frameIndex - firstFrameIndex];
+					localTranslation = sample.translation;
+					localRotation = sample.rotation;
+					localScale = sample.scale;
+				}
+				else
+				{
+					const FbxTime pTime = clock.GetTime((double)frameIndex);
+
+					const FbxAMatrix localTransform = pNode->EvaluateLocalTransform(pTime);
+					localTranslation = localTransform.GetT();
+					localRotation = localTransform.GetQ();
+					localScale = computeLocalScale(pNode, pTime);
+					if (native != nullptr)
+					{
+						validation.Add(
+							native[frameIndex - firstFrameIndex],
+							NativeSample{localTranslation, localRotation, localScale});
+					}
+				}
+
+				if (!nativeTranslation)
+				{
+					hasTranslation |=
+					(fabs(localTranslation[0] - baseTranslation[0]) > epsilon ||
+						fabs(localTranslation[1] - baseTranslation[1]) > epsilon ||
+						fabs(localTranslation[2] - baseTranslation[2]) > epsilon);
+					channel.translations.push_back(toVec3f(localTranslation) * scaleFactor);
+				}
+				if (!nativeRotation)
+				{
+					hasRotation |=
+					(fabs(localRotation[0] - baseRotation[0]) > epsilon ||
+						fabs(localRotation[1] - baseRotation[1]) > epsilon ||
+						fabs(localRotation[2] - baseRotation[2]) > epsilon ||
+						fabs(localRotation[3] - baseRotation[3]) > epsilon);
+					channel.rotations.push_back(toQuatf(localRotation));
+				}
+				if (!nativeScale)
+				{
+					hasScale |=
+					(fabs(localScale[0] - baseScaling[0]) > epsilon ||
+						fabs(localScale[1] - baseScaling[1]) > epsilon ||
+						fabs(localScale[2] - baseScaling[2]) > epsilon);
+					channel.scales.push_back(toVec3f(localScale));
+				}
+			}
+
+			if (needsBaking && options.adaptiveAnimationSampling)
+			{
+				// samples halfway between frames, shared by translation, rotation and scale
+				std::map<double, NativeSample> halfwaySamples;
+				const auto sampleAt = [&](const double frame) -> const NativeSample& {
+					auto iter = halfwaySamples.find(frame);
+					if (iter == halfwaySamples.end())
+					{
+						const FbxTime pTime = clock.GetTime((double)firstFrameIndex + frame);
+						NativeSample sample;
+						if (native != nullptr && options.animationEvaluator == AnimationEvaluatorOption::NATIVE)
+						{
+							const FbxAMatrix localTransform =
+								animationAccess->EvaluateLocalTransform(pNode, pTime.GetSecondDouble());
+							sample =
+								NativeSample{localTransform.GetT(), localTransform.GetQ(), localTransform.GetS()};
+						}
+						else
+						{
+							const FbxAMatrix localTransform = pNode->EvaluateLocalTransform(pTime);
+							sample = NativeSample{
+								localTransform.GetT(), localTransform.GetQ(), computeLocalScale(pNode, pTime)};
+						}
+						iter = halfwaySamples.emplace(frame, sample).first;
+					}
+					return iter->second;
+				};
+				const auto& tolerances = options.keyframeReduction;
+
+				if (hasTranslation && !nativeTranslation)
+				{
+					adaptiveSamples += RefineSamples(
+						channel.translations,
+						channel.translationTimes,
+						clock,
+						[&](const double frame) { return toVec3f(sampleAt(frame).translation) * scaleFactor; },
+						[&](const Vec3f& a, const Vec3f& b, const Vec3f& halfway) {
+							const Vec3f error = (a + b) * 0.5f - halfway;
+							return Vec3f::DotProduct(error, error) <=
+								tolerances.translation * tolerances.translation;
+						});
+				}
+				if (hasRotation && !nativeRotation)
+				{
+					adaptiveSamples += RefineSamples(
+						channel.rotations,
+						channel.rotationTimes,
+						clock,
+						[&](const double frame) { return toQuatf(sampleAt(frame).rotation); },
+						[&](const Quatf& a, const Quatf& b, const Quatf& halfway) {
+							return KeyframeReducer::AngleBetween(KeyframeReducer::Slerp(a, b, 0.5f), halfway) <=
+								tolerances.rotationDegrees;
+						});
+				}
+				if (hasScale && !nativeScale)
+				{
+					adaptiveSamples += RefineSamples(
+						channel.scales,
+						channel.scaleTimes,
+						clock,
+						[&](const double frame) { return toVec3f(sampleAt(frame).scale); },
+						[&](const Vec3f& a, const Vec3f& b, const Vec3f& halfway) {
+							const Vec3f scale = (a + b) * 0.5f;
+							for (int axis = 0; axis < 3; axis++)
+							{
+								if (fabs(scale[axis] - halfway[axis]) > tolerances.scaleRatio * fabs(halfway[axis]))
+								{
+									return false;
+								}
+							}
+							return true;
+						});
+				}
 			}
 
 			std::vector<FbxAnimCurve*> shapeAnimCurves;
@@ -998,8 +1604,7 @@ static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& o
 
 				for (FbxLongLong frameIndex = firstFrameIndex; frameIndex <= lastFrameIndex; frameIndex++)
 				{
-					FbxTime pTime;
-					pTime.SetFrame(frameIndex, eMode);
+					const FbxTime pTime = clock.GetTime((double)frameIndex);
 
 					for (size_t channelIx = 0; channelIx < blendShapes.GetChannelCount(); channelIx++)
 					{
@@ -1110,6 +1715,34 @@ static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& o
 
 		raw.AddAnimation(animation);
 
+		if (verboseOutput && options.adaptiveAnimationSampling)
+		{
+			fmt::printf(
+				"animation %d: adaptive sampling added %lu samples between frames\n",
+				animIx,
+				(unsigned long)adaptiveSamples);
+		}
+		if (verboseOutput && options.animationKeys == AnimationKeysOption::NATIVE)
+		{
+			fmt::printf(
+				"animation %d: wrote the FBX keys of %d animated properties, baked the other %d\n",
+				animIx,
+				nativeProperties,
+				bakedProperties);
+		}
+		if (options.animationEvaluator == AnimationEvaluatorOption::VALIDATE)
+		{
+			fmt::printf(
+				"animation %d: %lu of %lu native evaluator samples differ from the FBX SDK (largest "
+				"errors: translation %g, rotation %g degrees, scale %g)\n",
+				animIx,
+				(unsigned long)validation.mismatchCount,
+				(unsigned long)validation.sampleCount,
+				validation.maxTranslationError,
+				validation.maxRotationError,
+				validation.maxScaleError);
+		}
+
 		if (verboseOutput)
 		{
 			fmt::printf(
@@ -1118,6 +1751,11 @@ static void ReadAnimations(RawModel& raw, FbxScene* pScene, const GltfOptions& o
 				(const char*)animStackName,
 				(int)animation.channels.size(),
 				(float)totalSizeInBytes * 1e-6f);
+			fmt::printf(
+				"  sampled %d of %d nodes, skipping %lu transform evaluations of unanimated nodes\n",
+				sampledNodes,
+				nodeCount,
+				(unsigned long)skippedEvaluations);
 		}
 	}
 }
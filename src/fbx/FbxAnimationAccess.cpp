@@ -0,0 +1,461 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "FbxAnimationAccess.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+// the handle length of unweighted tangents, as a fraction of the segment
+static const double DEFAULT_TANGENT_WEIGHT = 1.0 / 3.0;
+
+double FbxAnimationAccess::Curve::Evaluate(const double time) const
+{
+	if (times.empty())
+	{
+		return constantValue;
+	}
+	// only constant extrapolation is supported
+	if (time <= times.front())
+	{
+		return values.front();
+	}
+	if (time >= times.back())
+	{
+		return values.back();
+	}
+
+	const size_t k = (size_t)(std::upper_bound(times.begin(), times.end(), time) - times.begin()) - 1;
+	const double duration = times[k + 1] - times[k];
+	const double u = (time - times[k]) / duration;
+	switch (interpolations[k])
+	{
+	case CONSTANT:
+		return values[k];
+	case CONSTANT_NEXT:
+		return values[k + 1];
+	case LINEAR:
+		return values[k] + (values[k + 1] - values[k]) * u;
+	case CUBIC:
+		break;
+	}
+
+	// a Bezier segment whose handles point along the tangents; time only runs linearly along it
+	// when both handles are a third of the segment long, otherwise solve for the Bezier parameter
+	const double w0 = rightWeights[k];
+	const double w1 = leftWeights[k + 1];
+	double s = u;
+	if (!HasDefaultWeights(k))
+	{
+		double lo = 0.0;
+		double hi = 1.0;
+		for (int iteration = 0; iteration < 40; iteration++)
+		{
+			s = 0.5 * (lo + hi);
+			const double r = 1.0 - s;
+			const double x = 3.0 * w0 * s * r * r + 3.0 * (1.0 - w1) * s * s * r + s * s * s;
+			if (x < u)
+			{
+				lo = s;
+			}
+			else
+			{
+				hi = s;
+			}
+		}
+		s = 0.5 * (lo + hi);
+	}
+	const double c0 = values[k] + rightSlopes[k] * w0 * duration;
+	const double c1 = values[k + 1] - leftSlopes[k + 1] * w1 * duration;
+	const double r = 1.0 - s;
+	return values[k] * r * r * r + 3.0 * c0 * s * r * r + 3.0 * c1 * s * s * r + values[k + 1] * s * s * s;
+}
+
+bool FbxAnimationAccess::Curve::HasDefaultWeights(const size_t k) const
+{
+	return std::fabs(rightWeights[k] - DEFAULT_TANGENT_WEIGHT) <= 1e-6 &&
+		std::fabs(leftWeights[k + 1] - DEFAULT_TANGENT_WEIGHT) <= 1e-6;
+}
+
+static bool ReadCurve(FbxAnimCurve* pCurve, const double defaultValue, FbxAnimationAccess::Curve& curve)
+{
+	curve.constantValue = defaultValue;
+	if (pCurve == nullptr || pCurve->KeyGetCount() == 0)
+	{
+		return true;
+	}
+	if (pCurve->GetPreExtrapolation() != FbxAnimCurveBase::eConstant ||
+		pCurve->GetPostExtrapolation() != FbxAnimCurveBase::eConstant)
+	{
+		return false;
+	}
+
+	const int keyCount = pCurve->KeyGetCount();
+	curve.times.resize(keyCount);
+	curve.values.resize(keyCount);
+	curve.interpolations.resize(keyCount);
+	curve.rightSlopes.resize(keyCount);
+	curve.leftSlopes.resize(keyCount);
+	curve.rightWeights.resize(keyCount);
+	curve.leftWeights.resize(keyCount);
+	for (int keyIx = 0; keyIx < keyCount; keyIx++)
+	{
+		curve.times[keyIx] = pCurve->KeyGetTime(keyIx).GetSecondDouble();
+		curve.values[keyIx] = pCurve->KeyGetValue(keyIx);
+		switch (pCurve->KeyGetInterpolation(keyIx))
+		{
+		case FbxAnimCurveDef::eInterpolationConstant:
+			curve.interpolations[keyIx] =
+				(pCurve->KeyGetConstantMode(keyIx) == FbxAnimCurveDef::eConstantNext)
+				? FbxAnimationAccess::Curve::CONSTANT_NEXT
+				: FbxAnimationAccess::Curve::CONSTANT;
+			break;
+		case FbxAnimCurveDef::eInterpolationLinear:
+			curve.interpolations[keyIx] = FbxAnimationAccess::Curve::LINEAR;
+			break;
+		default:
+			curve.interpolations[keyIx] = FbxAnimationAccess::Curve::CUBIC;
+			break;
+		}
+		// the SDK resolves auto, TCB and clamped tangents into plain derivatives for us
+		curve.rightSlopes[keyIx] = pCurve->KeyGetRightDerivative(keyIx);
+		curve.leftSlopes[keyIx] = pCurve->KeyGetLeftDerivative(keyIx);
+		curve.rightWeights[keyIx] = pCurve->KeyIsRightTangentWeighted(keyIx)
+			? pCurve->KeyGetRightTangentWeight(keyIx)
+			: DEFAULT_TANGENT_WEIGHT;
+		curve.leftWeights[keyIx] = pCurve->KeyIsLeftTangentWeighted(keyIx)
+			? pCurve->KeyGetLeftTangentWeight(keyIx)
+			: DEFAULT_TANGENT_WEIGHT;
+	}
+	return true;
+}
+
+static FbxAMatrix TranslationMatrix(const FbxVector4& translation)
+{
+	FbxAMatrix matrix;
+	matrix.SetT(translation);
+	return matrix;
+}
+
+static FbxAMatrix RotationMatrix(const FbxVector4& eulerDegrees, const EFbxRotationOrder order)
+{
+	FbxAMatrix matrix;
+	FbxRotationOrder(order).V2M(matrix, eulerDegrees);
+	return matrix;
+}
+
+bool FbxAnimationAccess::ReadNodeTransform(
+	FbxNode* pNode,
+	FbxAnimStack* pAnimStack,
+	NodeTransform& transform)
+{
+	if (pNode->GetTransform().GetInheritType() != FbxTransform::eInheritRSrs)
+	{
+		return false;
+	}
+	const bool hasLimits = pNode->TranslationMinX.Get() || pNode->TranslationMinY.Get() ||
+		pNode->TranslationMinZ.Get() || pNode->TranslationMaxX.Get() || pNode->TranslationMaxY.Get() ||
+		pNode->TranslationMaxZ.Get() || pNode->RotationMinX.Get() || pNode->RotationMinY.Get() ||
+		pNode->RotationMinZ.Get() || pNode->RotationMaxX.Get() || pNode->RotationMaxY.Get() ||
+		pNode->RotationMaxZ.Get() || pNode->ScalingMinX.Get() || pNode->ScalingMinY.Get() ||
+		pNode->ScalingMinZ.Get() || pNode->ScalingMaxX.Get() || pNode->ScalingMaxY.Get() ||
+		pNode->ScalingMaxZ.Get();
+	// without RotationActive, the SDK ignores the pre/post rotations and the rotation order
+	const bool rotationActive = pNode->RotationActive.Get();
+	transform.rotationOrder = rotationActive ? pNode->RotationOrder.Get() : eEulerXYZ;
+	if (hasLimits || transform.rotationOrder == eSphericXYZ)
+	{
+		return false;
+	}
+
+	FbxProperty animatedProperties[] = {pNode->LclTranslation, pNode->LclRotation, pNode->LclScaling};
+	FbxProperty fixedProperties[] = {
+		pNode->RotationOffset,
+		pNode->RotationPivot,
+		pNode->PreRotation,
+		pNode->PostRotation,
+		pNode->ScalingOffset,
+		pNode->ScalingPivot,
+	};
+	const int layerCount = pAnimStack->GetMemberCount<FbxAnimLayer>();
+	for (int layerIx = 0; layerIx < layerCount; layerIx++)
+	{
+		FbxAnimLayer* pLayer = pAnimStack->GetMember<FbxAnimLayer>(layerIx);
+		// anything but unmuted curves in the base layer would need to be blended
+		const bool isPlainBaseLayer = layerIx == 0 && !pLayer->Mute.Get() && pLayer->Weight.Get() == 100.0;
+		for (FbxProperty& property : animatedProperties)
+		{
+			if (!isPlainBaseLayer && property.GetCurveNode(pLayer) != nullptr)
+			{
+				return false;
+			}
+		}
+		for (FbxProperty& property : fixedProperties)
+		{
+			if (property.GetCurveNode(pLayer) != nullptr)
+			{
+				return false;
+			}
+		}
+	}
+
+	FbxAnimLayer* pBaseLayer = (layerCount > 0) ? pAnimStack->GetMember<FbxAnimLayer>(0) : nullptr;
+	for (int propertyIx = 0; propertyIx < 3; propertyIx++)
+	{
+		FbxProperty& property = animatedProperties[propertyIx];
+		const FbxDouble3 staticValue = property.Get<FbxDouble3>();
+		FbxAnimCurveNode* pCurveNode = (pBaseLayer != nullptr) ? property.GetCurveNode(pBaseLayer) : nullptr;
+		for (unsigned int axis = 0; axis < 3; axis++)
+		{
+			double value = staticValue[axis];
+			FbxAnimCurve* pCurve = nullptr;
+			if (pCurveNode != nullptr && axis < pCurveNode->GetChannelsCount())
+			{
+				value = pCurveNode->GetChannelValue<double>(axis, value);
+				pCurve = pCurveNode->GetCurve(axis);
+			}
+			if (!ReadCurve(pCurve, value, transform.curves[propertyIx * 3 + axis]))
+			{
+				return false;
+			}
+		}
+	}
+
+	const FbxVector4 rotationPivot = pNode->RotationPivot.Get();
+	const FbxVector4 scalingPivot = pNode->ScalingPivot.Get();
+	const FbxVector4 zero(0.0, 0.0, 0.0, 0.0);
+	transform.hasPivots = FbxVector4(pNode->RotationOffset.Get()) != zero || rotationPivot != zero ||
+		FbxVector4(pNode->ScalingOffset.Get()) != zero || scalingPivot != zero;
+	transform.preTranslation =
+		TranslationMatrix(pNode->RotationOffset.Get()) * TranslationMatrix(rotationPivot);
+	const FbxVector4 preRotation = rotationActive ? FbxVector4(pNode->PreRotation.Get()) : zero;
+	const FbxVector4 postRotation = rotationActive ? FbxVector4(pNode->PostRotation.Get()) : zero;
+	transform.preRotation = RotationMatrix(preRotation, eEulerXYZ);
+	transform.postRotation =
+		RotationMatrix(postRotation, eEulerXYZ).Inverse() * TranslationMatrix(rotationPivot).Inverse();
+	transform.scalingOffset =
+		TranslationMatrix(pNode->ScalingOffset.Get()) * TranslationMatrix(scalingPivot);
+	transform.postScaling = TranslationMatrix(scalingPivot).Inverse();
+	return true;
+}
+
+FbxAnimationAccess::FbxAnimationAccess(FbxAnimStack* pAnimStack, const std::set<FbxNode*>& nodes)
+{
+	for (FbxNode* pNode : nodes)
+	{
+		NodeTransform transform;
+		if (ReadNodeTransform(pNode, pAnimStack, transform))
+		{
+			nodeTransforms.emplace(pNode, std::move(transform));
+		}
+	}
+}
+
+FbxAMatrix FbxAnimationAccess::EvaluateLocalTransform(FbxNode* pNode, const double time) const
+{
+	const NodeTransform& transform = nodeTransforms.at(pNode);
+	FbxVector4 trs[3];
+	for (int propertyIx = 0; propertyIx < 3; propertyIx++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			trs[propertyIx][axis] = transform.curves[propertyIx * 3 + axis].Evaluate(time);
+		}
+	}
+	FbxAMatrix scaling;
+	scaling.SetS(trs[2]);
+
+	// T * Roff * Rp * Rpre * R * Rpost^-1 * Rp^-1 * Soff * Sp * S * Sp^-1
+	return TranslationMatrix(trs[0]) * transform.preTranslation * transform.preRotation *
+		RotationMatrix(trs[1], transform.rotationOrder) * transform.postRotation *
+		transform.scalingOffset * scaling * transform.postScaling;
+}
+
+// the slopes at the start and end of the segment after key k, in units per second
+static void GetSegmentSlopes(const FbxAnimationAccess::Curve& curve, const size_t k, double& start, double& end)
+{
+	if (curve.interpolations[k] == FbxAnimationAccess::Curve::CUBIC)
+	{
+		start = curve.rightSlopes[k];
+		end = curve.leftSlopes[k + 1];
+	}
+	else
+	{
+		start = end = (curve.values[k + 1] - curve.values[k]) / (curve.times[k + 1] - curve.times[k]);
+	}
+}
+
+bool FbxAnimationAccess::ConvertKeys(FbxNode* pNode, const Property property, SamplerKeys& keys) const
+{
+	const NodeTransform& transform = nodeTransforms.at(pNode);
+	const Curve* curves = &transform.curves[property * 3];
+	if (transform.hasPivots)
+	{
+		return false;
+	}
+	// a matrix decomposition folds mirroring into the rotation, so mirrored nodes are baked
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const Curve& scaling = transform.curves[SCALING * 3 + axis];
+		if (scaling.times.empty() ? scaling.constantValue <= 0.0
+								  : std::any_of(scaling.values.begin(), scaling.values.end(), [](const double value) {
+										return value <= 0.0;
+									}))
+		{
+			return false;
+		}
+	}
+
+	// the keyed components must share their key times; the others hold still
+	const Curve* keyed = nullptr;
+	int movingCount = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const Curve& curve = curves[axis];
+		if (curve.times.empty())
+		{
+			continue;
+		}
+		if (keyed != nullptr && curve.times != keyed->times)
+		{
+			return false;
+		}
+		keyed = &curve;
+		if (std::any_of(curve.values.begin(), curve.values.end(), [&](const double value) {
+				return value != curve.values.front();
+			}))
+		{
+			movingCount++;
+		}
+	}
+	if (keyed == nullptr)
+	{
+		// nothing to convert; baking tells whether the property differs from its static value
+		return false;
+	}
+	const size_t keyCount = keyed->times.size();
+
+	// one sampler interpolates every segment the same way
+	bool hasStep = false;
+	bool hasLinear = false;
+	bool hasCubic = false;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const Curve& curve = curves[axis];
+		for (size_t k = 0; k + 1 < curve.times.size(); k++)
+		{
+			switch (curve.interpolations[k])
+			{
+			case Curve::CONSTANT:
+				hasStep = true;
+				break;
+			case Curve::CONSTANT_NEXT:
+				return false;
+			case Curve::LINEAR:
+				hasLinear = true;
+				break;
+			case Curve::CUBIC:
+				hasCubic = true;
+				if (!curve.HasDefaultWeights(k))
+				{
+					return false;
+				}
+				break;
+			}
+		}
+	}
+	if (hasStep && (hasLinear || hasCubic))
+	{
+		return false;
+	}
+	keys.interpolation = hasStep ? SamplerKeys::STEP : (hasCubic ? SamplerKeys::CUBICSPLINE : SamplerKeys::LINEAR);
+	keys.times = keyed->times;
+
+	if (property == ROTATION)
+	{
+		if (keys.interpolation == SamplerKeys::CUBICSPLINE)
+		{
+			return false;
+		}
+		if (keys.interpolation == SamplerKeys::LINEAR && movingCount > 1)
+		{
+			return false;
+		}
+		keys.values.resize(keyCount);
+		for (size_t k = 0; k < keyCount; k++)
+		{
+			FbxVector4 euler;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				const Curve& curve = curves[axis];
+				euler[axis] = curve.times.empty() ? curve.constantValue : curve.values[k];
+				if (k > 0 && !curve.times.empty() && keys.interpolation == SamplerKeys::LINEAR &&
+					std::fabs(curve.values[k] - curve.values[k - 1]) >= 180.0)
+				{
+					// slerp would take the shorter way around
+					return false;
+				}
+			}
+			FbxQuaternion rotation =
+				(transform.preRotation * RotationMatrix(euler, transform.rotationOrder) * transform.postRotation)
+					.GetQ();
+			double dot = 0.0;
+			for (int ix = 0; k > 0 && ix < 4; ix++)
+			{
+				dot += rotation[ix] * keys.values[k - 1][ix];
+			}
+			if (dot < 0.0)
+			{
+				rotation = FbxQuaternion(-rotation[0], -rotation[1], -rotation[2], -rotation[3]);
+			}
+			keys.values[k] = rotation;
+		}
+		return true;
+	}
+
+	const bool isCubic = keys.interpolation == SamplerKeys::CUBICSPLINE;
+	keys.values.resize(isCubic ? keyCount * 3 : keyCount);
+	for (size_t k = 0; k < keyCount; k++)
+	{
+		FbxDouble4 value(0.0, 0.0, 0.0, 0.0);
+		FbxDouble4 inTangent(0.0, 0.0, 0.0, 0.0);
+		FbxDouble4 outTangent(0.0, 0.0, 0.0, 0.0);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			const Curve& curve = curves[axis];
+			if (curve.times.empty())
+			{
+				value[axis] = curve.constantValue;
+				continue;
+			}
+			value[axis] = curve.values[k];
+			double start, end;
+			if (k > 0)
+			{
+				GetSegmentSlopes(curve, k - 1, start, end);
+				inTangent[axis] = end;
+			}
+			if (k + 1 < keyCount)
+			{
+				GetSegmentSlopes(curve, k, start, end);
+				outTangent[axis] = start;
+			}
+		}
+		if (isCubic)
+		{
+			keys.values[k * 3] = inTangent;
+			keys.values[k * 3 + 1] = value;
+			keys.values[k * 3 + 2] = outTangent;
+		}
+		else
+		{
+			keys.values[k] = value;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "FBX2glTF.h"
+
+/**
+ * The FBX SDK evaluates animation through a stateful evaluator that caches per-node results and
+ * must not be used from more than one thread. This class instead copies what the local transform
+ * of a node depends on - the keys of the animation curves on its translation, rotation and
+ * scaling, and its pivots, offsets, pre/post rotations and rotation order - into plain arrays,
+ * once per animation stack. Local transforms can then be computed for any time, from any thread,
+ * without calling into the SDK's evaluator.
+ *
+ * Only nodes whose motion comes entirely from their own curves in the base layer are supported:
+ * layer blending, constraints, cyclic extrapolation, transform limits, animated pivots and
+ * inherit types that compensate for the parent's scale are left to the SDK.
+ */
+class FbxAnimationAccess {
+ public:
+  /**
+   * One animation curve, or a constant where a component has no curve. Each key starts a segment
+   * towards the next one, interpolated the way the key says.
+   */
+  struct Curve {
+    enum Interpolation : uint8_t { CONSTANT, CONSTANT_NEXT, LINEAR, CUBIC };
+
+    double Evaluate(double time) const;
+    // whether time runs linearly along the Bezier segment after key k, as with unweighted tangents
+    bool HasDefaultWeights(size_t k) const;
+
+    std::vector<double> times; // in seconds
+    std::vector<double> values;
+    std::vector<Interpolation> interpolations;
+    // cubic segments leave key i with rightSlopes[i] and reach key i + 1 with leftSlopes[i + 1],
+    // in units per second, their Bezier handles taking these fractions of the segment's duration
+    std::vector<double> rightSlopes;
+    std::vector<double> leftSlopes;
+    std::vector<double> rightWeights;
+    std::vector<double> leftWeights;
+    double constantValue = 0.0;
+  };
+
+  /**
+   * The keys of one transform property, ready for a glTF sampler: translations and scales as
+   * vectors, rotations as quaternions. CUBICSPLINE keys hold an in-tangent, the value and an
+   * out-tangent each, in units per second.
+   */
+  struct SamplerKeys {
+    enum Interpolation { STEP, LINEAR, CUBICSPLINE };
+
+    Interpolation interpolation = LINEAR;
+    std::vector<double> times; // in seconds
+    std::vector<FbxDouble4> values;
+  };
+
+  // the properties of a node's local transform, in the order of NodeTransform::curves
+  enum Property { TRANSLATION, ROTATION, SCALING };
+
+  FbxAnimationAccess(FbxAnimStack* pAnimStack, const std::set<FbxNode*>& nodes);
+
+  bool Supports(FbxNode* pNode) const {
+    return nodeTransforms.find(pNode) != nodeTransforms.end();
+  }
+
+  int GetSupportedNodeCount() const {
+    return (int)nodeTransforms.size();
+  }
+
+  // As pNode->EvaluateLocalTransform(time) would compute it, for a node that Supports().
+  FbxAMatrix EvaluateLocalTransform(FbxNode* pNode, double time) const;
+
+  /**
+   * Convert the keys of a property of a node that Supports() into a glTF sampler, if that samples
+   * exactly the same curve: the keys of all animated components must fall on the same times, the
+   * node must have no pivots or offsets, and Bezier tangents must be unweighted. Rotations only
+   * convert when their Euler angles step, or when just one angle moves linearly, by less than
+   * half a turn per key, which slerp then reproduces. Returns false if the property needs baking.
+   */
+  bool ConvertKeys(FbxNode* pNode, Property property, SamplerKeys& keys) const;
+
+ private:
+  struct NodeTransform {
+    // X, Y and Z of LclTranslation, LclRotation and LclScaling
+    std::array<Curve, 9> curves;
+    EFbxRotationOrder rotationOrder;
+    FbxAMatrix preTranslation; // the rotation offset and pivot
+    FbxAMatrix preRotation;
+    FbxAMatrix postRotation; // inverted, as well as the inverse rotation pivot
+    FbxAMatrix scalingOffset; // the scaling offset and pivot
+    FbxAMatrix postScaling; // the inverse scaling pivot
+    bool hasPivots; // or offsets
+  };
+
+  static bool ReadNodeTransform(FbxNode* pNode, FbxAnimStack* pAnimStack, NodeTransform& transform);
+
+  std::unordered_map<FbxNode*, NodeTransform> nodeTransforms;
+};
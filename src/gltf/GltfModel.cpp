@@ -8,6 +8,13 @@
 
 #include "GltfModel.hpp"
 
+#include <algorithm>
+
+#include "utils/Hash_Utils.hpp"
+#include "utils/Thread_Utils.hpp"
+
+#include "MeshoptCodec.hpp"
+
 std::shared_ptr<BufferViewData> GltfModel::GetAlignedBufferView(
 	BufferData& buffer,
 	const BufferViewData::GL_ArrayType target)
@@ -21,6 +28,94 @@ std::shared_ptr<BufferViewData> GltfModel::GetAlignedBufferView(
 	return this->bufferViews.hold(new BufferViewData(buffer, bufferSize, target));
 }
 
+void GltfModel::FinishBufferView(BufferViewData& bufferView, const GLType& type, unsigned int count)
+{
+	const unsigned int stride = type.byteStride();
+	bufferView.byteLength = stride * count;
+	if (type.padded)
+	{
+		bufferView.byteStride = stride;
+	}
+	if (useMeshopt)
+	{
+		// index views hold triangle lists; anything else with a suitable stride is attribute-like
+		if (bufferView.target == BufferViewData::GL_ELEMENT_ARRAY_BUFFER)
+		{
+			if (count % 3 == 0)
+			{
+				bufferView.meshopt.mode = BufferViewData::MESHOPT_TRIANGLES;
+			}
+		}
+		else if (stride % 4 == 0 && stride <= 256)
+		{
+			bufferView.meshopt.mode = BufferViewData::MESHOPT_ATTRIBUTES;
+		}
+		bufferView.meshopt.byteStride = stride;
+		bufferView.meshopt.count = count;
+	}
+}
+
+static bool SameGLType(const GLType& a, const GLType& b)
+{
+	return a.componentType.glType == b.componentType.glType && a.count == b.count &&
+		a.dataType == b.dataType && a.normalized == b.normalized && a.padded == b.padded;
+}
+
+std::shared_ptr<AccessorData> GltfModel::AddCachedAccessor(
+	BufferData& buffer,
+	const BufferViewData::GL_ArrayType target,
+	const GLType& type,
+	const std::vector<uint8_t>& bytes,
+	const unsigned int count,
+	const std::string& name)
+{
+	const uint32_t hash = HashUtils::HashBytes(bytes.data(), bytes.size(), (uint32_t)target);
+	std::vector<uint32_t>& candidates = accessorsByContentHash[hash];
+	accessorCacheStats.lookups++;
+	for (const uint32_t accessorIx : candidates)
+	{
+		const auto& candidate = accessors.ptrs[accessorIx];
+		const BufferViewData& view = *bufferViews.ptrs[candidate->bufferView];
+		if (!SameGLType(candidate->type, type) || view.target != target ||
+			view.byteLength != bytes.size() ||
+			memcmp(&(*binary)[view.byteOffset], bytes.data(), bytes.size()) != 0)
+		{
+			continue;
+		}
+		accessorCacheStats.hits++;
+		accessorCacheStats.bytesSaved += bytes.size();
+		if (candidate->name == name)
+		{
+			return candidate;
+		}
+		auto accessor = accessors.hold(new AccessorData(view, type, name));
+		accessor->count = count;
+		return accessor;
+	}
+
+	auto bufferView = GetAlignedBufferView(buffer, target);
+	binary->insert(binary->end(), bytes.begin(), bytes.end());
+	auto accessor = accessors.hold(new AccessorData(*bufferView, type, name));
+	accessor->count = count;
+	FinishBufferView(*bufferView, type, count);
+	candidates.push_back(accessor->ix);
+	return accessor;
+}
+
+void GltfModel::PrintAccessorCacheStats() const
+{
+	if (accessorCacheStats.lookups == 0)
+	{
+		return;
+	}
+	fmt::printf(
+		"Accessor cache: %lu of %lu accessors (%.1f%%) reused existing data, saving %lu KB.\n",
+		(unsigned long)accessorCacheStats.hits,
+		(unsigned long)accessorCacheStats.lookups,
+		100.0 * (double)accessorCacheStats.hits / (double)accessorCacheStats.lookups,
+		(unsigned long)(accessorCacheStats.bytesSaved / 1024));
+}
+
 // add a bufferview on the fly and copy data into it
 std::shared_ptr<BufferViewData>
 GltfModel::AddRawBufferView(BufferData& buffer, const char* source, uint32_t bytes)
@@ -37,6 +132,24 @@ GltfModel::AddRawBufferView(BufferData& buffer, const char* source, uint32_t byt
 	return bufferView;
 }
 
+std::shared_ptr<BufferViewData> GltfModel::AddInterleavedBufferView(
+	BufferData& buffer,
+	const std::vector<uint8_t>& bytes,
+	const uint32_t byteStride)
+{
+	auto bufferView = GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_BUFFER);
+	binary->insert(binary->end(), bytes.begin(), bytes.end());
+	bufferView->byteLength = to_uint32(bytes.size());
+	bufferView->byteStride = byteStride;
+	if (useMeshopt && byteStride % 4 == 0 && byteStride <= 256)
+	{
+		bufferView->meshopt.mode = BufferViewData::MESHOPT_ATTRIBUTES;
+		bufferView->meshopt.byteStride = byteStride;
+		bufferView->meshopt.count = to_uint32(bytes.size() / byteStride);
+	}
+	return bufferView;
+}
+
 std::shared_ptr<BufferViewData> GltfModel::AddBufferViewForFile(
 	BufferData& buffer,
 	const std::string& filename)
@@ -74,6 +187,114 @@ std::shared_ptr<BufferViewData> GltfModel::AddBufferViewForFile(
 	return result;
 }
 
+bool GltfModel::EncodeMeshoptBufferViews()
+{
+	std::vector<BufferViewData*> views;
+	for (const auto& view : bufferViews.ptrs)
+	{
+		if (view->meshopt.mode != BufferViewData::MESHOPT_NONE && view->byteLength > 0)
+		{
+			views.push_back(view.get());
+		}
+	}
+
+	std::vector<std::vector<uint8_t>> encodings(views.size());
+	ThreadUtils::ParallelFor(views.size(), [&](const size_t viewIx)
+	{
+		const BufferViewData& view = *views[viewIx];
+		const uint8_t* data = &(*binary)[view.byteOffset];
+		if (view.meshopt.mode == BufferViewData::MESHOPT_ATTRIBUTES)
+		{
+			MeshoptCodec::EncodeVertexBuffer(data, view.meshopt.count, view.meshopt.byteStride, encodings[viewIx]);
+		}
+		else
+		{
+			std::vector<uint32_t> indices(view.meshopt.count);
+			for (size_t ix = 0; ix < indices.size(); ix++)
+			{
+				if (view.meshopt.byteStride == 2)
+				{
+					uint16_t index;
+					memcpy(&index, data + 2 * ix, 2);
+					indices[ix] = index;
+				}
+				else
+				{
+					memcpy(&indices[ix], data + 4 * ix, 4);
+				}
+			}
+			MeshoptCodec::EncodeIndexBuffer(indices.data(), indices.size(), encodings[viewIx]);
+		}
+	});
+
+	std::vector<const std::vector<uint8_t>*> encodingByView(bufferViews.ptrs.size(), nullptr);
+	uint32_t fallbackByteLength = 0;
+	for (size_t viewIx = 0; viewIx < views.size(); viewIx++)
+	{
+		if (encodings[viewIx].size() < views[viewIx]->byteLength)
+		{
+			encodingByView[views[viewIx]->ix] = &encodings[viewIx];
+			fallbackByteLength += (views[viewIx]->byteLength + 3) & ~3u;
+		}
+	}
+	if (fallbackByteLength == 0)
+	{
+		return false;
+	}
+	const BufferData& fallback = *buffers.hold(new BufferData(fallbackByteLength));
+
+	// rebuild the binary in buffer order, with encoded data in place of the original
+	std::vector<BufferViewData*> ordered;
+	for (const auto& view : bufferViews.ptrs)
+	{
+		assert(view->buffer == defaultBuffer->ix);
+		ordered.push_back(view.get());
+	}
+	std::stable_sort(
+		ordered.begin(),
+		ordered.end(),
+		[](const BufferViewData* a, const BufferViewData* b) { return a->byteOffset < b->byteOffset; });
+
+	std::vector<uint8_t> packed;
+	packed.reserve(binary->size());
+	uint32_t fallbackOffset = 0;
+	for (BufferViewData* view : ordered)
+	{
+		packed.resize((packed.size() + 3) & ~(size_t)3);
+		const uint32_t packedOffset = to_uint32(packed.size());
+		const std::vector<uint8_t>* encoding = encodingByView[view->ix];
+		if (encoding != nullptr)
+		{
+			packed.insert(packed.end(), encoding->begin(), encoding->end());
+			view->meshopt.encoded = true;
+			view->meshopt.buffer = view->buffer;
+			view->meshopt.byteOffset = packedOffset;
+			view->meshopt.byteLength = to_uint32(encoding->size());
+
+			view->buffer = fallback.ix;
+			view->byteOffset = fallbackOffset;
+			fallbackOffset += (view->byteLength + 3) & ~3u;
+		}
+		else
+		{
+			const auto begin = binary->begin() + view->byteOffset;
+			packed.insert(packed.end(), begin, begin + view->byteLength);
+			view->byteOffset = packedOffset;
+		}
+	}
+
+	if (verboseOutput)
+	{
+		fmt::printf(
+			"EXT_meshopt_compression: %lu buffer views, %lu -> %lu bytes in total.\n",
+			(unsigned long)views.size(),
+			(unsigned long)binary->size(),
+			(unsigned long)packed.size());
+	}
+	binary->swap(packed);
+	return true;
+}
+
 void GltfModel::serializeHolders(json& glTFJson)
 {
 	serializeHolder(glTFJson, "buffers", buffers);
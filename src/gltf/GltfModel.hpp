@@ -9,6 +9,7 @@
 #pragma once
 
 #include <fstream>
+#include <unordered_map>
 
 #include "FBX2glTF.h"
 
@@ -55,6 +56,8 @@ class GltfModel {
   explicit GltfModel(const GltfOptions& options)
       : binary(new std::vector<uint8_t>),
         isGlb(options.outputBinary),
+        useMeshopt(options.meshoptCompression),
+        useAccessorCache(options.dedupeAccessors),
         defaultSampler(nullptr),
         defaultBuffer(buffers.hold(buildDefaultBuffer(options))) {
     defaultSampler = samplers.hold(buildDefaultSampler());
@@ -65,6 +68,11 @@ class GltfModel {
       const BufferViewData::GL_ArrayType target);
   std::shared_ptr<BufferViewData>
   AddRawBufferView(BufferData& buffer, const char* source, uint32_t bytes);
+  // a vertex buffer view of interleaved attributes, byteStride bytes per vertex
+  std::shared_ptr<BufferViewData> AddInterleavedBufferView(
+      BufferData& buffer,
+      const std::vector<uint8_t>& bytes,
+      uint32_t byteStride);
   std::shared_ptr<BufferViewData> AddBufferViewForFile(
       BufferData& buffer,
       const std::string& filename);
@@ -77,15 +85,73 @@ class GltfModel {
       std::string name) {
     auto accessor = accessors.hold(new AccessorData(bufferView, type, name));
     accessor->appendAsBinaryArray(source, *binary);
-    bufferView.byteLength = accessor->byteLength();
+    FinishBufferView(bufferView, type, accessor->count);
+    return accessor;
+  }
+
+  /**
+   * An accessor of count elements that are zero except at the given strictly ascending indices,
+   * where they take the given values. With no indices at all, the accessor has no data whatsoever.
+   */
+  template <class T>
+  std::shared_ptr<AccessorData> AddSparseAccessor(
+      BufferData& buffer,
+      const GLType& type,
+      const uint32_t count,
+      const std::vector<uint32_t>& indices,
+      const std::vector<T>& values,
+      std::string name) {
+    assert(indices.size() == values.size());
+    auto accessor = accessors.hold(new AccessorData(type));
+    accessor->count = count;
+    accessor->name = name;
+    if (indices.empty()) {
+      return accessor;
+    }
+
+    const GLType& indexType = (count > 65536) ? GLT_UINT : GLT_USHORT;
+    auto indexView = GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_NONE);
+    AccessorData indexData(*indexView, indexType, std::string(""));
+    indexData.appendAsBinaryArray(indices, *binary);
+    FinishBufferView(*indexView, indexType, indexData.count);
+
+    auto valueView = GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_NONE);
+    AccessorData valueData(*valueView, type, std::string(""));
+    valueData.appendAsBinaryArray(values, *binary);
+    FinishBufferView(*valueView, type, valueData.count);
+
+    accessor->sparse.count = to_uint32(indices.size());
+    accessor->sparse.indicesBufferView = indexView->ix;
+    accessor->sparse.indicesComponentType = indexType.componentType.glType;
+    accessor->sparse.valuesBufferView = valueView->ix;
     return accessor;
   }
 
+  /**
+   * An accessor in a buffer view of its own. With the accessor cache on, data that was added
+   * before with the same type and target reuses its buffer view instead, and the accessor, too,
+   * when the name also matches.
+   */
+  template <class T>
+  std::shared_ptr<AccessorData> AddAccessorAndView(
+      BufferData& buffer,
+      const BufferViewData::GL_ArrayType target,
+      const GLType& type,
+      const std::vector<T>& source,
+      std::string name) {
+    if (!useAccessorCache) {
+      return AddAccessorWithView(*GetAlignedBufferView(buffer, target), type, source, name);
+    }
+    AccessorData scratch(type);
+    std::vector<uint8_t> bytes;
+    scratch.appendAsBinaryArray(source, bytes);
+    return AddCachedAccessor(buffer, target, type, bytes, scratch.count, name);
+  }
+
   template <class T>
   std::shared_ptr<AccessorData>
   AddAccessorAndView(BufferData& buffer, const GLType& type, const std::vector<T>& source) {
-    auto bufferView = GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_NONE);
-    return AddAccessorWithView(*bufferView, type, source, std::string(""));
+    return AddAccessorAndView(buffer, BufferViewData::GL_ARRAY_NONE, type, source, std::string(""));
   }
 
   template <class T>
@@ -94,19 +160,19 @@ class GltfModel {
       const GLType& type,
       const std::vector<T>& source,
       std::string name) {
-    auto bufferView = GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_NONE);
-    return AddAccessorWithView(*bufferView, type, source, name);
+    return AddAccessorAndView(buffer, BufferViewData::GL_ARRAY_NONE, type, source, name);
   }
 
   template <class T>
   std::shared_ptr<AccessorData> AddAttributeToPrimitive(
       BufferData& buffer,
-      const RawModel& surfaceModel,
+      const RawModel& raw,
+      const RawPrimitive& rawPrimitive,
       PrimitiveData& primitive,
       const AttributeDefinition<T>& attrDef) {
-    // copy attribute data into vector
+    // gather the primitive's attribute data into a vector
     std::vector<T> attribArr;
-    surfaceModel.GetAttributeArray<T>(attribArr, attrDef.rawAttributeIx);
+    raw.GetAttributeArray<T>(attribArr, attrDef.rawAttributeIx, rawPrimitive.vertices);
 
     std::shared_ptr<AccessorData> accessor;
     if (attrDef.dracoComponentType != draco::DT_INVALID && primitive.dracoMesh != nullptr) {
@@ -115,8 +181,8 @@ class GltfModel {
       accessor = accessors.hold(new AccessorData(attrDef.glType));
       accessor->count = to_uint32(attribArr.size());
     } else {
-      auto bufferView = GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_BUFFER);
-      accessor = AddAccessorWithView(*bufferView, attrDef.glType, attribArr, std::string(""));
+      accessor = AddAccessorAndView(
+          buffer, BufferViewData::GL_ARRAY_BUFFER, attrDef.glType, attribArr, std::string(""));
     }
     primitive.AddAttrib(attrDef.gltfName, *accessor);
     return accessor;
@@ -135,7 +201,19 @@ class GltfModel {
 
   void serializeHolders(json& glTFJson);
 
+  /**
+   * Replace the contents of every buffer view marked for EXT_meshopt_compression with its
+   * encoding, in parallel, moving the view itself into a fallback buffer without data. Views
+   * that don't get smaller stay as they are. Returns whether anything was encoded.
+   */
+  bool EncodeMeshoptBufferViews();
+
+  // Print how often the accessor cache found data that had been added before.
+  void PrintAccessorCacheStats() const;
+
   const bool isGlb;
+  const bool useMeshopt;
+  const bool useAccessorCache;
 
   // cache BufferViewData instances that've already been created from a given filename
   std::map<std::string, std::shared_ptr<BufferViewData>> filenameToBufferView;
@@ -161,6 +239,25 @@ class GltfModel {
   std::shared_ptr<BufferData> defaultBuffer;
 
  private:
+  // size a freshly written view that holds count elements of type, and mark it for meshopt
+  void FinishBufferView(BufferViewData& bufferView, const GLType& type, unsigned int count);
+
+  std::shared_ptr<AccessorData> AddCachedAccessor(
+      BufferData& buffer,
+      BufferViewData::GL_ArrayType target,
+      const GLType& type,
+      const std::vector<uint8_t>& bytes,
+      unsigned int count,
+      const std::string& name);
+
+  // accessors whose view holds data of the given hash, for the accessor cache
+  std::unordered_map<uint32_t, std::vector<uint32_t>> accessorsByContentHash;
+  struct {
+    size_t lookups = 0;
+    size_t hits = 0;
+    size_t bytesSaved = 0;
+  } accessorCacheStats;
+
   SamplerData* buildDefaultSampler() {
     return new SamplerData();
   }
@@ -0,0 +1,413 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MeshoptCodec.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace MeshoptCodec
+{
+	static const uint8_t VERTEX_HEADER = 0xa0; // version 0
+	static const uint8_t INDEX_HEADER = 0xe1; // version 1
+
+	static const size_t BYTE_GROUP_SIZE = 16;
+	static const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+	static const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+	static const size_t VERTEX_TAIL_MIN_SIZE = 32;
+
+	//
+	// attributes
+	//
+
+	static uint8_t zigzag8(const uint8_t v)
+	{
+		return (uint8_t)(((int8_t)v >> 7) ^ (v << 1));
+	}
+
+	// Bytes needed to store a group of 16 values at 2 or 4 bits each, when values that don't fit
+	// are escaped with an all-ones code and stored in full after the packed bits.
+	static size_t measureByteGroup(const uint8_t* group, const int bits)
+	{
+		const uint8_t sentinel = (uint8_t)((1 << bits) - 1);
+		size_t size = BYTE_GROUP_SIZE * bits / 8;
+		for (size_t i = 0; i < BYTE_GROUP_SIZE; i++)
+		{
+			size += (group[i] >= sentinel) ? 1 : 0;
+		}
+		return size;
+	}
+
+	static void encodeByteGroup(std::vector<uint8_t>& out, const uint8_t* group, const int bits)
+	{
+		if (bits == 8)
+		{
+			out.insert(out.end(), group, group + BYTE_GROUP_SIZE);
+			return;
+		}
+		const uint8_t sentinel = (uint8_t)((1 << bits) - 1);
+		const size_t valuesPerByte = 8 / bits;
+		for (size_t i = 0; i < BYTE_GROUP_SIZE; i += valuesPerByte)
+		{
+			// the first value goes into the most significant bits
+			uint8_t packed = 0;
+			for (size_t k = 0; k < valuesPerByte; k++)
+			{
+				packed = (uint8_t)((packed << bits) | std::min(group[i + k], sentinel));
+			}
+			out.push_back(packed);
+		}
+		for (size_t i = 0; i < BYTE_GROUP_SIZE; i++)
+		{
+			if (group[i] >= sentinel)
+			{
+				out.push_back(group[i]);
+			}
+		}
+	}
+
+	// A run of bytes (a multiple of 16) as a 2-bit mode per group followed by the group contents;
+	// the modes 0 to 3 stand for all zeros, 2-bit, 4-bit and 8-bit values.
+	static void encodeBytes(std::vector<uint8_t>& out, const uint8_t* bytes, const size_t size)
+	{
+		assert(size % BYTE_GROUP_SIZE == 0);
+		const size_t groupCount = size / BYTE_GROUP_SIZE;
+		const size_t headerOffset = out.size();
+		out.resize(headerOffset + (groupCount + 3) / 4, 0);
+
+		for (size_t groupIx = 0; groupIx < groupCount; groupIx++)
+		{
+			const uint8_t* group = bytes + groupIx * BYTE_GROUP_SIZE;
+
+			int mode = 0;
+			if (std::any_of(group, group + BYTE_GROUP_SIZE, [](uint8_t b) { return b != 0; }))
+			{
+				mode = 3;
+				size_t bestSize = BYTE_GROUP_SIZE;
+				for (int candidate = 1; candidate <= 2; candidate++)
+				{
+					const size_t candidateSize = measureByteGroup(group, 1 << candidate);
+					if (candidateSize < bestSize)
+					{
+						mode = candidate;
+						bestSize = candidateSize;
+					}
+				}
+			}
+			out[headerOffset + groupIx / 4] |= (uint8_t)(mode << ((groupIx % 4) * 2));
+			if (mode > 0)
+			{
+				encodeByteGroup(out, group, 1 << mode);
+			}
+		}
+	}
+
+	void EncodeVertexBuffer(const uint8_t* data, const size_t count, const size_t byteStride, std::vector<uint8_t>& out)
+	{
+		assert(byteStride > 0 && byteStride <= 256 && byteStride % 4 == 0);
+
+		out.clear();
+		out.push_back(VERTEX_HEADER);
+
+		// each block holds the bytes of one element position at a time, so it fits a fixed buffer
+		const size_t blockSize =
+			std::min((VERTEX_BLOCK_SIZE_BYTES / byteStride) & ~(BYTE_GROUP_SIZE - 1), VERTEX_BLOCK_MAX_SIZE);
+
+		// deltas start out from the first element, which the decoder finds in the tail
+		std::vector<uint8_t> firstElement(byteStride, 0);
+		if (count > 0)
+		{
+			memcpy(firstElement.data(), data, byteStride);
+		}
+		std::vector<uint8_t> lastElement = firstElement;
+
+		uint8_t deltas[VERTEX_BLOCK_MAX_SIZE];
+		for (size_t blockStart = 0; blockStart < count; blockStart += blockSize)
+		{
+			const size_t blockCount = std::min(blockSize, count - blockStart);
+			const uint8_t* block = data + blockStart * byteStride;
+			for (size_t k = 0; k < byteStride; k++)
+			{
+				// rounding up to whole groups encodes a few zeros past the end
+				memset(deltas, 0, sizeof(deltas));
+				uint8_t previous = lastElement[k];
+				for (size_t i = 0; i < blockCount; i++)
+				{
+					const uint8_t value = block[i * byteStride + k];
+					deltas[i] = zigzag8((uint8_t)(value - previous));
+					previous = value;
+				}
+				encodeBytes(out, deltas, (blockCount + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1));
+			}
+			memcpy(lastElement.data(), block + (blockCount - 1) * byteStride, byteStride);
+		}
+
+		// the tail is padded to a minimum size, which spares the decoder some bounds checks
+		if (byteStride < VERTEX_TAIL_MIN_SIZE)
+		{
+			out.resize(out.size() + VERTEX_TAIL_MIN_SIZE - byteStride, 0);
+		}
+		out.insert(out.end(), firstElement.begin(), firstElement.end());
+	}
+
+	//
+	// triangles
+	//
+
+	static const int FIFO_SIZE = 16;
+
+	// the rotations that move the matched edge or vertex of a triangle to the front
+	static const int TRIANGLE_ORDER[3][3] = {{0, 1, 2}, {1, 2, 0}, {2, 0, 1}};
+
+	// The common pairs of vertex codes of triangles that share no recent edge, as fixed by the
+	// bitstream: entries 0 to 13 fit in the code byte, everything else needs an extra byte.
+	static const uint8_t CODE_AUX_TABLE[16] =
+		{0x00, 0x76, 0x87, 0x56, 0x67, 0x78, 0xa9, 0x86, 0x65, 0x89, 0x68, 0x98, 0x01, 0x69, 0x00, 0x00};
+
+	struct EdgeFifo
+	{
+		uint32_t edges[FIFO_SIZE][2];
+		size_t offset = 0;
+
+		EdgeFifo()
+		{
+			memset(edges, 0xff, sizeof(edges));
+		}
+
+		// the most recent of the triangle's edges, as (age << 2) | rotation
+		int Find(const uint32_t a, const uint32_t b, const uint32_t c) const
+		{
+			for (int age = 0; age < FIFO_SIZE; age++)
+			{
+				const uint32_t* edge = edges[(offset - 1 - age) & (FIFO_SIZE - 1)];
+				if (edge[0] == a && edge[1] == b)
+					return (age << 2) | 0;
+				if (edge[0] == b && edge[1] == c)
+					return (age << 2) | 1;
+				if (edge[0] == c && edge[1] == a)
+					return (age << 2) | 2;
+			}
+			return -1;
+		}
+
+		void Push(const uint32_t a, const uint32_t b)
+		{
+			edges[offset][0] = a;
+			edges[offset][1] = b;
+			offset = (offset + 1) & (FIFO_SIZE - 1);
+		}
+	};
+
+	struct VertexFifo
+	{
+		uint32_t vertices[FIFO_SIZE];
+		size_t offset = 0;
+
+		VertexFifo()
+		{
+			Reset();
+		}
+
+		void Reset()
+		{
+			memset(vertices, 0xff, sizeof(vertices));
+		}
+
+		int Find(const uint32_t v) const
+		{
+			for (int age = 0; age < FIFO_SIZE; age++)
+			{
+				if (vertices[(offset - 1 - age) & (FIFO_SIZE - 1)] == v)
+					return age;
+			}
+			return -1;
+		}
+
+		void Push(const uint32_t v)
+		{
+			vertices[offset] = v;
+			offset = (offset + 1) & (FIFO_SIZE - 1);
+		}
+	};
+
+	// a zigzag-coded delta from the previous free index, as a little-endian base-128 varint
+	static void encodeFreeIndex(std::vector<uint8_t>& data, const uint32_t index, uint32_t& last)
+	{
+		const uint32_t delta = index - last;
+		uint32_t v = (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+		do
+		{
+			data.push_back((uint8_t)((v & 127) | (v > 127 ? 128 : 0)));
+			v >>= 7;
+		} while (v != 0);
+		last = index;
+	}
+
+	void EncodeIndexBuffer(const uint32_t* indices, const size_t indexCount, std::vector<uint8_t>& out)
+	{
+		assert(indexCount % 3 == 0);
+
+		// the stream is the header, one code byte per triangle, and then the extra data
+		std::vector<uint8_t> codes, data;
+		codes.reserve(indexCount / 3);
+		data.reserve(indexCount / 3);
+
+		EdgeFifo edgeFifo;
+		VertexFifo vertexFifo;
+		uint32_t next = 0; // the lowest index not yet seen, if indices appear in order
+		uint32_t last = 0; // the previous free index
+
+		// vertex codes 13 and 14 of the edge case stand for last - 1 and last + 1 instead
+		const int maxVertexCode = 13;
+
+		for (size_t i = 0; i < indexCount; i += 3)
+		{
+			const int edgeMatch = edgeFifo.Find(indices[i], indices[i + 1], indices[i + 2]);
+			if (edgeMatch >= 0 && (edgeMatch >> 2) < 15)
+			{
+				// a recent edge plus a third vertex
+				const int* order = TRIANGLE_ORDER[edgeMatch & 3];
+				const uint32_t a = indices[i + order[0]], b = indices[i + order[1]], c = indices[i + order[2]];
+
+				const int fifoIx = vertexFifo.Find(c);
+				int vertexCode = 15;
+				if (fifoIx >= 1 && fifoIx < maxVertexCode)
+				{
+					vertexCode = fifoIx;
+				}
+				else if (c == next)
+				{
+					vertexCode = 0;
+					next++;
+				}
+				else if (c + 1 == last)
+				{
+					vertexCode = 13;
+					last = c;
+				}
+				else if (c == last + 1)
+				{
+					vertexCode = 14;
+					last = c;
+				}
+
+				codes.push_back((uint8_t)(((edgeMatch >> 2) << 4) | vertexCode));
+				if (vertexCode == 15)
+				{
+					encodeFreeIndex(data, c, last);
+				}
+				// a and b are most likely still in the vertex FIFO
+				if (vertexCode == 0 || vertexCode >= maxVertexCode)
+				{
+					vertexFifo.Push(c);
+				}
+				// the third edge, a-b, is already in the edge FIFO
+				edgeFifo.Push(c, b);
+				edgeFifo.Push(a, c);
+			}
+			else
+			{
+				// three vertices, rotated so that the next new index (if any) comes first
+				const int rotation = (indices[i + 1] == next) ? 1 : (indices[i + 2] == next) ? 2 : 0;
+				const int* order = TRIANGLE_ORDER[rotation];
+				const uint32_t a = indices[i + order[0]], b = indices[i + order[1]], c = indices[i + order[2]];
+
+				// 0, 1, 2 after other vertices restarts the numbering, e.g. for concatenated meshes
+				bool reset = false;
+				if (a == 0 && b == 1 && c == 2 && next > 0)
+				{
+					reset = true;
+					next = 0;
+					vertexFifo.Reset();
+				}
+
+				const int fifoB = vertexFifo.Find(b);
+				const int fifoC = vertexFifo.Find(c);
+
+				int codeA = 15;
+				if (a == next)
+				{
+					codeA = 0;
+					next++;
+				}
+				int codeB = 15;
+				if (fifoB >= 0 && fifoB < 14)
+				{
+					codeB = fifoB + 1;
+				}
+				else if (b == next)
+				{
+					codeB = 0;
+					next++;
+				}
+				int codeC = 15;
+				if (fifoC >= 0 && fifoC < 14)
+				{
+					codeC = fifoC + 1;
+				}
+				else if (c == next)
+				{
+					codeC = 0;
+					next++;
+				}
+
+				const uint8_t codeAux = (uint8_t)((codeB << 4) | codeC);
+				const int tableIx = (int)(std::find(CODE_AUX_TABLE, CODE_AUX_TABLE + 14, codeAux) - CODE_AUX_TABLE);
+				if (codeA == 0 && tableIx < 14 && !reset)
+				{
+					codes.push_back((uint8_t)(0xf0 | tableIx));
+				}
+				else
+				{
+					// 0xfe for a new vertex a and 0xff for a free one; a reset is 0xfe with aux 0x00
+					codes.push_back((uint8_t)(0xf0 | 14 | (codeA & 1)));
+					data.push_back(codeAux);
+				}
+
+				if (codeA == 15)
+				{
+					encodeFreeIndex(data, a, last);
+				}
+				if (codeB == 15)
+				{
+					encodeFreeIndex(data, b, last);
+				}
+				if (codeC == 15)
+				{
+					encodeFreeIndex(data, c, last);
+				}
+
+				if (codeA == 0 || codeA == 15)
+				{
+					vertexFifo.Push(a);
+				}
+				if (codeB == 0 || codeB == 15)
+				{
+					vertexFifo.Push(b);
+				}
+				if (codeC == 0 || codeC == 15)
+				{
+					vertexFifo.Push(c);
+				}
+
+				edgeFifo.Push(b, a);
+				edgeFifo.Push(c, b);
+				edgeFifo.Push(a, c);
+			}
+		}
+
+		out.clear();
+		out.reserve(1 + codes.size() + data.size() + 16);
+		out.push_back(INDEX_HEADER);
+		out.insert(out.end(), codes.begin(), codes.end());
+		out.insert(out.end(), data.begin(), data.end());
+		// the code table goes last, where it also serves as padding for the decoder
+		out.insert(out.end(), CODE_AUX_TABLE, CODE_AUX_TABLE + 16);
+	}
+} // namespace MeshoptCodec
@@ -0,0 +1,27 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Encoders for the bitstreams of the EXT_meshopt_compression glTF extension. They are lossless and
+ * cheap to decode; the data compresses best after vertex cache and vertex fetch optimization.
+ */
+namespace MeshoptCodec
+{
+	// "ATTRIBUTES" mode: count elements of byteStride bytes each, which must be a multiple of 4 and
+	// at most 256. Bytes are delta-encoded against the previous element and bit-packed in groups.
+	void EncodeVertexBuffer(const uint8_t* data, size_t count, size_t byteStride, std::vector<uint8_t>& out);
+
+	// "TRIANGLES" mode: a triangle list, coded against FIFOs of recently seen edges and vertices.
+	void EncodeIndexBuffer(const uint32_t* indices, size_t indexCount, std::vector<uint8_t>& out);
+} // namespace MeshoptCodec
@@ -8,10 +8,15 @@
 
 #include "Raw2Gltf.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
 
 #include <stb_image.h>
 #include <stb_image_write.h>
@@ -19,7 +24,9 @@
 #include <utils/File_Utils.hpp>
 #include "utils/Image_Utils.hpp"
 #include "utils/String_Utils.hpp"
+#include "utils/Thread_Utils.hpp"
 
+#include "raw/MeshOptimizer.hpp"
 #include "raw/RawModel.hpp"
 
 #include "gltf/properties/AccessorData.hpp"
@@ -40,8 +47,6 @@
 #include "GltfModel.hpp"
 #include "TextureBuilder.hpp"
 
-typedef uint32_t TriangleIndex;
-
 #define DEFAULT_SCENE_NAME "Root Scene"
 
 /**
@@ -67,19 +72,773 @@ T& require(std::map<uint64_t, std::shared_ptr<T>> map, uint64_t key)
 	return result;
 }
 
-static const std::vector<TriangleIndex> getIndexArray(const RawModel& raw)
+// Skinned vertices only collapse onto vertices whose joint influences differ by at most this much
+// (as the sum of absolute weight differences), so simplified levels deform like the original.
+static const float LOD_MAX_SKIN_DISTANCE = 0.1f;
+
+static float skinDistance(const Vec4i& jointsA, const Vec4f& weightsA, const Vec4i& jointsB, const Vec4f& weightsB)
+{
+	// weight differences per joint; joints that appear in neither influence list contribute nothing
+	int joints[8];
+	float differences[8];
+	int count = 0;
+	const auto accumulate = [&](const int joint, const float weight) {
+		for (int i = 0; i < count; i++)
+		{
+			if (joints[i] == joint)
+			{
+				differences[i] += weight;
+				return;
+			}
+		}
+		joints[count] = joint;
+		differences[count++] = weight;
+	};
+	for (int i = 0; i < 4; i++)
+	{
+		accumulate(jointsA[i], weightsA[i]);
+		accumulate(jointsB[i], -weightsB[i]);
+	}
+	float distance = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		distance += fabsf(differences[i]);
+	}
+	return distance;
+}
+
+/**
+ * Fill in primitive.lodIndices with successively simplified versions of its triangles, one per
+ * ratio, each starting from the previous. Skin weights and morph target offsets constrain which
+ * vertices may be merged.
+ */
+static void simplifyPrimitive(const RawModel& raw, RawPrimitive& primitive, const std::vector<float>& lodRatios)
+{
+	std::vector<Vec3f> positions;
+	raw.GetAttributeArray(positions, &RawVertex::position, primitive.vertices);
+
+	MeshOptimizer::SimplifyConstraints constraints;
+	std::vector<Vec4i> jointIndices;
+	std::vector<Vec4f> jointWeights;
+	if ((primitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0)
+	{
+		raw.GetAttributeArray(jointIndices, &RawVertex::jointIndices, primitive.vertices);
+		raw.GetAttributeArray(jointWeights, &RawVertex::jointWeights, primitive.vertices);
+		constraints.canCollapse = [&](const uint32_t from, const uint32_t to)
+		{
+			return skinDistance(jointIndices[from], jointWeights[from], jointIndices[to], jointWeights[to]) <=
+				LOD_MAX_SKIN_DISTANCE;
+		};
+	}
+	if (primitive.blendDeltas.Size() > 0)
+	{
+		// the largest squared difference between the two vertices' offsets in any one channel
+		constraints.collapseError = [&](const uint32_t from, const uint32_t to)
+		{
+			auto a = primitive.blendDeltas.GetVertexDeltas((int)from);
+			auto b = primitive.blendDeltas.GetVertexDeltas((int)to);
+			float error = 0.0f;
+			while (a.first != a.second || b.first != b.second)
+			{
+				Vec3f difference;
+				if (b.first == b.second || (a.first != a.second && a.first->channelIndex < b.first->channelIndex))
+				{
+					difference = (a.first++)->position;
+				}
+				else if (a.first == a.second || b.first->channelIndex < a.first->channelIndex)
+				{
+					difference = (b.first++)->position;
+				}
+				else
+				{
+					difference = (a.first++)->position - (b.first++)->position;
+				}
+				error = std::max(error, difference.LengthSquared());
+			}
+			return error;
+		};
+	}
+
+	std::vector<uint32_t> indices = primitive.indices;
+	for (const float ratio : lodRatios)
+	{
+		const size_t targetTriangles = std::max<size_t>(1, (size_t)(ratio * primitive.GetTriangleCount()));
+		MeshOptimizer::Simplify(indices, positions, targetTriangles * 3, constraints);
+		if (indices.empty())
+		{
+			// never emit an empty level; repeat the previous one instead
+			indices = primitive.lodIndices.empty() ? primitive.indices : primitive.lodIndices.back();
+		}
+		primitive.lodIndices.push_back(indices);
+	}
+}
+
+/**
+ * Run the enabled simplification and index and vertex order optimizations on every primitive, in
+ * parallel: levels of detail, then vertex cache, then overdraw (which cuts clusters along the
+ * cache-optimized order), then vertex fetch (which follows the final index order of the full
+ * detail level). Reports the simulated vertex cache efficiency of the full detail level.
+ */
+static void optimizePrimitives(
+	const RawModel& raw,
+	std::vector<RawPrimitive>& primitives,
+	const GltfOptions& options)
+{
+	std::vector<MeshOptimizer::VertexCacheStats> before(primitives.size());
+	std::vector<MeshOptimizer::VertexCacheStats> after(primitives.size());
+	ThreadUtils::ParallelFor(primitives.size(), [&](const size_t primIx)
+	{
+		RawPrimitive& primitive = primitives[primIx];
+		const size_t vertexCount = primitive.vertices.size();
+		before[primIx] = MeshOptimizer::AnalyzeVertexCache(primitive.indices, vertexCount);
+
+		if (!options.lodRatios.empty())
+		{
+			simplifyPrimitive(raw, primitive, options.lodRatios);
+		}
+
+		std::vector<std::vector<uint32_t>*> indexLists{&primitive.indices};
+		for (auto& lod : primitive.lodIndices)
+		{
+			indexLists.push_back(&lod);
+		}
+		if (options.optimizeVertexCache)
+		{
+			for (auto* indices : indexLists)
+			{
+				MeshOptimizer::OptimizeVertexCache(*indices, vertexCount);
+			}
+		}
+		if (options.optimizeOverdraw)
+		{
+			std::vector<Vec3f> positions;
+			raw.GetAttributeArray(positions, &RawVertex::position, primitive.vertices);
+			for (auto* indices : indexLists)
+			{
+				MeshOptimizer::OptimizeOverdraw(*indices, positions);
+			}
+		}
+		if (options.optimizeVertexFetch)
+		{
+			std::vector<int> remap;
+			MeshOptimizer::OptimizeVertexFetch(primitive.indices, vertexCount, remap);
+			std::vector<int> vertices(vertexCount);
+			for (size_t localIx = 0; localIx < vertexCount; localIx++)
+			{
+				// every vertex of a primitive is referenced by at least one of its triangles
+				assert(remap[localIx] >= 0);
+				vertices[remap[localIx]] = primitive.vertices[localIx];
+			}
+			primitive.vertices.swap(vertices);
+			primitive.blendDeltas.Remap(remap);
+			// the simplified levels only use a subset of the same vertices
+			for (auto& lod : primitive.lodIndices)
+			{
+				for (uint32_t& index : lod)
+				{
+					index = (uint32_t)remap[index];
+				}
+			}
+		}
+
+		after[primIx] = MeshOptimizer::AnalyzeVertexCache(primitive.indices, vertexCount);
+	});
+
+	if (verboseOutput)
+	{
+		MeshOptimizer::VertexCacheStats totalBefore, totalAfter;
+		for (size_t primIx = 0; primIx < primitives.size(); primIx++)
+		{
+			totalBefore.Add(before[primIx]);
+			totalAfter.Add(after[primIx]);
+		}
+		if (options.optimizeVertexCache || options.optimizeOverdraw || options.optimizeVertexFetch)
+		{
+			fmt::printf(
+				"Vertex cache (%d-entry FIFO): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f.\n",
+				(int)MeshOptimizer::DEFAULT_FIFO_CACHE_SIZE,
+				totalBefore.GetACMR(),
+				totalAfter.GetACMR(),
+				totalBefore.GetATVR(),
+				totalAfter.GetATVR());
+		}
+		for (size_t level = 0; level < options.lodRatios.size(); level++)
+		{
+			size_t triangleCount = 0;
+			for (const RawPrimitive& primitive : primitives)
+			{
+				triangleCount += primitive.lodIndices[level].size() / 3;
+			}
+			fmt::printf(
+				"LOD %d (ratio %.3f): %lu of %lu triangles.\n",
+				(int)level + 1,
+				options.lodRatios[level],
+				(unsigned long)triangleCount,
+				(unsigned long)totalBefore.triangleCount);
+		}
+	}
+}
+
+/**
+ * The KHR_mesh_quantization transform of a surface: its positions are stored as the normalized
+ * 16-bit integers of (p - offset) / scale. The scale is uniform, so that folding the transform into
+ * a node or into inverse bind matrices leaves normals and tangents undistorted.
+ */
+struct PositionQuantization
+{
+	Vec3f offset{0.0f};
+	float scale = 1.0f;
+
+	Vec3f Quantize(const Vec3f& position) const
+	{
+		return (position - offset) * (1.0f / scale);
+	}
+
+	Mat4f GetDequantizeMatrix() const
+	{
+		return Mat4f::FromTranslationVector(offset) * Mat4f::FromScaleVector(Vec3f(scale));
+	}
+};
+
+// all primitives of a surface end up in the same mesh, so they share its transform
+static std::map<uint64_t, PositionQuantization> getPositionQuantizations(
+	const RawModel& raw,
+	const std::vector<RawPrimitive>& primitives)
 {
-	std::vector<TriangleIndex> result;
+	std::map<uint64_t, Boundsf> boundsBySurfaceId;
+	for (const RawPrimitive& primitive : primitives)
+	{
+		Boundsf& bounds = boundsBySurfaceId[raw.GetSurface(primitive.surfaceIndex).id];
+		bounds.AddPoint(primitive.bounds.min);
+		bounds.AddPoint(primitive.bounds.max);
+	}
 
-	for (int i = 0; i < raw.GetTriangleCount(); i++)
+	std::map<uint64_t, PositionQuantization> quantizations;
+	for (const auto& entry : boundsBySurfaceId)
 	{
-		result.push_back((TriangleIndex)raw.GetTriangle(i).verts[0]);
-		result.push_back((TriangleIndex)raw.GetTriangle(i).verts[1]);
-		result.push_back((TriangleIndex)raw.GetTriangle(i).verts[2]);
+		const Vec3f extent = entry.second.max - entry.second.min;
+		const float scale = std::max(extent[0], std::max(extent[1], extent[2]));
+		PositionQuantization& quantization = quantizations[entry.first];
+		quantization.offset = entry.second.min;
+		quantization.scale = (scale > 0.0f) ? scale : 1.0f;
+	}
+	return quantizations;
+}
+
+// Round [0, 1] (or [-1, 1]) to the full range of an unsigned (or signed) integer type, clamping.
+template <typename T, int d>
+static mathfu::Vector<T, d> quantizeUnorm(const mathfu::Vector<float, d>& value)
+{
+	mathfu::Vector<T, d> result;
+	for (int c = 0; c < d; c++)
+	{
+		const float clamped = std::max(0.0f, std::min(1.0f, value[c]));
+		result[c] = (T)(clamped * (float)std::numeric_limits<T>::max() + 0.5f);
 	}
 	return result;
 }
 
+template <typename T, int d>
+static mathfu::Vector<T, d> quantizeSnorm(const mathfu::Vector<float, d>& value)
+{
+	mathfu::Vector<T, d> result;
+	for (int c = 0; c < d; c++)
+	{
+		const float scaled = std::max(-1.0f, std::min(1.0f, value[c])) * (float)std::numeric_limits<T>::max();
+		result[c] = (T)(scaled + ((scaled >= 0.0f) ? 0.5f : -0.5f));
+	}
+	return result;
+}
+
+template <typename T, int d>
+static std::vector<float> toFloatVec(const mathfu::Vector<T, d>& vec)
+{
+	std::vector<float> result(d);
+	for (int ii = 0; ii < d; ii++)
+	{
+		result[ii] = (float)vec[ii];
+	}
+	return result;
+}
+
+static const char* describeInterpolation(const RawInterpolation interpolation)
+{
+	switch (interpolation)
+	{
+	case RAW_INTERPOLATION_STEP:
+		return "STEP";
+	case RAW_INTERPOLATION_CUBICSPLINE:
+		return "CUBICSPLINE";
+	case RAW_INTERPOLATION_LINEAR:
+		break;
+	}
+	return "LINEAR";
+}
+
+// number of significant bits --quantize-translations keeps of each float
+static const int ANIMATION_MANTISSA_BITS = 16;
+
+// Round a float to the given number of significant bits, leaving the lower bits of its mantissa
+// zero; values too large to round stay as they are.
+static float roundMantissa(const float value, const int bits)
+{
+	uint32_t word;
+	memcpy(&word, &value, sizeof(word));
+	const int dropped = 23 - (bits - 1);
+	if ((word & 0x7f800000u) == 0x7f800000u || dropped <= 0)
+	{
+		return value;
+	}
+	const uint32_t mask = (1u << dropped) - 1;
+	word = (word + (1u << (dropped - 1))) & ~mask;
+	float result;
+	memcpy(&result, &word, sizeof(result));
+	return std::isfinite(result) ? result : value;
+}
+
+// the outputs of a translation or scale sampler, rounded with --quantize-translations
+static std::shared_ptr<AccessorData> addVectorOutputAccessor(
+	GltfModel& gltf,
+	BufferData& buffer,
+	const GltfOptions& options,
+	const std::vector<Vec3f>& values)
+{
+	if (!options.quantizeAnimations.translations)
+	{
+		return gltf.AddAccessorAndView(buffer, GLT_VEC3F, values);
+	}
+	std::vector<Vec3f> rounded(values.size());
+	for (size_t ix = 0; ix < values.size(); ix++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			rounded[ix][axis] = roundMantissa(values[ix][axis], ANIMATION_MANTISSA_BITS);
+		}
+	}
+	return gltf.AddAccessorAndView(buffer, GLT_VEC3F, rounded);
+}
+
+// The outputs of a rotation sampler; with --quantize-animations, normalized 16-bit integers, each
+// key flipped into the hemisphere of the one before, so that consecutive keys stay close.
+static std::shared_ptr<AccessorData> addRotationOutputAccessor(
+	GltfModel& gltf,
+	BufferData& buffer,
+	const GltfOptions& options,
+	const std::vector<Quatf>& rotations,
+	const RawInterpolation interpolation)
+{
+	// cubic spline tangents aren't unit quaternions
+	if (!options.quantizeAnimations.enabled || interpolation == RAW_INTERPOLATION_CUBICSPLINE)
+	{
+		return gltf.AddAccessorAndView(buffer, GLT_QUATF, rotations);
+	}
+	std::vector<mathfu::Vector<int16_t, 4>> quantized(rotations.size());
+	Vec4f previous(0.0f, 0.0f, 0.0f, 1.0f);
+	for (size_t ix = 0; ix < rotations.size(); ix++)
+	{
+		const Vec3f& axis = rotations[ix].vector();
+		Vec4f rotation(axis[0], axis[1], axis[2], rotations[ix].scalar());
+		if (Vec4f::DotProduct(rotation, previous) < 0.0f)
+		{
+			rotation = -rotation;
+		}
+		quantized[ix] = quantizeSnorm<int16_t>(rotation);
+		previous = rotation;
+	}
+	return gltf.AddAccessorAndView(buffer, GLT_VEC4S_NORM, quantized);
+}
+
+// the outputs of a morph target weights sampler; with --quantize-animations, normalized integers
+// unless a weight falls outside [0, 1]
+static std::shared_ptr<AccessorData> addWeightOutputAccessor(
+	GltfModel& gltf,
+	BufferData& buffer,
+	const GltfOptions& options,
+	const std::vector<float>& weights)
+{
+	const bool isUnorm = std::all_of(weights.begin(), weights.end(), [](const float weight) {
+		return weight >= 0.0f && weight <= 1.0f;
+	});
+	if (!options.quantizeAnimations.enabled || !isUnorm)
+	{
+		return gltf.AddAccessorAndView(buffer, GLT_FLOAT, weights);
+	}
+	const bool isShort = options.quantizeAnimations.bitsWeight == 16;
+	const float maxValue = isShort ? 65535.0f : 255.0f;
+	std::vector<uint32_t> quantized(weights.size());
+	for (size_t ix = 0; ix < weights.size(); ix++)
+	{
+		quantized[ix] = (uint32_t)(weights[ix] * maxValue + 0.5f);
+	}
+	return gltf.AddAccessorAndView(buffer, isShort ? GLT_USHORT_NORM : GLT_UBYTE_NORM, quantized);
+}
+
+// the keyframe times of an animation sampler, with the bounds glTF asks for
+static std::shared_ptr<AccessorData>
+addTimeAccessor(GltfModel& gltf, BufferData& buffer, const std::vector<float>& times)
+{
+	auto accessor = gltf.AddAccessorAndView(buffer, GLT_FLOAT, times);
+	accessor->min = {*std::min_element(std::begin(times), std::end(times))};
+	accessor->max = {*std::max_element(std::begin(times), std::end(times))};
+	return accessor;
+}
+
+/**
+ * One attribute of a primitive's vertices, read in place from the model's vertex columns.
+ */
+template <typename T>
+struct VertexColumn
+{
+	VertexColumn(const RawModel& raw, const RawPrimitive& rawPrimitive, const T RawVertex::*member)
+		: column(raw.GetAttributeColumn(member)), vertices(rawPrimitive.vertices), fallback(RawVertex().*member)
+	{
+	}
+
+	size_t size() const
+	{
+		return vertices.size();
+	}
+
+	const T& operator[](const size_t ix) const
+	{
+		return (column != nullptr) ? (*column)[vertices[ix]] : fallback;
+	}
+
+	const std::vector<T>* column;
+	const std::vector<int>& vertices;
+	T fallback;
+};
+
+/**
+ * The vertex attributes of one primitive, written into a single buffer view, one vertex after
+ * the other, in one pass over the vertices once all of them are known. Each attribute starts on
+ * a 4-byte boundary within the vertex, as glTF requires.
+ */
+struct InterleavedAttributes
+{
+	struct Attribute
+	{
+		std::string name;
+		GLType type;
+		uint32_t byteOffset;
+		std::function<void(uint32_t, uint8_t*)> write; // the attribute of one vertex
+		std::vector<float> min;
+		std::vector<float> max;
+	};
+
+	template <typename T, typename Convert>
+	void Add(
+		const std::string& name,
+		const GLType& type,
+		const VertexColumn<T>& values,
+		const Convert& convert,
+		const std::vector<float>& min,
+		const std::vector<float>& max)
+	{
+		assert(attributes.empty() || values.size() == count);
+		count = to_uint32(values.size());
+		attributes.push_back(Attribute{
+			name,
+			type,
+			byteStride,
+			[type, values, convert](const uint32_t ix, uint8_t* out) { type.write(out, convert(values[ix])); },
+			min,
+			max});
+		byteStride += (type.byteStride() + 3) & ~3u;
+	}
+
+	void Write(GltfModel& gltf, BufferData& buffer, PrimitiveData& primitive) const
+	{
+		if (attributes.empty())
+		{
+			return;
+		}
+		// padding between attributes stays zero
+		std::vector<uint8_t> vertices((size_t)count * byteStride, 0);
+		for (uint32_t ix = 0; ix < count; ix++)
+		{
+			uint8_t* vertex = &vertices[(size_t)ix * byteStride];
+			for (const Attribute& attribute : attributes)
+			{
+				attribute.write(ix, vertex + attribute.byteOffset);
+			}
+		}
+
+		const auto bufferView = gltf.AddInterleavedBufferView(buffer, vertices, byteStride);
+		for (const Attribute& attribute : attributes)
+		{
+			auto accessor = gltf.accessors.hold(new AccessorData(*bufferView, attribute.type, ""));
+			accessor->byteOffset = attribute.byteOffset;
+			accessor->count = count;
+			accessor->min = attribute.min;
+			accessor->max = attribute.max;
+			primitive.AddAttrib(attribute.name, *accessor);
+		}
+	}
+
+	std::vector<Attribute> attributes;
+	uint32_t count = 0;
+	uint32_t byteStride = 0;
+};
+
+// add an attribute in a buffer view of its own, or to the interleaved one; convert maps each
+// stored value to the one written
+template <typename T, typename Convert>
+static void addVertexAttribute(
+	GltfModel& gltf,
+	BufferData& buffer,
+	PrimitiveData& primitive,
+	InterleavedAttributes* interleaved,
+	const std::string& name,
+	const GLType& type,
+	const VertexColumn<T>& values,
+	const Convert& convert,
+	const std::vector<float>& min = {},
+	const std::vector<float>& max = {})
+{
+	if (interleaved != nullptr)
+	{
+		interleaved->Add(name, type, values, convert, min, max);
+		return;
+	}
+	typedef typename std::decay<decltype(convert(values[0]))>::type Converted;
+	std::vector<Converted> converted(values.size());
+	for (size_t ix = 0; ix < values.size(); ix++)
+	{
+		converted[ix] = convert(values[ix]);
+	}
+	auto accessor =
+		gltf.AddAccessorAndView(buffer, BufferViewData::GL_ARRAY_BUFFER, type, converted, std::string(""));
+	// the accessor may be shared with an earlier attribute of the same bytes, so never clear its bounds
+	if (!min.empty())
+	{
+		accessor->min = min;
+		accessor->max = max;
+	}
+	primitive.AddAttrib(name, *accessor);
+}
+
+// the same for an attribute stored as is, which may also go into the Draco mesh
+template <typename T>
+static void addRawVertexAttribute(
+	GltfModel& gltf,
+	BufferData& buffer,
+	const RawModel& raw,
+	const RawPrimitive& rawPrimitive,
+	PrimitiveData& primitive,
+	InterleavedAttributes* interleaved,
+	const AttributeDefinition<T>& attrDef,
+	const std::vector<float>& min = {},
+	const std::vector<float>& max = {})
+{
+	if (interleaved != nullptr)
+	{
+		interleaved->Add(
+			attrDef.gltfName,
+			attrDef.glType,
+			VertexColumn<T>(raw, rawPrimitive, attrDef.rawAttributeIx),
+			[](const T& value) { return value; },
+			min,
+			max);
+		return;
+	}
+	auto accessor = gltf.AddAttributeToPrimitive<T>(buffer, raw, rawPrimitive, primitive, attrDef);
+	if (!min.empty())
+	{
+		accessor->min = min;
+		accessor->max = max;
+	}
+}
+
+// whether a morph target offset moves any attribute we write out by more than the epsilon
+static bool isBlendDeltaSignificant(
+	const RawBlendDelta& delta,
+	const RawBlendChannel& channel,
+	const GltfOptions& options)
+{
+	const float epsilon = options.blendShapeEpsilon;
+	for (int i = 0; i < 3; i++)
+	{
+		if (std::fabs(delta.position[i]) > epsilon)
+		{
+			return true;
+		}
+	}
+	if (options.useBlendShapeNormals && channel.hasNormals)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if (std::fabs(delta.normal[i]) > epsilon)
+			{
+				return true;
+			}
+		}
+	}
+	if (options.useBlendShapeTangents && channel.hasTangents)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			if (std::fabs(delta.tangent[i]) > epsilon)
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/**
+ * The blend channels of each surface that have any significant offset, in their original order.
+ * All primitives of a surface share one mesh and so one list of morph targets, so a channel stays
+ * for all of them as soon as any one of them needs it.
+ */
+static std::map<uint64_t, std::vector<int>> getBlendChannels(
+	const RawModel& raw,
+	const std::vector<RawPrimitive>& primitives,
+	const GltfOptions& options)
+{
+	std::map<uint64_t, std::vector<bool>> keepBySurfaceId;
+	for (const RawPrimitive& primitive : primitives)
+	{
+		const RawSurface& surface = raw.GetSurface(primitive.surfaceIndex);
+		std::vector<bool>& keep = keepBySurfaceId[surface.id];
+		keep.resize(surface.blendChannels.size(), false);
+		for (const RawBlendDelta& delta : primitive.blendDeltas.GetDeltas())
+		{
+			if (!keep[delta.channelIndex] &&
+				isBlendDeltaSignificant(delta, surface.blendChannels[delta.channelIndex], options))
+			{
+				keep[delta.channelIndex] = true;
+			}
+		}
+	}
+
+	std::map<uint64_t, std::vector<int>> blendChannels;
+	for (const auto& entry : keepBySurfaceId)
+	{
+		std::vector<int>& channels = blendChannels[entry.first];
+		for (size_t channelIx = 0; channelIx < entry.second.size(); channelIx++)
+		{
+			if (entry.second[channelIx])
+			{
+				channels.push_back((int)channelIx);
+			}
+		}
+		if (verboseOutput && channels.size() < entry.second.size())
+		{
+			fmt::printf(
+				"Surface %s: dropped %lu of %lu blend channels without significant offsets.\n",
+				raw.GetSurface(raw.GetSurfaceById(entry.first)).name.c_str(),
+				entry.second.size() - channels.size(),
+				entry.second.size());
+		}
+	}
+	return blendChannels;
+}
+
+/**
+ * Groups of sibling nodes, in node order, that can be drawn as instances of a single node: each
+ * holds the same unskinned mesh, and has nothing else that depends on the node itself - no
+ * children, animation, camera or light.
+ */
+static std::vector<std::vector<int>> getInstanceGroups(const RawModel& raw, const GltfOptions& options)
+{
+	std::vector<bool> eligible(raw.GetNodeCount(), true);
+	for (int i = 0; i < raw.GetAnimationCount(); i++)
+	{
+		for (const RawChannel& channel : raw.GetAnimation(i).channels)
+		{
+			eligible[channel.nodeIndex] = false;
+		}
+	}
+	for (int i = 0; i < raw.GetCameraCount(); i++)
+	{
+		const int nodeIx = raw.GetNodeById(raw.GetCamera(i).nodeId);
+		if (nodeIx >= 0)
+		{
+			eligible[nodeIx] = false;
+		}
+	}
+
+	std::map<std::pair<uint64_t, uint64_t>, std::vector<int>> nodesByParentAndSurface;
+	for (int i = 0; i < raw.GetNodeCount(); i++)
+	{
+		const RawNode& node = raw.GetNode(i);
+		if (!eligible[i] || node.surfaceId == 0 || node.isJoint || node.lightIx >= 0 ||
+			!node.childIds.empty() || raw.GetNodeById(node.parentId) < 0)
+		{
+			continue;
+		}
+		const int surfaceIx = raw.GetSurfaceById(node.surfaceId);
+		if (surfaceIx < 0 || !raw.GetSurface(surfaceIx).jointIds.empty())
+		{
+			continue;
+		}
+		nodesByParentAndSurface[std::make_pair(node.parentId, node.surfaceId)].push_back(i);
+	}
+
+	std::vector<std::vector<int>> groups;
+	for (auto& entry : nodesByParentAndSurface)
+	{
+		if (entry.second.size() >= (size_t)options.instancing.minInstances)
+		{
+			groups.emplace_back(std::move(entry.second));
+		}
+	}
+	return groups;
+}
+
+/**
+ * Turn node into the EXT_mesh_gpu_instancing holder of the given instances, whose local transforms
+ * become its per-instance attributes. The extension applies those before the node's own transform,
+ * so a quantized mesh must dequantize within each of them, and the node is left as the identity.
+ */
+static void addInstanceAttributes(
+	GltfModel& gltf,
+	BufferData& buffer,
+	const RawModel& raw,
+	const std::vector<int>& instanceNodes,
+	const PositionQuantization* quantization,
+	NodeData& node)
+{
+	std::vector<Vec3f> translations;
+	std::vector<Quatf> rotations;
+	std::vector<Vec3f> scales;
+	bool anyRotation = false;
+	bool anyScale = false;
+	for (const int nodeIx : instanceNodes)
+	{
+		const RawNode& instance = raw.GetNode(nodeIx);
+		const Quatf rotation = instance.rotation.Normalized();
+		Vec3f translation = instance.translation;
+		Vec3f scale = instance.scale;
+		if (quantization != nullptr)
+		{
+			// TRS * T(offset) * S(scale) is again a TRS transform, as the scale is uniform
+			translation += rotation * (scale * quantization->offset);
+			scale *= quantization->scale;
+		}
+		translations.push_back(translation);
+		rotations.push_back(rotation);
+		scales.push_back(scale);
+		anyRotation |= rotation.scalar() != 1.0f || rotation.vector() != VEC3F_ZERO;
+		anyScale |= scale != VEC3F_ONE;
+	}
+
+	node.instanceAttributes["TRANSLATION"] = gltf.AddAccessorAndView(buffer, GLT_VEC3F, translations)->ix;
+	if (anyRotation)
+	{
+		node.instanceAttributes["ROTATION"] = gltf.AddAccessorAndView(buffer, GLT_QUATF, rotations)->ix;
+	}
+	if (anyScale)
+	{
+		node.instanceAttributes["SCALE"] = gltf.AddAccessorAndView(buffer, GLT_VEC3F, scales)->ix;
+	}
+	node.translation = VEC3F_ZERO;
+	node.rotation = Quatf(1.0f, 0.0f, 0.0f, 0.0f);
+	node.scale = VEC3F_ONE;
+}
+
 ModelData* Raw2Gltf(
 	std::ofstream& gltfOutStream,
 	const std::string& outputFolder,
@@ -104,12 +863,23 @@ ModelData* Raw2Gltf(
 		}
 	}
 
-	std::vector<RawModel> materialModels;
+	std::vector<RawPrimitive> materialModels;
 	raw.CreateMaterialModels(
 		materialModels,
 		options.useLongIndices == UseLongIndicesOptions::NEVER,
-		options.keepAttribs,
-		true);
+		options.keepAttribs);
+	if (options.optimizeVertexCache || options.optimizeOverdraw || options.optimizeVertexFetch ||
+		!options.lodRatios.empty())
+	{
+		optimizePrimitives(raw, materialModels, options);
+	}
+	std::map<uint64_t, PositionQuantization> positionQuantizationBySurfaceId;
+	if (options.quantize.enabled)
+	{
+		positionQuantizationBySurfaceId = getPositionQuantizations(raw, materialModels);
+	}
+	std::map<uint64_t, std::vector<int>> blendChannelsBySurfaceId =
+		getBlendChannels(raw, materialModels, options);
 
 	if (verboseOutput)
 	{
@@ -129,6 +899,10 @@ ModelData* Raw2Gltf(
 	std::map<uint64_t, std::shared_ptr<MaterialData>> materialsById;
 	std::map<std::string, std::shared_ptr<TextureData>> textureByIndicesKey;
 	std::map<uint64_t, std::shared_ptr<MeshData>> meshBySurfaceId;
+	std::map<uint64_t, std::vector<std::shared_ptr<MeshData>>> lodMeshesBySurfaceId;
+	std::map<uint64_t, std::shared_ptr<NodeData>> meshNodesById;
+	std::map<uint64_t, std::vector<int>> instanceNodesById;
+	std::vector<bool> mergedIntoInstances(raw.GetNodeCount(), false);
 
 	// for now, we only have one buffer; data->binary points to the same vector as that BufferData
 	// does.
@@ -162,6 +936,86 @@ ModelData* Raw2Gltf(
 			nodesById.insert(std::make_pair(node.id, nodeData));
 		}
 
+		//
+		// instancing: the first node of each group holds the mesh for all of them; the others stay
+		// behind as nodes outside the scene hierarchy, as raw and glTF node indices must line up
+		//
+		if (options.instancing.enabled)
+		{
+			size_t mergedNodeCount = 0;
+			for (const auto& group : getInstanceGroups(raw, options))
+			{
+				const RawNode& first = raw.GetNode(group[0]);
+				for (size_t instanceIx = 1; instanceIx < group.size(); instanceIx++)
+				{
+					mergedIntoInstances[group[instanceIx]] = true;
+				}
+				auto& siblings = require(nodesById, first.parentId).children;
+				siblings.erase(
+					std::remove_if(
+						siblings.begin(),
+						siblings.end(),
+						[&](const uint32_t childIx) { return mergedIntoInstances[childIx]; }),
+					siblings.end());
+				instanceNodesById[first.id] = group;
+				mergedNodeCount += group.size();
+			}
+			if (verboseOutput && !instanceNodesById.empty())
+			{
+				fmt::printf(
+					"Instancing: merged %lu nodes into %lu instanced nodes.\n",
+					mergedNodeCount,
+					instanceNodesById.size());
+			}
+		}
+
+		//
+		// quantized meshes get their dequantization transform folded into the node that holds them;
+		// when anything else depends on that node's own transform - an animation, children, a skin
+		// that uses it as a joint, a light or a camera - the mesh moves to a new child node instead.
+		// Skinned meshes ignore the node transform and fold it into the skin.
+		//
+		if (options.quantize.enabled)
+		{
+			std::vector<bool> transformShared(raw.GetNodeCount(), false);
+			for (int i = 0; i < raw.GetAnimationCount(); i++)
+			{
+				for (const RawChannel& channel : raw.GetAnimation(i).channels)
+				{
+					if (!channel.translations.empty() || !channel.rotations.empty() || !channel.scales.empty())
+					{
+						transformShared[channel.nodeIndex] = true;
+					}
+				}
+			}
+			for (int i = 0; i < raw.GetCameraCount(); i++)
+			{
+				const int nodeIx = raw.GetNodeById(raw.GetCamera(i).nodeId);
+				if (nodeIx >= 0)
+				{
+					transformShared[nodeIx] = true;
+				}
+			}
+			for (int i = 0; i < raw.GetNodeCount(); i++)
+			{
+				const RawNode& node = raw.GetNode(i);
+				if (node.surfaceId == 0 ||
+					(node.childIds.empty() && !node.isJoint && node.lightIx < 0 && !transformShared[i]))
+				{
+					continue;
+				}
+				const RawSurface& rawSurface = raw.GetSurface(raw.GetSurfaceById(node.surfaceId));
+				if (!rawSurface.jointIds.empty())
+				{
+					continue;
+				}
+				auto meshNode = gltf->nodes.hold(
+					new NodeData(node.name + "_mesh", VEC3F_ZERO, Quatf(1.0f, 0.0f, 0.0f, 0.0f), VEC3F_ONE, false));
+				gltf->nodes.ptrs[i]->AddChildNode(meshNode->ix);
+				meshNodesById[node.id] = meshNode;
+			}
+		}
+
 		//
 		// animations
 		//
@@ -177,11 +1031,22 @@ ModelData* Raw2Gltf(
 				continue;
 			}
 
-			auto accessor = gltf->AddAccessorAndView(buffer, GLT_FLOAT, animation.times);
-			accessor->min = {*std::min_element(std::begin(animation.times), std::end(animation.times))};
-			accessor->max = {*std::max_element(std::begin(animation.times), std::end(animation.times))};
+			// properties that kept every baked keyframe share the times of the animation
+			std::shared_ptr<AccessorData> animationTimes;
+			const auto timesFor = [&](const std::vector<float>& times) -> const AccessorData&
+			{
+				if (!times.empty())
+				{
+					return *addTimeAccessor(*gltf, buffer, times);
+				}
+				if (animationTimes == nullptr)
+				{
+					animationTimes = addTimeAccessor(*gltf, buffer, animation.times);
+				}
+				return *animationTimes;
+			};
 
-			AnimationData& aDat = *gltf->animations.hold(new AnimationData(animation.name, *accessor));
+			AnimationData& aDat = *gltf->animations.hold(new AnimationData(animation.name));
 			if (verboseOutput)
 			{
 				fmt::printf(
@@ -212,25 +1077,58 @@ ModelData* Raw2Gltf(
 				{
 					aDat.AddNodeChannel(
 						nDat,
-						*gltf->AddAccessorAndView(buffer, GLT_VEC3F, channel.translations),
-						"translation");
+						timesFor(channel.translationTimes),
+						*addVectorOutputAccessor(*gltf, buffer, options, channel.translations),
+						"translation",
+						describeInterpolation(channel.translationInterpolation));
 				}
 				if (!channel.rotations.empty())
 				{
 					aDat.AddNodeChannel(
-						nDat, *gltf->AddAccessorAndView(buffer, GLT_QUATF, channel.rotations), "rotation");
+						nDat,
+						timesFor(channel.rotationTimes),
+						*addRotationOutputAccessor(
+							*gltf, buffer, options, channel.rotations, channel.rotationInterpolation),
+						"rotation",
+						describeInterpolation(channel.rotationInterpolation));
 				}
 				if (!channel.scales.empty())
 				{
 					aDat.AddNodeChannel(
-						nDat, *gltf->AddAccessorAndView(buffer, GLT_VEC3F, channel.scales), "scale");
+						nDat,
+						timesFor(channel.scaleTimes),
+						*addVectorOutputAccessor(*gltf, buffer, options, channel.scales),
+						"scale",
+						describeInterpolation(channel.scaleInterpolation));
 				}
 				if (!channel.weights.empty())
 				{
-					aDat.AddNodeChannel(
-						nDat,
-						*gltf->AddAccessorAndView(buffer, {CT_FLOAT, 1, "SCALAR"}, channel.weights),
-						"weights");
+					// each frame holds a weight for every blend channel; keep those the mesh still has
+					std::vector<float> weights;
+					const int surfaceIx = raw.GetSurfaceById(node.surfaceId);
+					auto blendChannelsIter = blendChannelsBySurfaceId.find(node.surfaceId);
+					if (surfaceIx >= 0 && blendChannelsIter != blendChannelsBySurfaceId.end())
+					{
+						const size_t channelCount = raw.GetSurface(surfaceIx).blendChannels.size();
+						for (size_t frameIx = 0; frameIx + channelCount <= channel.weights.size();
+							 frameIx += channelCount)
+						{
+							for (const int blendChannelIx : blendChannelsIter->second)
+							{
+								weights.push_back(channel.weights[frameIx + blendChannelIx]);
+							}
+						}
+					}
+					if (!weights.empty())
+					{
+						// morph weights belong to whichever node ended up holding the mesh
+						auto meshNodeIter = meshNodesById.find(node.id);
+						aDat.AddNodeChannel(
+							(meshNodeIter != meshNodesById.end()) ? *meshNodeIter->second : nDat,
+							timesFor({}),
+							*addWeightOutputAccessor(*gltf, buffer, options, weights),
+							"weights");
+					}
 				}
 			}
 		}
@@ -407,14 +1305,14 @@ ModelData* Raw2Gltf(
 			}
 		}
 
-		for (const auto& surfaceModel : materialModels)
+		for (const auto& rawPrimitive : materialModels)
 		{
-			assert(surfaceModel.GetSurfaceCount() == 1);
-			const RawSurface& rawSurface = surfaceModel.GetSurface(0);
+			const RawSurface& rawSurface = raw.GetSurface(rawPrimitive.surfaceIndex);
 			const uint64_t surfaceId = rawSurface.id;
 
-			const RawMaterial& rawMaterial = surfaceModel.GetMaterial(surfaceModel.GetTriangle(0).materialIndex);
+			const RawMaterial& rawMaterial = raw.GetMaterial(rawPrimitive.materialIndex);
 			const MaterialData& mData = require(materialsById, rawMaterial.id);
+			const std::vector<int>& blendChannels = blendChannelsBySurfaceId[surfaceId];
 
 			MeshData* mesh = nullptr;
 			auto meshIter = meshBySurfaceId.find(surfaceId);
@@ -425,9 +1323,9 @@ ModelData* Raw2Gltf(
 			else
 			{
 				std::vector<float> defaultDeforms;
-				for (const auto& channel : rawSurface.blendChannels)
+				for (const int channelIx : blendChannels)
 				{
-					defaultDeforms.push_back(channel.defaultDeform);
+					defaultDeforms.push_back(rawSurface.blendChannels[channelIx].defaultDeform);
 				}
 				auto meshPtr = gltf->meshes.hold(new MeshData(rawSurface.name, defaultDeforms));
 				meshBySurfaceId[surfaceId] = meshPtr;
@@ -436,24 +1334,24 @@ ModelData* Raw2Gltf(
 
 			bool useLongIndices = (options.useLongIndices == UseLongIndicesOptions::ALWAYS) ||
 			(options.useLongIndices == UseLongIndicesOptions::AUTO &&
-				surfaceModel.GetVertexCount() > 65535);
+				rawPrimitive.GetVertexCount() > 65535);
 
 			std::shared_ptr<PrimitiveData> primitive;
 			if (options.draco.enabled)
 			{
-				size_t triangleCount = surfaceModel.GetTriangleCount();
+				size_t triangleCount = rawPrimitive.GetTriangleCount();
 
 				// initialize Draco mesh with vertex index information
 				auto dracoMesh(std::make_shared<draco::Mesh>());
 				dracoMesh->SetNumFaces(triangleCount);
-				dracoMesh->set_num_points(surfaceModel.GetVertexCount());
+				dracoMesh->set_num_points(rawPrimitive.GetVertexCount());
 
 				for (uint32_t ii = 0; ii < triangleCount; ii++)
 				{
 					draco::Mesh::Face face;
-					face[0] = surfaceModel.GetTriangle(ii).verts[0];
-					face[1] = surfaceModel.GetTriangle(ii).verts[1];
-					face[2] = surfaceModel.GetTriangle(ii).verts[2];
+					face[0] = rawPrimitive.indices[3 * ii + 0];
+					face[1] = rawPrimitive.indices[3 * ii + 1];
+					face[2] = rawPrimitive.indices[3 * ii + 2];
 					dracoMesh->SetFace(draco::FaceIndex(ii), face);
 				}
 
@@ -464,19 +1362,50 @@ ModelData* Raw2Gltf(
 			}
 			else
 			{
-				const AccessorData& indexes = *gltf->AddAccessorWithView(
-					*gltf->GetAlignedBufferView(buffer, BufferViewData::GL_ELEMENT_ARRAY_BUFFER),
+				const AccessorData& indexes = *gltf->AddAccessorAndView(
+					buffer,
+					BufferViewData::GL_ELEMENT_ARRAY_BUFFER,
 					useLongIndices ? GLT_UINT : GLT_USHORT,
-					getIndexArray(surfaceModel),
+					rawPrimitive.indices,
 					std::string(""));
 				primitive.reset(new PrimitiveData(indexes, mData));
 			};
 
+			// with --quantize, most attributes are written as KHR_mesh_quantization integers
+			const PositionQuantization* quantization = nullptr;
+			if (options.quantize.enabled)
+			{
+				quantization = &positionQuantizationBySurfaceId.at(surfaceId);
+			}
+
 			//
 			// surface vertices
 			//
 			{
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_POSITION) != 0)
+				// Draco meshes carry their own attribute layout
+				InterleavedAttributes interleavedAttributes;
+				InterleavedAttributes* interleaved =
+					(options.interleave && primitive->dracoMesh == nullptr) ? &interleavedAttributes : nullptr;
+
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_POSITION) != 0 &&
+					quantization != nullptr)
+				{
+					// the bounds of normalized accessors are given in the stored integers
+					addVertexAttribute(
+						*gltf,
+						buffer,
+						*primitive,
+						interleaved,
+						"POSITION",
+						GLT_VEC3US_NORM,
+						VertexColumn<Vec3f>(raw, rawPrimitive, &RawVertex::position),
+						[quantization](const Vec3f& position) {
+							return quantizeUnorm<uint16_t>(quantization->Quantize(position));
+						},
+						toFloatVec(quantizeUnorm<uint16_t>(quantization->Quantize(rawPrimitive.bounds.min))),
+						toFloatVec(quantizeUnorm<uint16_t>(quantization->Quantize(rawPrimitive.bounds.max))));
+				}
+				else if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_POSITION) != 0)
 				{
 					const AttributeDefinition<Vec3f> ATTR_POSITION(
 						"POSITION",
@@ -484,13 +1413,37 @@ ModelData* Raw2Gltf(
 						GLT_VEC3F,
 						draco::GeometryAttribute::POSITION,
 						draco::DT_FLOAT32);
-					auto accessor =
-						gltf->AddAttributeToPrimitive<Vec3f>(buffer, surfaceModel, *primitive, ATTR_POSITION);
-
-					accessor->min = toStdVec(rawSurface.bounds.min);
-					accessor->max = toStdVec(rawSurface.bounds.max);
+					addRawVertexAttribute<Vec3f>(
+						*gltf,
+						buffer,
+						raw,
+						rawPrimitive,
+						*primitive,
+						interleaved,
+						ATTR_POSITION,
+						toStdVec(rawPrimitive.bounds.min),
+						toStdVec(rawPrimitive.bounds.max));
+				}
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0 &&
+					quantization != nullptr)
+				{
+					const VertexColumn<Vec3f> normals(raw, rawPrimitive, &RawVertex::normal);
+					if (options.quantize.bitsNormal == 8)
+					{
+						addVertexAttribute(
+							*gltf, buffer, *primitive, interleaved, "NORMAL", GLT_VEC3B_NORM, normals, [](const Vec3f& normal) {
+								return quantizeSnorm<int8_t>(normal);
+							});
+					}
+					else
+					{
+						addVertexAttribute(
+							*gltf, buffer, *primitive, interleaved, "NORMAL", GLT_VEC3S_NORM, normals, [](const Vec3f& normal) {
+								return quantizeSnorm<int16_t>(normal);
+							});
+					}
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0)
+				else if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0)
 				{
 					const AttributeDefinition<Vec3f> ATTR_NORMAL(
 						"NORMAL",
@@ -498,16 +1451,35 @@ ModelData* Raw2Gltf(
 						GLT_VEC3F,
 						draco::GeometryAttribute::NORMAL,
 						draco::DT_FLOAT32);
-					const auto _ =
-						gltf->AddAttributeToPrimitive<Vec3f>(buffer, surfaceModel, *primitive, ATTR_NORMAL);
+					addRawVertexAttribute<Vec3f>(
+						*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_NORMAL);
+				}
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0 &&
+					quantization != nullptr)
+				{
+					const VertexColumn<Vec4f> tangents(raw, rawPrimitive, &RawVertex::tangent);
+					if (options.quantize.bitsNormal == 8)
+					{
+						addVertexAttribute(
+							*gltf, buffer, *primitive, interleaved, "TANGENT", GLT_VEC4B_NORM, tangents, [](const Vec4f& tangent) {
+								return quantizeSnorm<int8_t>(tangent);
+							});
+					}
+					else
+					{
+						addVertexAttribute(
+							*gltf, buffer, *primitive, interleaved, "TANGENT", GLT_VEC4S_NORM, tangents, [](const Vec4f& tangent) {
+								return quantizeSnorm<int16_t>(tangent);
+							});
+					}
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0)
+				else if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0)
 				{
 					const AttributeDefinition<Vec4f> ATTR_TANGENT("TANGENT", &RawVertex::tangent, GLT_VEC4F);
-					const auto _ = gltf->AddAttributeToPrimitive<Vec4f>(
-						buffer, surfaceModel, *primitive, ATTR_TANGENT);
+					addRawVertexAttribute<Vec4f>(
+						*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_TANGENT);
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_COLOR) != 0)
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_COLOR) != 0)
 				{
 					const AttributeDefinition<Vec4f> ATTR_COLOR(
 						"COLOR_0",
@@ -515,10 +1487,32 @@ ModelData* Raw2Gltf(
 						GLT_VEC4F,
 						draco::GeometryAttribute::COLOR,
 						draco::DT_FLOAT32);
-					const auto _ =
-						gltf->AddAttributeToPrimitive<Vec4f>(buffer, surfaceModel, *primitive, ATTR_COLOR);
+					addRawVertexAttribute<Vec4f>(*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_COLOR);
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_UV0) != 0)
+				// UVs outside [0, 1], as on tiling textures, don't fit normalized integers and stay float
+				const auto addQuantizedTexCoords = [&](const std::string& name, const Vec2f RawVertex::*member)
+				{
+					if (quantization == nullptr)
+					{
+						return false;
+					}
+					const VertexColumn<Vec2f> uvs(raw, rawPrimitive, member);
+					for (size_t ix = 0; ix < uvs.size(); ix++)
+					{
+						const Vec2f& uv = uvs[ix];
+						if (uv[0] < 0.0f || uv[0] > 1.0f || uv[1] < 0.0f || uv[1] > 1.0f)
+						{
+							return false;
+						}
+					}
+					addVertexAttribute(
+						*gltf, buffer, *primitive, interleaved, name, GLT_VEC2US_NORM, uvs, [](const Vec2f& uv) {
+							return quantizeUnorm<uint16_t>(uv);
+						});
+					return true;
+				};
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0 &&
+					!addQuantizedTexCoords("TEXCOORD_0", &RawVertex::uv0))
 				{
 					const AttributeDefinition<Vec2f> ATTR_TEXCOORD_0(
 						"TEXCOORD_0",
@@ -526,10 +1520,11 @@ ModelData* Raw2Gltf(
 						GLT_VEC2F,
 						draco::GeometryAttribute::TEX_COORD,
 						draco::DT_FLOAT32);
-					const auto _ = gltf->AddAttributeToPrimitive<Vec2f>(
-						buffer, surfaceModel, *primitive, ATTR_TEXCOORD_0);
+					addRawVertexAttribute<Vec2f>(
+						*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_TEXCOORD_0);
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_UV1) != 0)
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0 &&
+					!addQuantizedTexCoords("TEXCOORD_1", &RawVertex::uv1))
 				{
 					const AttributeDefinition<Vec2f> ATTR_TEXCOORD_1(
 						"TEXCOORD_1",
@@ -537,10 +1532,10 @@ ModelData* Raw2Gltf(
 						GLT_VEC2F,
 						draco::GeometryAttribute::TEX_COORD,
 						draco::DT_FLOAT32);
-					const auto _ = gltf->AddAttributeToPrimitive<Vec2f>(
-						buffer, surfaceModel, *primitive, ATTR_TEXCOORD_1);
+					addRawVertexAttribute<Vec2f>(
+						*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_TEXCOORD_1);
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0)
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0)
 				{
 					const AttributeDefinition<Vec4i> ATTR_JOINTS(
 						"JOINTS_0",
@@ -548,10 +1543,9 @@ ModelData* Raw2Gltf(
 						GLT_VEC4I,
 						draco::GeometryAttribute::GENERIC,
 						draco::DT_UINT16);
-					const auto _ =
-						gltf->AddAttributeToPrimitive<Vec4i>(buffer, surfaceModel, *primitive, ATTR_JOINTS);
+					addRawVertexAttribute<Vec4i>(*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_JOINTS);
 				}
-				if ((surfaceModel.GetVertexAttributes() & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0)
+				if ((rawPrimitive.vertexAttributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0)
 				{
 					const AttributeDefinition<Vec4f> ATTR_WEIGHTS(
 						"WEIGHTS_0",
@@ -559,60 +1553,80 @@ ModelData* Raw2Gltf(
 						GLT_VEC4F,
 						draco::GeometryAttribute::GENERIC,
 						draco::DT_FLOAT32);
-					const auto _ =
-						gltf->AddAttributeToPrimitive<Vec4f>(buffer, surfaceModel, *primitive, ATTR_WEIGHTS);
+					addRawVertexAttribute<Vec4f>(*gltf, buffer, raw, rawPrimitive, *primitive, interleaved, ATTR_WEIGHTS);
 				}
-
-				// each channel present in the mesh always ends up a target in the primitive
-				for (int channelIx = 0; channelIx < rawSurface.blendChannels.size(); channelIx++)
+				if (interleaved != nullptr)
 				{
-					const auto& channel = rawSurface.blendChannels[channelIx];
+					interleaved->Write(*gltf, buffer, *primitive);
+				}
 
-					// track the bounds of each shape channel
-					Bounds<float, 3> shapeBounds;
+				// each channel kept for the mesh ends up a target in the primitive, even if it moves
+				// none of this primitive's vertices
+				const RawBlendDeltaStore& blendDeltas = rawPrimitive.blendDeltas;
+				std::vector<uint32_t> channelOffsets, channelOrder;
+				blendDeltas.GroupByChannel(rawSurface.blendChannels.size(), channelOffsets, channelOrder);
+				// morph targets stay float, but must offset quantized positions in their own units
+				const float targetPositionScale = (quantization != nullptr) ? 1.0f / quantization->scale : 1.0f;
+				const uint32_t vertexCount = to_uint32(rawPrimitive.GetVertexCount());
 
-					std::vector<Vec3f> positions, normals;
+				for (const int channelIx : blendChannels)
+				{
+					const auto& channel = rawSurface.blendChannels[channelIx];
+					const bool useNormals = options.useBlendShapeNormals && channel.hasNormals;
+					const bool useTangents = options.useBlendShapeTangents && channel.hasTangents;
+
+					// gather the significant deltas of this channel, in vertex order; the sparse
+					// accessors leave all other vertices at zero
+					std::vector<uint32_t> vertexIndices;
+					std::vector<Vec3f> positions;
+					std::vector<Vec3f> normals;
 					std::vector<Vec4f> tangents;
-					for (int jj = 0; jj < surfaceModel.GetVertexCount(); jj++)
+					for (uint32_t ix = channelOffsets[channelIx]; ix < channelOffsets[channelIx + 1]; ix++)
 					{
-						auto blendVertex = surfaceModel.GetVertex(jj).blends[channelIx];
-						shapeBounds.AddPoint(blendVertex.position);
-						positions.push_back(blendVertex.position);
-						if (options.useBlendShapeTangents && channel.hasNormals)
+						const RawBlendDelta& delta = blendDeltas.GetDeltas()[channelOrder[ix]];
+						if (!isBlendDeltaSignificant(delta, channel, options))
+						{
+							continue;
+						}
+						vertexIndices.push_back((uint32_t)delta.vertexIndex);
+						positions.push_back(delta.position * targetPositionScale);
+						if (useNormals)
 						{
-							normals.push_back(blendVertex.normal);
+							normals.push_back(delta.normal);
 						}
-						if (options.useBlendShapeTangents && channel.hasTangents)
+						if (useTangents)
 						{
-							tangents.push_back(blendVertex.tangent);
+							tangents.push_back(delta.tangent);
 						}
 					}
-					std::shared_ptr<AccessorData> pAcc = gltf->AddAccessorWithView(
-						*gltf->GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_BUFFER),
-						GLT_VEC3F,
-						positions,
-						channel.name);
+
+					// track the bounds of each shape channel, untouched vertices included
+					Bounds<float, 3> shapeBounds;
+					if (vertexIndices.size() < vertexCount)
+					{
+						shapeBounds.AddPoint(Vec3f{0.0f});
+					}
+					for (const auto& position : positions)
+					{
+						shapeBounds.AddPoint(position);
+					}
+					std::shared_ptr<AccessorData> pAcc = gltf->AddSparseAccessor(
+						buffer, GLT_VEC3F, vertexCount, vertexIndices, positions, channel.name);
 					pAcc->min = toStdVec(shapeBounds.min);
 					pAcc->max = toStdVec(shapeBounds.max);
 
 					std::shared_ptr<AccessorData> nAcc;
-					if (!normals.empty())
+					if (useNormals)
 					{
-						nAcc = gltf->AddAccessorWithView(
-							*gltf->GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_BUFFER),
-							GLT_VEC3F,
-							normals,
-							channel.name);
+						nAcc = gltf->AddSparseAccessor(
+							buffer, GLT_VEC3F, vertexCount, vertexIndices, normals, channel.name);
 					}
 
 					std::shared_ptr<AccessorData> tAcc;
-					if (!tangents.empty())
+					if (useTangents)
 					{
-						nAcc = gltf->AddAccessorWithView(
-							*gltf->GetAlignedBufferView(buffer, BufferViewData::GL_ARRAY_BUFFER),
-							GLT_VEC4F,
-							tangents,
-							channel.name);
+						tAcc = gltf->AddSparseAccessor(
+							buffer, GLT_VEC4F, vertexCount, vertexIndices, tangents, channel.name);
 					}
 
 					primitive->AddTarget(pAcc.get(), nAcc.get(), tAcc.get());
@@ -662,6 +1676,27 @@ ModelData* Raw2Gltf(
 				primitive->NoteDracoBuffer(*view);
 			}
 			mesh->AddPrimitive(primitive);
+
+			// the simplified levels share the vertex attributes and morph targets of the full one
+			for (size_t level = 0; level < rawPrimitive.lodIndices.size(); level++)
+			{
+				auto& lodMeshes = lodMeshesBySurfaceId[surfaceId];
+				if (lodMeshes.size() <= level)
+				{
+					lodMeshes.push_back(gltf->meshes.hold(
+						new MeshData(rawSurface.name + "_LOD" + std::to_string(level + 1), mesh->weights)));
+				}
+				const AccessorData& lodIndexes = *gltf->AddAccessorAndView(
+					buffer,
+					BufferViewData::GL_ELEMENT_ARRAY_BUFFER,
+					useLongIndices ? GLT_UINT : GLT_USHORT,
+					rawPrimitive.lodIndices[level],
+					std::string(""));
+				std::shared_ptr<PrimitiveData> lodPrimitive(new PrimitiveData(lodIndexes, mData));
+				lodPrimitive->attributes = primitive->attributes;
+				lodPrimitive->targetAccessors = primitive->targetAccessors;
+				lodMeshes[level]->AddPrimitive(lodPrimitive);
+			}
 		}
 
 		//
@@ -672,6 +1707,10 @@ ModelData* Raw2Gltf(
 		{
 			const RawNode& node = raw.GetNode(i);
 			auto nodeData = gltf->nodes.ptrs[i];
+			if (mergedIntoInstances[i])
+			{
+				continue;
+			}
 
 			//
 			// Assign mesh to node
@@ -682,7 +1721,24 @@ ModelData* Raw2Gltf(
 				const RawSurface& rawSurface = raw.GetSurface(surfaceIndex);
 
 				MeshData& meshData = require(meshBySurfaceId, rawSurface.id);
-				nodeData->SetMesh(meshData.ix);
+				auto meshNodeIter = meshNodesById.find(node.id);
+				auto meshNode = (meshNodeIter != meshNodesById.end()) ? meshNodeIter->second : nodeData;
+				meshNode->SetMesh(meshData.ix);
+
+				const auto quantIter = positionQuantizationBySurfaceId.find(rawSurface.id);
+				const PositionQuantization* quantization =
+					(quantIter != positionQuantizationBySurfaceId.end()) ? &quantIter->second : nullptr;
+				const auto instanceIter = instanceNodesById.find(node.id);
+				if (instanceIter != instanceNodesById.end())
+				{
+					addInstanceAttributes(*gltf, buffer, raw, instanceIter->second, quantization, *meshNode);
+				}
+				else if (quantization != nullptr && rawSurface.jointIds.empty())
+				{
+					// TRS * T(offset) * S(scale) is again a TRS transform, as the scale is uniform
+					meshNode->translation += meshNode->rotation * (meshNode->scale * quantization->offset);
+					meshNode->scale *= quantization->scale;
+				}
 
 				//
 				// surface skin
@@ -691,11 +1747,14 @@ ModelData* Raw2Gltf(
 				{
 					if (nodeData->skin == -1)
 					{
-						// glTF uses column-major matrices
+						// glTF uses column-major matrices; quantized positions dequantize through them
 						std::vector<Mat4f> inverseBindMatrices;
 						for (const auto& inverseBindMatrice : rawSurface.inverseBindMatrices)
 						{
-							inverseBindMatrices.push_back(inverseBindMatrice.Transpose());
+							inverseBindMatrices.push_back(
+								(quantization != nullptr)
+									? inverseBindMatrice.Transpose() * quantization->GetDequantizeMatrix()
+									: inverseBindMatrice.Transpose());
 						}
 
 						std::vector<uint32_t> jointIndexes;
@@ -712,6 +1771,31 @@ ModelData* Raw2Gltf(
 						nodeData->SetSkin(skin.ix);
 					}
 				}
+
+				//
+				// levels of detail: MSFT_lod points at nodes outside the scene hierarchy that stand
+				// in for this one, with the same transform and skin but a coarser mesh
+				//
+				auto lodIter = lodMeshesBySurfaceId.find(rawSurface.id);
+				if (lodIter != lodMeshesBySurfaceId.end())
+				{
+					for (size_t level = 0; level < lodIter->second.size(); level++)
+					{
+						auto lodNode = gltf->nodes.hold(new NodeData(
+							meshNode->name + "_LOD" + std::to_string(level + 1),
+							meshNode->translation,
+							meshNode->rotation,
+							meshNode->scale,
+							false));
+						lodNode->SetMesh(lodIter->second[level]->ix);
+						lodNode->instanceAttributes = meshNode->instanceAttributes;
+						if (meshNode->skin >= 0)
+						{
+							lodNode->SetSkin(meshNode->skin);
+						}
+						meshNode->lods.push_back(lodNode->ix);
+					}
+				}
 			}
 		}
 
@@ -799,6 +1883,11 @@ ModelData* Raw2Gltf(
 		}
 	}
 
+	if (verboseOutput)
+	{
+		gltf->PrintAccessorCacheStats();
+	}
+
 	NodeData& rootNode = require(nodesById, raw.GetRootNode());
 	const SceneData& rootScene = *gltf->scenes.hold(new SceneData(DEFAULT_SCENE_NAME, rootNode));
 
@@ -845,11 +1934,31 @@ ModelData* Raw2Gltf(
 		{
 			extensionsUsed.push_back(KHR_LIGHTS_PUNCTUAL);
 		}
+		if (!lodMeshesBySurfaceId.empty())
+		{
+			extensionsUsed.push_back(MSFT_LOD);
+		}
+		if (!instanceNodesById.empty())
+		{
+			extensionsUsed.push_back(EXT_MESH_GPU_INSTANCING);
+			extensionsRequired.push_back(EXT_MESH_GPU_INSTANCING);
+		}
+		if (options.quantize.enabled)
+		{
+			extensionsUsed.push_back(KHR_MESH_QUANTIZATION);
+			extensionsRequired.push_back(KHR_MESH_QUANTIZATION);
+		}
 		if (options.draco.enabled)
 		{
 			extensionsUsed.push_back(KHR_DRACO_MESH_COMPRESSION);
 			extensionsRequired.push_back(KHR_DRACO_MESH_COMPRESSION);
 		}
+		// the fallback buffer holds no data, so the extension can't be optional
+		if (options.meshoptCompression && gltf->EncodeMeshoptBufferViews())
+		{
+			extensionsUsed.push_back(EXT_MESHOPT_COMPRESSION);
+			extensionsRequired.push_back(EXT_MESHOPT_COMPRESSION);
+		}
 
 		json glTFJson{
 			{"asset", {{"generator", "FBX2glTF v" + FBX2GLTF_VERSION}, {"version", "2.0"}}},
@@ -21,6 +21,10 @@
 const std::string KHR_DRACO_MESH_COMPRESSION = "KHR_draco_mesh_compression";
 const std::string KHR_MATERIALS_CMN_UNLIT = "KHR_materials_unlit";
 const std::string KHR_LIGHTS_PUNCTUAL = "KHR_lights_punctual";
+const std::string KHR_MESH_QUANTIZATION = "KHR_mesh_quantization";
+const std::string EXT_MESHOPT_COMPRESSION = "EXT_meshopt_compression";
+const std::string MSFT_LOD = "MSFT_lod";
+const std::string EXT_MESH_GPU_INSTANCING = "EXT_mesh_gpu_instancing";
 
 const std::string extBufferFilename = "buffer.bin";
 
@@ -42,6 +46,9 @@ struct ComponentType
 	const unsigned int size;
 };
 
+const ComponentType CT_BYTE = {ComponentType::GL_BYTE, 1};
+const ComponentType CT_UBYTE = {ComponentType::GL_UNSIGNED_BYTE, 1};
+const ComponentType CT_SHORT = {ComponentType::GL_SHORT, 2};
 const ComponentType CT_USHORT = {ComponentType::GL_UNSIGNED_SHORT, 2};
 const ComponentType CT_UINT = {ComponentType::GL_UNSIGNED_INT, 4};
 const ComponentType CT_FLOAT = {ComponentType::GL_FLOAT, 4};
@@ -49,14 +56,24 @@ const ComponentType CT_FLOAT = {ComponentType::GL_FLOAT, 4};
 // Map our low-level data types for glTF output
 struct GLType
 {
-	GLType(const ComponentType& componentType, unsigned int count, const std::string dataType)
-		: componentType(componentType), count(count), dataType(dataType)
+	GLType(
+		const ComponentType& componentType,
+		unsigned int count,
+		const std::string dataType,
+		bool normalized = false,
+		bool padded = false)
+		: componentType(componentType),
+		  count(count),
+		  dataType(dataType),
+		  normalized(normalized),
+		  padded(padded)
 	{
 	}
 
 	unsigned int byteStride() const
 	{
-		return componentType.size * count;
+		const unsigned int size = componentType.size * count;
+		return padded ? (size + 3) & ~3u : size;
 	}
 
 	void write(uint8_t* buf, const float scalar) const
@@ -120,6 +137,10 @@ struct GLType
 	const ComponentType componentType;
 	const uint8_t count;
 	const std::string dataType;
+	// integer components map to [0, 1] or [-1, 1] when read
+	const bool normalized;
+	// each element starts on a 4-byte boundary, as glTF requires of vertex attributes
+	const bool padded;
 };
 
 const GLType GLT_FLOAT = {CT_FLOAT, 1, "SCALAR"};
@@ -134,6 +155,18 @@ const GLType GLT_MAT3F = {CT_USHORT, 9, "MAT3"};
 const GLType GLT_MAT4F = {CT_FLOAT, 16, "MAT4"};
 const GLType GLT_QUATF = {CT_FLOAT, 4, "VEC4"};
 
+// KHR_mesh_quantization vertex attribute types
+const GLType GLT_VEC2US_NORM = {CT_USHORT, 2, "VEC2", true};
+const GLType GLT_VEC3US_NORM = {CT_USHORT, 3, "VEC3", true, true};
+const GLType GLT_VEC3B_NORM = {CT_BYTE, 3, "VEC3", true, true};
+const GLType GLT_VEC3S_NORM = {CT_SHORT, 3, "VEC3", true, true};
+const GLType GLT_VEC4B_NORM = {CT_BYTE, 4, "VEC4", true};
+const GLType GLT_VEC4S_NORM = {CT_SHORT, 4, "VEC4", true};
+
+// normalized animation sampler outputs: morph target weights (rotations use GLT_VEC4S_NORM)
+const GLType GLT_UBYTE_NORM = {CT_UBYTE, 1, "SCALAR", true};
+const GLType GLT_USHORT_NORM = {CT_USHORT, 1, "SCALAR", true};
+
 /**
  * The base of any indexed glTF entity.
  */
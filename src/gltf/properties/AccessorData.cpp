@@ -29,11 +29,26 @@ json AccessorData::serialize() const
 	json result{
 		{"componentType", type.componentType.glType}, {"type", type.dataType}, {"count", count}
 	};
+	if (type.normalized)
+	{
+		result["normalized"] = true;
+	}
 	if (bufferView >= 0)
 	{
 		result["bufferView"] = bufferView;
 		result["byteOffset"] = byteOffset;
 	}
+	if (sparse.count > 0)
+	{
+		result["sparse"] = {
+			{"count", sparse.count},
+			{"indices",
+			 {{"bufferView", sparse.indicesBufferView},
+			  {"byteOffset", 0},
+			  {"componentType", sparse.indicesComponentType}}},
+			{"values", {{"bufferView", sparse.valuesBufferView}, {"byteOffset", 0}}}
+		};
+	}
 	if (!min.empty())
 	{
 		result["min"] = min;
@@ -46,4 +46,13 @@ struct AccessorData : Holdable
 	std::vector<float> min;
 	std::vector<float> max;
 	std::string name;
+
+	// when count > 0, only the listed elements differ from zero; they live in their own views
+	struct
+	{
+		unsigned int count = 0;
+		int indicesBufferView = -1;
+		ComponentType::GL_DataType indicesComponentType = ComponentType::GL_UNSIGNED_SHORT;
+		int valuesBufferView = -1;
+	} sparse;
 };
@@ -13,8 +13,7 @@
 #include "AccessorData.hpp"
 #include "NodeData.hpp"
 
-AnimationData::AnimationData(std::string name, const AccessorData& timeAccessor)
-	: Holdable(), name(std::move(name)), timeAccessor(timeAccessor.ix)
+AnimationData::AnimationData(std::string name) : Holdable(), name(std::move(name))
 {
 }
 
@@ -22,13 +21,15 @@ AnimationData::AnimationData(std::string name, const AccessorData& timeAccessor)
 // glTF can express, but it means we can rely on samplerIx == channelIx throughout an animation
 void AnimationData::AddNodeChannel(
 	const NodeData& node,
+	const AccessorData& timeAccessor,
 	const AccessorData& accessor,
-	std::string path)
+	std::string path,
+	std::string interpolation)
 {
 	assert(channels.size() == samplers.size());
 	uint32_t ix = to_uint32(channels.size());
 	channels.emplace_back(channel_t(ix, node, std::move(path)));
-	samplers.emplace_back(sampler_t(timeAccessor, accessor.ix));
+	samplers.emplace_back(sampler_t(timeAccessor.ix, accessor.ix, std::move(interpolation)));
 }
 
 json AnimationData::serialize() const
@@ -41,7 +42,8 @@ AnimationData::channel_t::channel_t(uint32_t ix, const NodeData& node, std::stri
 {
 }
 
-AnimationData::sampler_t::sampler_t(uint32_t time, uint32_t output) : time(time), output(output)
+AnimationData::sampler_t::sampler_t(uint32_t time, uint32_t output, std::string interpolation)
+	: time(time), output(output), interpolation(std::move(interpolation))
 {
 }
 
@@ -60,7 +62,7 @@ void to_json(json& j, const AnimationData::sampler_t& data)
 {
 	j = json{
 		{"input", data.time},
-		{"interpolation", "LINEAR"},
+		{"interpolation", data.interpolation},
 		{"output", data.output},
 	};
 }
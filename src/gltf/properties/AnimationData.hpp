@@ -12,11 +12,16 @@
 
 struct AnimationData : Holdable
 {
-	AnimationData(std::string name, const AccessorData& timeAccessor);
+	explicit AnimationData(std::string name);
 
 	// assumption: 1-to-1 relationship between channels and samplers; this is a simplification on what
 	// glTF can express, but it means we can rely on samplerIx == channelIx throughout an animation
-	void AddNodeChannel(const NodeData& node, const AccessorData& accessor, std::string path);
+	void AddNodeChannel(
+		const NodeData& node,
+		const AccessorData& timeAccessor,
+		const AccessorData& accessor,
+		std::string path,
+		std::string interpolation = "LINEAR");
 
 	json serialize() const override;
 
@@ -31,14 +36,14 @@ struct AnimationData : Holdable
 
 	struct sampler_t
 	{
-		sampler_t(uint32_t time, uint32_t output);
+		sampler_t(uint32_t time, uint32_t output, std::string interpolation);
 
 		const uint32_t time;
 		const uint32_t output;
+		const std::string interpolation;
 	};
 
 	const std::string name;
-	const uint32_t timeAccessor;
 	std::vector<channel_t> channels;
 	std::vector<sampler_t> samplers;
 };
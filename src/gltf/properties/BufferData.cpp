@@ -11,7 +11,7 @@
 #include "BufferData.hpp"
 
 BufferData::BufferData(const std::shared_ptr<const std::vector<uint8_t>>& binData)
-	: Holdable(), isGlb(true), binData(binData)
+	: Holdable(), isGlb(true), isFallback(false), fallbackByteLength(0), binData(binData)
 {
 }
 
@@ -19,12 +19,28 @@ BufferData::BufferData(
 	std::string uri,
 	const std::shared_ptr<const std::vector<uint8_t>>& binData,
 	bool isEmbedded)
-	: Holdable(), isGlb(false), uri(isEmbedded ? "" : std::move(uri)), binData(binData)
+	: Holdable(),
+	  isGlb(false),
+	  isFallback(false),
+	  fallbackByteLength(0),
+	  uri(isEmbedded ? "" : std::move(uri)),
+	  binData(binData)
+{
+}
+
+BufferData::BufferData(uint32_t fallbackByteLength)
+	: Holdable(), isGlb(false), isFallback(true), fallbackByteLength(fallbackByteLength)
 {
 }
 
 json BufferData::serialize() const
 {
+	if (isFallback)
+	{
+		json result{{"byteLength", fallbackByteLength}};
+		result["extensions"][EXT_MESHOPT_COMPRESSION] = {{"fallback", true}};
+		return result;
+	}
 	json result{{"byteLength", binData->size()}};
 	if (!isGlb)
 	{
@@ -18,9 +18,15 @@ struct BufferData : Holdable {
       const std::shared_ptr<const std::vector<uint8_t>>& binData,
       bool isEmbedded = false);
 
+  // An EXT_meshopt_compression fallback buffer, which only has a size: every view into it is
+  // compressed elsewhere.
+  explicit BufferData(uint32_t fallbackByteLength);
+
   json serialize() const override;
 
   const bool isGlb;
+  const bool isFallback;
+  const uint32_t fallbackByteLength;
   const std::string uri;
   const std::shared_ptr<const std::vector<uint8_t>> binData; // TODO this is just weird
 };
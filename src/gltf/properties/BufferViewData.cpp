@@ -20,6 +20,21 @@ BufferViewData::BufferViewData(
 json BufferViewData::serialize() const
 {
 	json result{{"buffer", buffer}, {"byteLength", byteLength}, {"byteOffset", byteOffset}};
+	if (byteStride > 0)
+	{
+		result["byteStride"] = byteStride;
+	}
+	if (meshopt.encoded)
+	{
+		result["extensions"][EXT_MESHOPT_COMPRESSION] = {
+			{"buffer", meshopt.buffer},
+			{"byteOffset", meshopt.byteOffset},
+			{"byteLength", meshopt.byteLength},
+			{"byteStride", meshopt.byteStride},
+			{"count", meshopt.count},
+			{"mode", (meshopt.mode == MESHOPT_TRIANGLES) ? "TRIANGLES" : "ATTRIBUTES"}
+		};
+	}
 	if (target != GL_ARRAY_NONE)
 	{
 		result["target"] = target;
@@ -20,13 +20,35 @@ struct BufferViewData : Holdable
 		GL_ELEMENT_ARRAY_BUFFER = 34963
 	};
 
+	enum MeshoptMode
+	{
+		MESHOPT_NONE = 0,
+		MESHOPT_ATTRIBUTES,
+		MESHOPT_TRIANGLES
+	};
+
 	BufferViewData(const BufferData& _buffer, const size_t _byteOffset, const GL_ArrayType _target);
 
 	json serialize() const override;
 
-	const unsigned int buffer;
-	const unsigned int byteOffset;
+	// both change when EXT_meshopt_compression moves the view into the fallback buffer
+	unsigned int buffer;
+	unsigned int byteOffset;
 	const GL_ArrayType target;
 
 	unsigned int byteLength = 0;
+	unsigned int byteStride = 0; // only written for padded vertex attributes
+
+	/** How to encode the view with EXT_meshopt_compression, and where the encoded data went. */
+	struct
+	{
+		MeshoptMode mode = MESHOPT_NONE;
+		unsigned int byteStride = 0;
+		unsigned int count = 0;
+
+		bool encoded = false;
+		unsigned int buffer = 0;
+		unsigned int byteOffset = 0;
+		unsigned int byteLength = 0;
+	} meshopt;
 };
@@ -107,6 +107,14 @@ json NodeData::serialize() const
 		{
 			result["extensions"][KHR_LIGHTS_PUNCTUAL]["light"] = light;
 		}
+		if (!lods.empty())
+		{
+			result["extensions"][MSFT_LOD]["ids"] = lods;
+		}
+		if (!instanceAttributes.empty())
+		{
+			result["extensions"][EXT_MESH_GPU_INSTANCING]["attributes"] = instanceAttributes;
+		}
 	}
 
 	for (const auto& i : userProperties)
@@ -33,6 +33,8 @@ struct NodeData : Holdable
 	Quatf rotation;
 	Vec3f scale;
 	std::vector<uint32_t> children;
+	std::vector<uint32_t> lods; // MSFT_lod: nodes with successively coarser versions of the mesh
+	std::map<std::string, uint32_t> instanceAttributes; // EXT_mesh_gpu_instancing accessors
 	int32_t mesh;
 	int32_t camera;
 	int32_t light;
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "KeyframeReducer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace KeyframeReducer
+{
+	/**
+	 * Greedily extends each segment from the last kept keyframe for as long as every keyframe it
+	 * spans stays within tolerance; fits(start, end, ix, t) tests keyframe ix at t in [0, 1]
+	 * between start and end. Keyframes are tested from the end of the segment backwards, where a
+	 * misfit is most likely to show up first.
+	 */
+	template <typename Fits>
+	static std::vector<uint32_t> Reduce(const std::vector<float>& times, const size_t count, const Fits& fits)
+	{
+		std::vector<uint32_t> kept;
+		if (count != times.size() || count <= 2)
+		{
+			for (uint32_t ix = 0; ix < count; ix++)
+			{
+				kept.push_back(ix);
+			}
+			return kept;
+		}
+
+		uint32_t start = 0;
+		kept.push_back(start);
+		for (uint32_t end = 2; end < count; end++)
+		{
+			const float duration = times[end] - times[start];
+			for (uint32_t ix = end - 1; ix > start; ix--)
+			{
+				const float t = (duration > 0.0f) ? (times[ix] - times[start]) / duration : 0.0f;
+				if (!fits(start, end, ix, t))
+				{
+					start = end - 1;
+					kept.push_back(start);
+					break;
+				}
+			}
+		}
+		kept.push_back((uint32_t)count - 1);
+		return kept;
+	}
+
+	Quatf Slerp(const Quatf& a, const Quatf& b, const float t)
+	{
+		float dot = Quatf::DotProduct(a, b);
+		const float sign = (dot < 0.0f) ? -1.0f : 1.0f;
+		dot = std::min(dot * sign, 1.0f);
+
+		float weightA = 1.0f - t;
+		float weightB = t;
+		if (dot < 0.9995f)
+		{
+			const float angle = std::acos(dot);
+			const float sinAngle = std::sin(angle);
+			weightA = std::sin((1.0f - t) * angle) / sinAngle;
+			weightB = std::sin(t * angle) / sinAngle;
+		}
+		weightB *= sign;
+
+		const float s = a.scalar() * weightA + b.scalar() * weightB;
+		const Vec3f v = a.vector() * weightA + b.vector() * weightB;
+		const float length = std::sqrt(s * s + Vec3f::DotProduct(v, v));
+		return (length > 0.0f) ? Quatf(s / length, v / length) : a;
+	}
+
+	// Measured by the chord between the quaternions rather than the acos of their dot product,
+	// which has no precision left for the fraction of a degree that matters here.
+	float AngleBetween(const Quatf& a, const Quatf& b)
+	{
+		const float sign = (Quatf::DotProduct(a, b) < 0.0f) ? -1.0f : 1.0f;
+		const float ds = a.scalar() - b.scalar() * sign;
+		const Vec3f dv = a.vector() - b.vector() * sign;
+		const float chord = std::sqrt(ds * ds + Vec3f::DotProduct(dv, dv));
+		return 4.0f * std::asin(std::min(chord * 0.5f, 1.0f)) * (180.0f / (float)M_PI);
+	}
+
+	std::vector<uint32_t>
+	ReduceTranslations(const std::vector<float>& times, const std::vector<Vec3f>& values, const float tolerance)
+	{
+		const float toleranceSquared = tolerance * tolerance;
+		return Reduce(
+			times,
+			values.size(),
+			[&](const uint32_t start, const uint32_t end, const uint32_t ix, const float t)
+			{
+				const Vec3f error = values[start] + (values[end] - values[start]) * t - values[ix];
+				return Vec3f::DotProduct(error, error) <= toleranceSquared;
+			});
+	}
+
+	std::vector<uint32_t>
+	ReduceRotations(const std::vector<float>& times, const std::vector<Quatf>& values, const float toleranceDegrees)
+	{
+		return Reduce(
+			times,
+			values.size(),
+			[&](const uint32_t start, const uint32_t end, const uint32_t ix, const float t)
+			{
+				return AngleBetween(Slerp(values[start], values[end], t), values[ix]) <= toleranceDegrees;
+			});
+	}
+
+	std::vector<uint32_t>
+	ReduceScales(const std::vector<float>& times, const std::vector<Vec3f>& values, const float tolerance)
+	{
+		return Reduce(
+			times,
+			values.size(),
+			[&](const uint32_t start, const uint32_t end, const uint32_t ix, const float t)
+			{
+				const Vec3f scale = values[start] + (values[end] - values[start]) * t;
+				for (int axis = 0; axis < 3; axis++)
+				{
+					if (std::fabs(scale[axis] - values[ix][axis]) > tolerance * std::fabs(values[ix][axis]))
+					{
+						return false;
+					}
+				}
+				return true;
+			});
+	}
+} // namespace KeyframeReducer
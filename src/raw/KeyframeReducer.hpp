@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "mathfu.hpp"
+
+/**
+ * Keyframe reduction for sampled animation curves, as baked into RawChannel. Each function
+ * returns the indices of the keyframes to keep, in increasing order: interpolating between them
+ * the way glTF LINEAR samplers do reproduces every dropped keyframe within the tolerance. The
+ * first and last keyframes are always kept, so the curve still spans the same time interval.
+ */
+namespace KeyframeReducer
+{
+	// Linear interpolation, off by at most tolerance (in scene units) from any dropped translation.
+	std::vector<uint32_t>
+	ReduceTranslations(const std::vector<float>& times, const std::vector<Vec3f>& values, float tolerance);
+
+	// Spherical linear interpolation, rotated at most toleranceDegrees away from any dropped key.
+	std::vector<uint32_t>
+	ReduceRotations(const std::vector<float>& times, const std::vector<Quatf>& values, float toleranceDegrees);
+
+	// Linear interpolation, where every component is within a ratio of tolerance of the dropped
+	// key, e.g. 0.001 for 0.1%.
+	std::vector<uint32_t>
+	ReduceScales(const std::vector<float>& times, const std::vector<Vec3f>& values, float tolerance);
+
+	// Interpolates rotations the way glTF LINEAR samplers do: spherically, along the shorter arc.
+	Quatf Slerp(const Quatf& a, const Quatf& b, float t);
+
+	// The angle of the rotation from one unit quaternion to the other, in degrees.
+	float AngleBetween(const Quatf& a, const Quatf& b);
+} // namespace KeyframeReducer
@@ -0,0 +1,750 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <unordered_set>
+
+namespace MeshOptimizer
+{
+	// the LRU cache modelled by the Forsyth scoring, and its tuning constants
+	static const int FORSYTH_CACHE_SIZE = 32;
+	static const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+	static const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+	static const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+	static const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+	static const int FORSYTH_MAX_VALENCE = 64; // higher valences score like this one
+
+	struct ForsythScoreTables
+	{
+		float cache[FORSYTH_CACHE_SIZE];
+		float valence[FORSYTH_MAX_VALENCE + 1];
+
+		ForsythScoreTables()
+		{
+			for (int pos = 0; pos < FORSYTH_CACHE_SIZE; pos++)
+			{
+				if (pos < 3)
+				{
+					// the vertices of the last triangle: deliberately not the best score, so the
+					// same triangles are not re-entered over and over
+					cache[pos] = FORSYTH_LAST_TRIANGLE_SCORE;
+				}
+				else
+				{
+					const float scale = 1.0f / (float)(FORSYTH_CACHE_SIZE - 3);
+					cache[pos] = powf(1.0f - (float)(pos - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+				}
+			}
+			valence[0] = 0.0f;
+			for (int count = 1; count <= FORSYTH_MAX_VALENCE; count++)
+			{
+				// favour vertices with few triangles left, to get rid of lone triangles early
+				valence[count] = FORSYTH_VALENCE_BOOST_SCALE * powf((float)count, -FORSYTH_VALENCE_BOOST_POWER);
+			}
+		}
+	};
+
+	static float GetVertexScore(const ForsythScoreTables& tables, const int cachePos, const uint32_t liveTriangles)
+	{
+		if (liveTriangles == 0)
+		{
+			// no triangles left to use this vertex
+			return -1.0f;
+		}
+		const float cacheScore = (cachePos >= 0) ? tables.cache[cachePos] : 0.0f;
+		return cacheScore + tables.valence[std::min<uint32_t>(liveTriangles, FORSYTH_MAX_VALENCE)];
+	}
+
+	// A FIFO post-transform cache: a vertex stays cached until cacheSize other vertices were pushed.
+	class FifoCache
+	{
+	public:
+		FifoCache(const size_t vertexCount, const size_t cacheSize)
+			: pushedAt(vertexCount, 0), pushCount(0), cacheSize(cacheSize)
+		{
+		}
+
+		// Returns the number of cache misses, i.e. vertex shader invocations, for the triangle.
+		int AccessTriangle(const uint32_t* verts)
+		{
+			int misses = 0;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const uint32_t index = verts[corner];
+				if (pushedAt[index] == 0 || pushCount - pushedAt[index] >= cacheSize)
+				{
+					pushedAt[index] = ++pushCount;
+					misses++;
+				}
+			}
+			return misses;
+		}
+
+		void Flush()
+		{
+			pushCount += cacheSize;
+		}
+
+	private:
+		std::vector<size_t> pushedAt; // 0 if never pushed
+		size_t pushCount;
+		const size_t cacheSize;
+	};
+
+	VertexCacheStats AnalyzeVertexCache(
+		const std::vector<uint32_t>& indices,
+		const size_t vertexCount,
+		const size_t cacheSize)
+	{
+		VertexCacheStats stats;
+		stats.triangleCount = indices.size() / 3;
+
+		std::vector<bool> used(vertexCount, false);
+		for (const uint32_t index : indices)
+		{
+			assert(index < vertexCount);
+			if (!used[index])
+			{
+				used[index] = true;
+				stats.vertexCount++;
+			}
+		}
+		FifoCache cache(vertexCount, cacheSize);
+		for (size_t t = 0; t < stats.triangleCount; t++)
+		{
+			stats.transformCount += cache.AccessTriangle(&indices[t * 3]);
+		}
+		return stats;
+	}
+
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, const size_t vertexCount)
+	{
+		static const ForsythScoreTables tables;
+
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount < 2)
+		{
+			return;
+		}
+
+		// vertex -> triangle adjacency; the first liveTriangles[v] entries of a vertex's range are
+		// the triangles not emitted yet
+		std::vector<uint32_t> triangleOffsets(vertexCount + 1, 0);
+		for (const uint32_t index : indices)
+		{
+			assert(index < vertexCount);
+			triangleOffsets[index + 1]++;
+		}
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			triangleOffsets[v + 1] += triangleOffsets[v];
+		}
+		std::vector<uint32_t> liveTriangles(vertexCount);
+		std::vector<uint32_t> adjacency(indices.size());
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			liveTriangles[v] = triangleOffsets[v + 1] - triangleOffsets[v];
+		}
+		{
+			std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				adjacency[cursor[indices[i]]++] = (uint32_t)(i / 3);
+			}
+		}
+
+		std::vector<int> cachePositions(vertexCount, -1);
+		std::vector<float> vertexScores(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			vertexScores[v] = GetVertexScore(tables, -1, liveTriangles[v]);
+		}
+
+		std::vector<bool> emitted(triangleCount, false);
+		int bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			const float score = vertexScores[indices[t * 3 + 0]] + vertexScores[indices[t * 3 + 1]] +
+				vertexScores[indices[t * 3 + 2]];
+			if (score > bestScore)
+			{
+				bestScore = score;
+				bestTriangle = (int)t;
+			}
+		}
+
+		// the cache holds up to three extra entries while a triangle is being added
+		int cache[FORSYTH_CACHE_SIZE + 3];
+		int cacheCount = 0;
+		int newCache[FORSYTH_CACHE_SIZE + 3];
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		size_t nextUnemitted = 0;
+
+		while (output.size() < indices.size())
+		{
+			if (bestTriangle < 0)
+			{
+				// nothing adjacent to the cache is left: continue with the next unemitted triangle
+				while (emitted[nextUnemitted])
+				{
+					nextUnemitted++;
+				}
+				bestTriangle = (int)nextUnemitted;
+			}
+
+			const uint32_t* verts = &indices[(size_t)bestTriangle * 3];
+			emitted[bestTriangle] = true;
+			output.insert(output.end(), verts, verts + 3);
+
+			// retire the triangle from its vertices' live adjacency
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const uint32_t v = verts[corner];
+				uint32_t* begin = &adjacency[triangleOffsets[v]];
+				uint32_t* end = begin + liveTriangles[v];
+				uint32_t* found = std::find(begin, end, (uint32_t)bestTriangle);
+				assert(found != end);
+				std::swap(*found, *(end - 1));
+				liveTriangles[v]--;
+			}
+
+			// the new triangle's vertices move to the front, the rest shift back
+			int newCount = 0;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				// degenerate triangles may repeat a vertex
+				if (std::find(newCache, newCache + newCount, (int)verts[corner]) == newCache + newCount)
+				{
+					newCache[newCount++] = (int)verts[corner];
+				}
+			}
+			for (int i = 0; i < cacheCount; i++)
+			{
+				const int v = cache[i];
+				if (v != (int)verts[0] && v != (int)verts[1] && v != (int)verts[2])
+				{
+					newCache[newCount++] = v;
+				}
+			}
+			for (int i = 0; i < newCount; i++)
+			{
+				const int v = newCache[i];
+				cachePositions[v] = (i < FORSYTH_CACHE_SIZE) ? i : -1;
+				vertexScores[v] = GetVertexScore(tables, cachePositions[v], liveTriangles[v]);
+			}
+
+			// rescore the live triangles around the (previously) cached vertices
+			bestTriangle = -1;
+			bestScore = -1.0f;
+			for (int i = 0; i < newCount; i++)
+			{
+				const int v = newCache[i];
+				const uint32_t* adjacent = &adjacency[triangleOffsets[v]];
+				for (uint32_t k = 0; k < liveTriangles[v]; k++)
+				{
+					const uint32_t t = adjacent[k];
+					const float score = vertexScores[indices[t * 3 + 0]] +
+						vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+					if (score > bestScore)
+					{
+						bestScore = score;
+						bestTriangle = (int)t;
+					}
+				}
+			}
+
+			cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+			std::copy(newCache, newCache + cacheCount, cache);
+		}
+
+		indices.swap(output);
+	}
+
+	void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vec3f>& positions, const float threshold)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount < 2)
+		{
+			return;
+		}
+		const size_t vertexCount = positions.size();
+
+		// hard clusters start wherever the cache misses all three vertices of a triangle
+		std::vector<size_t> hardBoundaries;
+		{
+			FifoCache cache(vertexCount, DEFAULT_FIFO_CACHE_SIZE);
+			for (size_t t = 0; t < triangleCount; t++)
+			{
+				if (cache.AccessTriangle(&indices[t * 3]) == 3 || t == 0)
+				{
+					hardBoundaries.push_back(t);
+				}
+			}
+			hardBoundaries.push_back(triangleCount);
+		}
+
+		// cut each hard cluster further wherever the running ACMR since the last cut is within the
+		// threshold of the whole hard cluster's ACMR
+		std::vector<size_t> clusters;
+		FifoCache cache(vertexCount, DEFAULT_FIFO_CACHE_SIZE);
+		for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+		{
+			const size_t begin = hardBoundaries[h];
+			const size_t end = hardBoundaries[h + 1];
+
+			cache.Flush();
+			size_t hardMisses = 0;
+			for (size_t t = begin; t < end; t++)
+			{
+				hardMisses += cache.AccessTriangle(&indices[t * 3]);
+			}
+			const float limit = threshold * (float)hardMisses / (float)(end - begin);
+
+			cache.Flush();
+			clusters.push_back(begin);
+			size_t softMisses = 0;
+			size_t softStart = begin;
+			for (size_t t = begin; t < end; t++)
+			{
+				softMisses += cache.AccessTriangle(&indices[t * 3]);
+				if (t + 1 < end && (float)softMisses / (float)(t + 1 - softStart) <= limit)
+				{
+					clusters.push_back(t + 1);
+					softStart = t + 1;
+					softMisses = 0;
+					cache.Flush();
+				}
+			}
+		}
+		clusters.push_back(triangleCount);
+		const size_t clusterCount = clusters.size() - 1;
+
+		// area-weighted centroid and normal of every cluster, and of the whole mesh
+		std::vector<Vec3f> clusterCentroids(clusterCount, Vec3f{0.0f});
+		std::vector<Vec3f> clusterNormals(clusterCount, Vec3f{0.0f});
+		Vec3f meshCentroid = Vec3f{0.0f};
+		float meshArea = 0.0f;
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			float clusterArea = 0.0f;
+			for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+			{
+				const Vec3f& p0 = positions[indices[t * 3 + 0]];
+				const Vec3f& p1 = positions[indices[t * 3 + 1]];
+				const Vec3f& p2 = positions[indices[t * 3 + 2]];
+				const Vec3f normal = Vec3f::CrossProduct(p1 - p0, p2 - p0);
+				const float area = normal.Length();
+				clusterCentroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+				clusterNormals[c] += normal;
+				clusterArea += area;
+			}
+			meshCentroid += clusterCentroids[c];
+			meshArea += clusterArea;
+			clusterCentroids[c] = (clusterArea > 0.0f) ? clusterCentroids[c] / clusterArea : positions[indices[clusters[c] * 3]];
+		}
+		if (meshArea > 0.0f)
+		{
+			meshCentroid /= meshArea;
+		}
+
+		// clusters that face away from the centre are likely to occlude the others: draw them first
+		std::vector<float> sortKeys(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			const float length = clusterNormals[c].Length();
+			sortKeys[c] = (length > 0.0f)
+				? Vec3f::DotProduct(clusterCentroids[c] - meshCentroid, clusterNormals[c] / length)
+				: 0.0f;
+		}
+		std::vector<size_t> order(clusterCount);
+		for (size_t c = 0; c < clusterCount; c++)
+		{
+			order[c] = c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](const size_t a, const size_t b) {
+			return sortKeys[a] > sortKeys[b];
+		});
+
+		std::vector<uint32_t> output;
+		output.reserve(indices.size());
+		for (const size_t c : order)
+		{
+			output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+		}
+		indices.swap(output);
+	}
+
+	size_t OptimizeVertexFetch(std::vector<uint32_t>& indices, const size_t vertexCount, std::vector<int>& remap)
+	{
+		remap.assign(vertexCount, -1);
+		size_t nextIndex = 0;
+		for (uint32_t& index : indices)
+		{
+			if (remap[index] < 0)
+			{
+				remap[index] = (int)nextIndex++;
+			}
+			index = (uint32_t)remap[index];
+		}
+		return nextIndex;
+	}
+
+	// how much more an open border resists moving away from itself than a surface does
+	static const double SIMPLIFY_BORDER_WEIGHT = 10.0;
+
+	// Sum of squared distances to a set of weighted planes, as a symmetric 4x4 matrix.
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0;
+		double c = 0;
+		double weight = 0;
+
+		// The plane through p with unit normal n.
+		void AddPlane(const Vec3f& n, const Vec3f& p, const double w)
+		{
+			const double nx = n.x, ny = n.y, nz = n.z;
+			const double d = -(nx * p.x + ny * p.y + nz * p.z);
+			a00 += w * nx * nx;
+			a01 += w * nx * ny;
+			a02 += w * nx * nz;
+			a11 += w * ny * ny;
+			a12 += w * ny * nz;
+			a22 += w * nz * nz;
+			b0 += w * nx * d;
+			b1 += w * ny * d;
+			b2 += w * nz * d;
+			c += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00;
+			a01 += q.a01;
+			a02 += q.a02;
+			a11 += q.a11;
+			a12 += q.a12;
+			a22 += q.a22;
+			b0 += q.b0;
+			b1 += q.b1;
+			b2 += q.b2;
+			c += q.c;
+			weight += q.weight;
+		}
+
+		double Error(const Vec3f& p) const
+		{
+			const double x = p.x, y = p.y, z = p.z;
+			const double e = a00 * x * x + a11 * y * y + a22 * z * z +
+				2 * (a01 * x * y + a02 * x * z + a12 * y * z) + 2 * (b0 * x + b1 * y + b2 * z) + c;
+			return std::max(e, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		uint32_t from;
+		uint32_t to;
+		double cost;
+	};
+
+	static uint64_t EdgeKey(const uint32_t a, const uint32_t b)
+	{
+		return ((uint64_t)a << 32) | b;
+	}
+
+	void Simplify(
+		std::vector<uint32_t>& indices,
+		const std::vector<Vec3f>& positions,
+		const size_t targetIndexCount,
+		const SimplifyConstraints& constraints)
+	{
+		const size_t vertexCount = positions.size();
+		if (indices.size() <= targetIndexCount || vertexCount == 0)
+		{
+			return;
+		}
+
+		// weld by position: wedges[v] is the first vertex with v's position
+		std::vector<uint32_t> wedges(vertexCount);
+		std::vector<bool> locked(vertexCount, false);
+		{
+			std::vector<uint32_t> order(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				order[v] = (uint32_t)v;
+			}
+			const auto less = [&](const uint32_t a, const uint32_t b) {
+				const Vec3f& pa = positions[a];
+				const Vec3f& pb = positions[b];
+				if (pa.x != pb.x)
+					return pa.x < pb.x;
+				if (pa.y != pb.y)
+					return pa.y < pb.y;
+				if (pa.z != pb.z)
+					return pa.z < pb.z;
+				return a < b;
+			};
+			std::sort(order.begin(), order.end(), less);
+			for (size_t i = 0; i < vertexCount; i++)
+			{
+				const bool sameAsPrevious = i > 0 && positions[order[i]] == positions[order[i - 1]];
+				wedges[order[i]] = sameAsPrevious ? wedges[order[i - 1]] : order[i];
+				if (sameAsPrevious)
+				{
+					// a seam: moving one wedge would tear the surface open
+					locked[order[i]] = true;
+					locked[order[i - 1]] = true;
+				}
+			}
+		}
+
+		// directed edges between welded vertices; an edge without its reverse lies on an open
+		// border. Recomputed for every pass, as collapses move the borders.
+		std::unordered_set<uint64_t> edges;
+		std::vector<uint8_t> borderEdgeCount(vertexCount);
+		std::vector<bool> passLocked(vertexCount);
+		const auto classifyEdges = [&]() {
+			edges.clear();
+			std::fill(borderEdgeCount.begin(), borderEdgeCount.end(), 0);
+			passLocked = locked;
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				const size_t next = (i % 3 == 2) ? i - 2 : i + 1;
+				const uint32_t a = wedges[indices[i]];
+				const uint32_t b = wedges[indices[next]];
+				if (!edges.insert(EdgeKey(a, b)).second)
+				{
+					// non-manifold
+					passLocked[a] = passLocked[b] = true;
+				}
+			}
+			for (const uint64_t edge : edges)
+			{
+				const uint32_t a = (uint32_t)(edge >> 32);
+				const uint32_t b = (uint32_t)edge;
+				if (edges.count(EdgeKey(b, a)) == 0)
+				{
+					borderEdgeCount[a] = (uint8_t)std::min(borderEdgeCount[a] + 1, 255);
+					borderEdgeCount[b] = (uint8_t)std::min(borderEdgeCount[b] + 1, 255);
+				}
+			}
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				// only simple borders (one edge in, one out) can slide along themselves
+				if (borderEdgeCount[wedges[v]] > 2)
+				{
+					passLocked[v] = true;
+				}
+			}
+		};
+		const auto isBorderEdge = [&](const uint32_t a, const uint32_t b) {
+			return (edges.count(EdgeKey(a, b)) != 0) != (edges.count(EdgeKey(b, a)) != 0);
+		};
+		classifyEdges();
+
+		std::vector<Quadric> quadrics(vertexCount);
+		for (size_t t = 0; t < indices.size() / 3; t++)
+		{
+			const uint32_t* verts = &indices[t * 3];
+			const Vec3f& p0 = positions[verts[0]];
+			const Vec3f cross = Vec3f::CrossProduct(positions[verts[1]] - p0, positions[verts[2]] - p0);
+			const float length = cross.Length();
+			if (length <= 0.0f)
+			{
+				continue;
+			}
+			const Vec3f normal = cross / length;
+			for (int corner = 0; corner < 3; corner++)
+			{
+				quadrics[wedges[verts[corner]]].AddPlane(normal, p0, 0.5 * length);
+			}
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const uint32_t a = wedges[verts[corner]];
+				const uint32_t b = wedges[verts[(corner + 1) % 3]];
+				if (edges.count(EdgeKey(b, a)) != 0)
+				{
+					continue;
+				}
+				// keep the border in place with a plane through it, perpendicular to the face
+				const Vec3f edge = positions[b] - positions[a];
+				const Vec3f borderNormal = Vec3f::CrossProduct(edge, normal);
+				const float borderLength = borderNormal.Length();
+				if (borderLength > 0.0f)
+				{
+					const double w = SIMPLIFY_BORDER_WEIGHT * edge.LengthSquared();
+					quadrics[a].AddPlane(borderNormal / borderLength, positions[a], w);
+					quadrics[b].AddPlane(borderNormal / borderLength, positions[a], w);
+				}
+			}
+		}
+
+		std::vector<uint32_t> triangleOffsets;
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> candidates;
+		std::vector<bool> touched(vertexCount);
+		std::vector<uint32_t> collapseTo(vertexCount);
+
+		for (bool firstPass = true; indices.size() > targetIndexCount; firstPass = false)
+		{
+			const size_t liveTriangles = indices.size() / 3;
+			if (!firstPass)
+			{
+				classifyEdges();
+			}
+
+			// vertex -> triangle adjacency of the current triangles
+			triangleOffsets.assign(vertexCount + 1, 0);
+			for (const uint32_t index : indices)
+			{
+				triangleOffsets[index + 1]++;
+			}
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				triangleOffsets[v + 1] += triangleOffsets[v];
+			}
+			adjacency.resize(indices.size());
+			{
+				std::vector<uint32_t> cursor(triangleOffsets.begin(), triangleOffsets.end() - 1);
+				for (size_t i = 0; i < indices.size(); i++)
+				{
+					adjacency[cursor[indices[i]]++] = (uint32_t)(i / 3);
+				}
+			}
+
+			candidates.clear();
+			for (size_t t = 0; t < liveTriangles; t++)
+			{
+				for (int corner = 0; corner < 3; corner++)
+				{
+					const uint32_t from = indices[t * 3 + corner];
+					const uint32_t to = indices[t * 3 + (corner + 1) % 3];
+					for (int direction = 0; direction < 2; direction++)
+					{
+						const uint32_t u = direction ? to : from;
+						const uint32_t v = direction ? from : to;
+						if (passLocked[u] || wedges[u] == wedges[v])
+						{
+							continue;
+						}
+						if (borderEdgeCount[u] > 0 && !isBorderEdge(u, wedges[v]))
+						{
+							continue;
+						}
+						if (constraints.canCollapse && !constraints.canCollapse(u, v))
+						{
+							continue;
+						}
+						Quadric q = quadrics[u];
+						q.Add(quadrics[wedges[v]]);
+						double cost = q.Error(positions[v]);
+						if (constraints.collapseError)
+						{
+							cost += q.weight * constraints.collapseError(u, v);
+						}
+						candidates.push_back(Collapse{u, v, cost});
+					}
+				}
+			}
+			std::sort(candidates.begin(), candidates.end(), [](const Collapse& a, const Collapse& b) {
+				return a.cost < b.cost;
+			});
+
+			// greedily apply the cheapest collapses that don't interfere with each other
+			const size_t trianglesToRemove = (indices.size() - targetIndexCount + 2) / 3;
+			size_t removed = 0;
+			size_t collapseCount = 0;
+			std::fill(touched.begin(), touched.end(), false);
+			for (size_t v = 0; v < vertexCount; v++)
+			{
+				collapseTo[v] = (uint32_t)v;
+			}
+			for (const Collapse& collapse : candidates)
+			{
+				if (removed >= trianglesToRemove)
+				{
+					break;
+				}
+				const uint32_t u = collapse.from;
+				const uint32_t v = collapse.to;
+				if (touched[u] || touched[v])
+				{
+					continue;
+				}
+
+				// reject collapses that flip a surviving triangle
+				bool flips = false;
+				size_t collapsing = 0;
+				const Vec3f& target = positions[v];
+				for (uint32_t k = triangleOffsets[u]; k < triangleOffsets[u + 1] && !flips; k++)
+				{
+					const uint32_t* verts = &indices[(size_t)adjacency[k] * 3];
+					const int corner = (verts[0] == u) ? 0 : (verts[1] == u) ? 1 : 2;
+					const uint32_t b = verts[(corner + 1) % 3];
+					const uint32_t c = verts[(corner + 2) % 3];
+					if (wedges[b] == wedges[v] || wedges[c] == wedges[v])
+					{
+						collapsing++;
+						continue;
+					}
+					const Vec3f& pb = positions[b];
+					const Vec3f& pc = positions[c];
+					const Vec3f before = Vec3f::CrossProduct(pb - positions[u], pc - positions[u]);
+					const Vec3f after = Vec3f::CrossProduct(pb - target, pc - target);
+					flips = Vec3f::DotProduct(before, after) <= 0.0f;
+				}
+				if (flips)
+				{
+					continue;
+				}
+
+				collapseTo[u] = v;
+				quadrics[wedges[v]].Add(quadrics[u]);
+				touched[u] = touched[v] = true;
+				for (uint32_t k = triangleOffsets[u]; k < triangleOffsets[u + 1]; k++)
+				{
+					const uint32_t* verts = &indices[(size_t)adjacency[k] * 3];
+					touched[verts[0]] = touched[verts[1]] = touched[verts[2]] = true;
+				}
+				removed += collapsing;
+				collapseCount++;
+			}
+			if (collapseCount == 0)
+			{
+				break;
+			}
+
+			// apply the collapses and drop the triangles that became degenerate
+			size_t kept = 0;
+			for (size_t t = 0; t < liveTriangles; t++)
+			{
+				const uint32_t a = collapseTo[indices[t * 3 + 0]];
+				const uint32_t b = collapseTo[indices[t * 3 + 1]];
+				const uint32_t c = collapseTo[indices[t * 3 + 2]];
+				if (wedges[a] == wedges[b] || wedges[b] == wedges[c] || wedges[c] == wedges[a])
+				{
+					continue;
+				}
+				indices[kept * 3 + 0] = a;
+				indices[kept * 3 + 1] = b;
+				indices[kept * 3 + 2] = c;
+				kept++;
+			}
+			indices.resize(kept * 3);
+		}
+	}
+} // namespace MeshOptimizer
@@ -0,0 +1,99 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "mathfu.hpp"
+
+/**
+ * Index buffer optimizations that work on plain triangle lists, e.g. RawPrimitive::indices.
+ */
+namespace MeshOptimizer
+{
+	// The cache size that AnalyzeVertexCache() simulates by default, typical of current GPUs.
+	static const size_t DEFAULT_FIFO_CACHE_SIZE = 16;
+
+	struct VertexCacheStats
+	{
+		size_t triangleCount = 0;
+		size_t vertexCount = 0;
+		size_t transformCount = 0; // simulated vertex shader invocations
+
+		// average cache miss ratio: transformed vertices per triangle, 0.5 at best and 3 at worst
+		float GetACMR() const
+		{
+			return (triangleCount > 0) ? (float)transformCount / (float)triangleCount : 0.0f;
+		}
+
+		// average transform to vertex ratio: 1 is optimal
+		float GetATVR() const
+		{
+			return (vertexCount > 0) ? (float)transformCount / (float)vertexCount : 0.0f;
+		}
+
+		void Add(const VertexCacheStats& other)
+		{
+			triangleCount += other.triangleCount;
+			vertexCount += other.vertexCount;
+			transformCount += other.transformCount;
+		}
+	};
+
+	// Simulate a FIFO post-transform cache of the given size over the index buffer.
+	VertexCacheStats AnalyzeVertexCache(
+		const std::vector<uint32_t>& indices,
+		size_t vertexCount,
+		size_t cacheSize = DEFAULT_FIFO_CACHE_SIZE);
+
+	// Reorder the triangles of an index buffer for post-transform vertex cache locality, following
+	// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Vertices are not renumbered.
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+	// The default for OptimizeOverdraw(): how much worse than its hard cluster's ACMR a soft
+	// cluster may be. Higher values allow more reordering at the cost of vertex cache efficiency.
+	static const float DEFAULT_OVERDRAW_THRESHOLD = 1.05f;
+
+	// Reorder clusters of a vertex cache optimized index buffer so that outward-facing geometry is
+	// drawn first, which lowers overdraw from any viewpoint (Sander, Nehab & Barczak, "Fast
+	// Triangle Reordering for Vertex Locality and Reduced Overdraw"). The clusters are cut where
+	// the vertex cache restarts, so cache efficiency degrades by at most the given threshold.
+	void OptimizeOverdraw(
+		std::vector<uint32_t>& indices,
+		const std::vector<Vec3f>& positions,
+		float threshold = DEFAULT_OVERDRAW_THRESHOLD);
+
+	// Renumber vertices in the order the index buffer first references them, so vertex fetches
+	// stream linearly through memory. Fills remap with old -> new vertex indices (-1 for vertices
+	// that are never referenced) and returns the number of referenced vertices.
+	size_t OptimizeVertexFetch(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<int>& remap);
+
+	// Per-vertex constraints for Simplify(), beyond what the positions tell it.
+	struct SimplifyConstraints
+	{
+		// Whether vertex `from` may be moved onto vertex `to`, e.g. if their skin weights match.
+		std::function<bool(uint32_t from, uint32_t to)> canCollapse;
+		// Extra squared distance error of moving `from` onto `to`, e.g. for morph target offsets.
+		std::function<float(uint32_t from, uint32_t to)> collapseError;
+	};
+
+	// Reduce a triangle list towards targetIndexCount indices with quadric error metric edge
+	// collapses (Garland & Heckbert), always moving a vertex onto one of its neighbours so no new
+	// vertices are created. Vertices that share their position with another vertex (UV seams,
+	// hard edges) never move, and open borders only collapse along themselves. Stops early when
+	// no collapse is allowed.
+	void Simplify(
+		std::vector<uint32_t>& indices,
+		const std::vector<Vec3f>& positions,
+		size_t targetIndexCount,
+		const SimplifyConstraints& constraints);
+} // namespace MeshOptimizer
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "RawBlendDeltaStore.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+#include "utils/Hash_Utils.hpp"
+
+struct CompareVertex
+{
+	bool operator()(const RawBlendDelta& a, const int vertexIndex) const
+	{
+		return a.vertexIndex < vertexIndex;
+	}
+	bool operator()(const int vertexIndex, const RawBlendDelta& b) const
+	{
+		return vertexIndex < b.vertexIndex;
+	}
+};
+
+static bool CompareVertexChannel(const RawBlendDelta& a, const RawBlendDelta& b)
+{
+	if (a.vertexIndex != b.vertexIndex)
+	{
+		return a.vertexIndex < b.vertexIndex;
+	}
+	return a.channelIndex < b.channelIndex;
+}
+
+uint64_t RawBlendDeltaStore::Fingerprint(const RawBlendDelta* begin, const RawBlendDelta* end)
+{
+	if (begin == end)
+	{
+		return 0;
+	}
+
+	uint64_t seed = 0;
+	for (const RawBlendDelta* delta = begin; delta != end; delta++)
+	{
+		const uint32_t words[] = {
+			(uint32_t)delta->channelIndex,
+			HashUtils::FloatBits(delta->position.x),
+			HashUtils::FloatBits(delta->position.y),
+			HashUtils::FloatBits(delta->position.z),
+			HashUtils::FloatBits(delta->normal.x),
+			HashUtils::FloatBits(delta->normal.y),
+			HashUtils::FloatBits(delta->normal.z),
+			HashUtils::FloatBits(delta->tangent.x),
+			HashUtils::FloatBits(delta->tangent.y),
+			HashUtils::FloatBits(delta->tangent.z),
+			HashUtils::FloatBits(delta->tangent.w),
+		};
+		const size_t wordCount = sizeof(words) / sizeof(words[0]);
+		HashUtils::Combine(seed, HashUtils::HashWords(words, wordCount, 0));
+		HashUtils::Combine(seed, HashUtils::HashWords(words, wordCount, HashUtils::PRIME32_5));
+	}
+	// keep zero reserved for "no deltas"
+	return (seed == 0) ? 1 : seed;
+}
+
+bool RawBlendDeltaStore::SameDeltas(
+	const RawBlendDelta* beginA,
+	const RawBlendDelta* endA,
+	const RawBlendDelta* beginB,
+	const RawBlendDelta* endB)
+{
+	if (endA - beginA != endB - beginB)
+	{
+		return false;
+	}
+	for (; beginA != endA; beginA++, beginB++)
+	{
+		if (beginA->channelIndex != beginB->channelIndex || beginA->position != beginB->position ||
+			beginA->normal != beginB->normal || beginA->tangent != beginB->tangent)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void RawBlendDeltaStore::Clear()
+{
+	std::vector<RawBlendDelta>().swap(deltas);
+}
+
+void RawBlendDeltaStore::Add(const RawBlendDelta& delta)
+{
+	assert(deltas.empty() || !CompareVertexChannel(delta, deltas.back()));
+	deltas.push_back(delta);
+}
+
+std::pair<const RawBlendDelta*, const RawBlendDelta*> RawBlendDeltaStore::GetVertexDeltas(
+	const int vertexIndex) const
+{
+	const auto range = std::equal_range(deltas.begin(), deltas.end(), vertexIndex, CompareVertex());
+	const RawBlendDelta* base = deltas.data();
+	return std::make_pair(base + (range.first - deltas.begin()), base + (range.second - deltas.begin()));
+}
+
+void RawBlendDeltaStore::GroupByChannel(
+	const size_t channelCount,
+	std::vector<uint32_t>& channelOffsets,
+	std::vector<uint32_t>& order) const
+{
+	channelOffsets.assign(channelCount + 1, 0);
+	for (const RawBlendDelta& delta : deltas)
+	{
+		assert(delta.channelIndex >= 0 && (size_t)delta.channelIndex < channelCount);
+		channelOffsets[delta.channelIndex + 1]++;
+	}
+	for (size_t channelIx = 0; channelIx < channelCount; channelIx++)
+	{
+		channelOffsets[channelIx + 1] += channelOffsets[channelIx];
+	}
+
+	std::vector<uint32_t> cursor(channelOffsets.begin(), channelOffsets.end() - 1);
+	order.resize(deltas.size());
+	for (size_t deltaIx = 0; deltaIx < deltas.size(); deltaIx++)
+	{
+		order[cursor[deltas[deltaIx].channelIndex]++] = (uint32_t)deltaIx;
+	}
+}
+
+void RawBlendDeltaStore::Remap(const std::vector<int>& vertexRemap)
+{
+	bool ordered = true;
+	size_t kept = 0;
+	for (const RawBlendDelta& delta : deltas)
+	{
+		const int newIndex = vertexRemap[delta.vertexIndex];
+		if (newIndex < 0)
+		{
+			continue;
+		}
+		RawBlendDelta& out = deltas[kept++];
+		out = delta;
+		out.vertexIndex = newIndex;
+		if (kept > 1 && CompareVertexChannel(out, deltas[kept - 2]))
+		{
+			ordered = false;
+		}
+	}
+	deltas.resize(kept);
+	if (!ordered)
+	{
+		std::stable_sort(deltas.begin(), deltas.end(), CompareVertexChannel);
+	}
+}
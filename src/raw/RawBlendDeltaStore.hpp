@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "mathfu.hpp"
+
+// The morph target offset of a single vertex for a single blend channel.
+struct RawBlendDelta
+{
+	int vertexIndex;
+	int channelIndex; // into RawSurface::blendChannels of the vertex's blend surface
+	Vec3f position{0.0f};
+	Vec3f normal{0.0f};
+	Vec4f tangent{0.0f};
+
+	bool IsZero() const
+	{
+		return position == Vec3f{0.0f} && normal == Vec3f{0.0f} && tangent == Vec4f{0.0f};
+	}
+};
+
+/**
+ * Sparse storage for the morph target deltas of a RawModel.
+ *
+ * Only non-zero deltas are kept, all in one arena sorted by vertex index (and by channel within
+ * a vertex), so memory scales with the number of actual offsets instead of vertices x channels.
+ * Consumers that want to walk a channel at a time use GroupByChannel().
+ */
+class RawBlendDeltaStore
+{
+public:
+	// A 64-bit digest of one vertex's deltas; zero iff there are none. Used as part of the
+	// vertex welding key so that coincident vertices with different offsets stay apart.
+	static uint64_t Fingerprint(const RawBlendDelta* begin, const RawBlendDelta* end);
+	// Whether two vertices have the same deltas, channel by channel; equal fingerprints only say
+	// that they probably do.
+	static bool SameDeltas(
+		const RawBlendDelta* beginA,
+		const RawBlendDelta* endA,
+		const RawBlendDelta* beginB,
+		const RawBlendDelta* endB);
+
+	void Clear();
+
+	size_t Size() const
+	{
+		return deltas.size();
+	}
+
+	const std::vector<RawBlendDelta>& GetDeltas() const
+	{
+		return deltas;
+	}
+
+	// Append the deltas of one vertex; vertices must be added in increasing index order.
+	void Add(const RawBlendDelta& delta);
+
+	// The deltas of a single vertex, ordered by channel.
+	std::pair<const RawBlendDelta*, const RawBlendDelta*> GetVertexDeltas(int vertexIndex) const;
+
+	// Bucket the arena by channel with a counting sort: the deltas of channel c are
+	// deltas[order[channelOffsets[c]]] .. deltas[order[channelOffsets[c + 1] - 1]], in vertex order.
+	void GroupByChannel(
+		size_t channelCount,
+		std::vector<uint32_t>& channelOffsets,
+		std::vector<uint32_t>& order) const;
+
+	// Renumber vertices through an old->new map, dropping deltas of vertices mapped to -1.
+	void Remap(const std::vector<int>& vertexRemap);
+
+	size_t GetMemoryUsage() const
+	{
+		return deltas.capacity() * sizeof(RawBlendDelta);
+	}
+
+private:
+	std::vector<RawBlendDelta> deltas;
+};
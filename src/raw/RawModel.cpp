@@ -9,10 +9,13 @@
 #include "RawModel.hpp"
 
 #include <cmath>
+#include <deque>
+#include <limits>
 #include <map>
-#include <set>
 #include <string>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #if defined(__unix__)
@@ -21,6 +24,9 @@
 
 #include "utils/Image_Utils.hpp"
 #include "utils/String_Utils.hpp"
+#include "utils/Thread_Utils.hpp"
+
+#include "KeyframeReducer.hpp"
 
 bool RawVertex::operator==(const RawVertex& other) const
 {
@@ -28,7 +34,7 @@ bool RawVertex::operator==(const RawVertex& other) const
 		(binormal == other.binormal) && (color == other.color) && (uv0 == other.uv0) &&
 		(uv1 == other.uv1) && (jointIndices == other.jointIndices) &&
 		(jointWeights == other.jointWeights) && (polarityUv0 == other.polarityUv0) &&
-		(blendSurfaceIx == other.blendSurfaceIx) && (blends == other.blends);
+		(blendSurfaceIx == other.blendSurfaceIx) && (blendFingerprint == other.blendFingerprint);
 }
 
 size_t RawVertex::Difference(const RawVertex& other) const
@@ -74,25 +80,74 @@ size_t RawVertex::Difference(const RawVertex& other) const
 	return attributes;
 }
 
-RawModel::RawModel() : vertexAttributes(0)
+RawModel::RawModel() : vertexAttributes(0), vertexTableAttributes(0)
 {
 }
 
 void RawModel::AddVertexAttribute(const RawVertexAttribute attrib)
 {
 	vertexAttributes |= attrib;
+	vertices.SetAttributes(vertexAttributes);
 }
 
 int RawModel::AddVertex(const RawVertex& vertex)
 {
-	auto it = vertexHash.find(vertex);
-	if (it != vertexHash.end())
+	return AddVertex(vertex, std::vector<RawBlendDelta>());
+}
+
+int RawModel::AddVertex(const RawVertex& vertex, const std::vector<RawBlendDelta>& deltas)
+{
+	if (vertexTableAttributes != vertexAttributes || vertexTable.GetCount() != vertices.Size())
 	{
-		return it->second;
+		rebuildVertexTable();
+	}
+
+	const int newIndex = (int)vertices.Size();
+	const int index = vertexTable.FindOrInsert(
+		RawVertexTable::Hash(vertex, vertexAttributes),
+		newIndex,
+		[&](const int candidate) {
+			if (!vertices.Equals(candidate, vertex))
+			{
+				return false;
+			}
+			if (vertex.blendFingerprint == 0)
+			{
+				return true;
+			}
+			// the fingerprints match, but they are only a hash
+			const auto range = blendDeltas.GetVertexDeltas(candidate);
+			return RawBlendDeltaStore::SameDeltas(
+				range.first, range.second, deltas.data(), deltas.data() + deltas.size());
+		});
+	if (index == newIndex)
+	{
+		vertices.PushBack(vertex);
+		for (RawBlendDelta delta : deltas)
+		{
+			delta.vertexIndex = newIndex;
+			blendDeltas.Add(delta);
+		}
+	}
+	return index;
+}
+
+bool RawModel::sameBlendDeltas(const int vertexA, const int vertexB) const
+{
+	const auto rangeA = blendDeltas.GetVertexDeltas(vertexA);
+	const auto rangeB = blendDeltas.GetVertexDeltas(vertexB);
+	return RawBlendDeltaStore::SameDeltas(rangeA.first, rangeA.second, rangeB.first, rangeB.second);
+}
+
+void RawModel::rebuildVertexTable()
+{
+	vertexTable.Clear();
+	vertexTable.Reserve(vertices.Size());
+	for (size_t i = 0; i < vertices.Size(); i++)
+	{
+		vertexTable.Insert(RawVertexTable::Hash(vertices.Get((int)i), vertexAttributes), (int)i);
 	}
-	vertexHash.emplace(vertex, (int)vertices.size());
-	vertices.push_back(vertex);
-	return (int)vertices.size() - 1;
+	vertexTableAttributes = vertexAttributes;
 }
 
 int RawModel::AddTriangle(
@@ -107,6 +162,38 @@ int RawModel::AddTriangle(
 	return (int)triangles.size() - 1;
 }
 
+static std::string GetTextureKey(
+	const RawTextureUsage usage,
+	const std::string& fileLocation,
+	const std::string& name)
+{
+	std::string key = std::to_string((int)usage);
+	key.push_back('\0');
+	key += StringUtils::ToLower(fileLocation);
+	key.push_back('\0');
+	key += StringUtils::ToLower(name);
+	return key;
+}
+
+static uint64_t GetMaterialHash(
+	const std::string& name,
+	const int textures[RAW_TEXTURE_USAGE_MAX],
+	const RawMatProps& materialInfo,
+	const std::vector<std::string>& userProperties)
+{
+	uint64_t seed = std::hash<std::string>{}(name);
+	HashUtils::Combine(seed, materialInfo.Hash());
+	for (int i = 0; i < RAW_TEXTURE_USAGE_MAX; i++)
+	{
+		HashUtils::Combine(seed, (uint64_t)(int64_t)textures[i]);
+	}
+	for (const auto& property : userProperties)
+	{
+		HashUtils::Combine(seed, std::hash<std::string>{}(property));
+	}
+	return seed;
+}
+
 int RawModel::AddTexture(
 	const std::string& name,
 	const std::string& fileName,
@@ -116,15 +203,12 @@ int RawModel::AddTexture(
 	if (name.empty())
 		return -1;
 
-	for (size_t i = 0; i < textures.size(); i++)
+	// we allocate the struct even if the implementing image file is missing
+	const std::string key = GetTextureKey(usage, fileLocation, name);
+	auto it = textureIndexByKey.find(key);
+	if (it != textureIndexByKey.end())
 	{
-		// we allocate the struct even if the implementing image file is missing
-		if (textures[i].usage == usage &&
-			StringUtils::CompareNoCase(textures[i].fileLocation, fileLocation) == 0 &&
-			StringUtils::CompareNoCase(textures[i].name, name) == 0)
-		{
-			return (int)i;
-		}
+		return it->second;
 	}
 
 //	const ImageUtils::ImageProperties properties = ImageUtils::GetImageProperties(
@@ -137,6 +221,7 @@ int RawModel::AddTexture(
 	texture.fileLocation = fileLocation;
 
 	textures.emplace_back(texture);
+	textureIndexByKey.emplace(key, (int)textures.size() - 1);
 
 	return (int)textures.size() - 1;
 }
@@ -158,32 +243,25 @@ int RawModel::AddMaterial(
 	std::shared_ptr<RawMatProps> materialInfo,
 	const std::vector<std::string>& userProperties)
 {
-	for (size_t i = 0; i < materials.size(); i++)
+	const uint64_t hash = GetMaterialHash(name, textures, *materialInfo, userProperties);
+	auto range = materialIndexByHash.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
 	{
-		if (materials[i].name != name)
+		const RawMaterial& candidate = materials[it->second];
+		if (candidate.name != name)
 			continue;
 
-		if (*(materials[i].info) != *materialInfo)
+		if (*(candidate.info) != *materialInfo)
 			continue;
 
 		bool match = true;
 		for (int j = 0; match && j < RAW_TEXTURE_USAGE_MAX; j++)
 		{
-			match = match && (materials[i].textures[j] == textures[j]);
-		}
-
-		if (materials[i].userProperties.size() != userProperties.size())
-		{
-			match = false;
-		}
-		else
-		{
-			for (int j = 0; match && j < userProperties.size(); j++)
-				match = match && (materials[i].userProperties[j] == userProperties[j]);
+			match = match && (candidate.textures[j] == textures[j]);
 		}
 
-		if (match)
-			return (int)i;
+		if (match && candidate.userProperties == userProperties)
+			return it->second;
 	}
 
 	RawMaterial material;
@@ -196,6 +274,7 @@ int RawModel::AddMaterial(
 		material.textures[i] = textures[i];
 
 	materials.emplace_back(material);
+	materialIndexByHash.emplace(hash, (int)materials.size() - 1);
 
 	return (int)materials.size() - 1;
 }
@@ -208,23 +287,30 @@ int RawModel::AddLight(
 	const float innerConeAngle,
 	const float outerConeAngle)
 {
-	for (size_t i = 0; i < lights.size(); i++)
+	auto range = lightIndexByName.equal_range(name);
+	int match = -1;
+	for (auto it = range.first; it != range.second; ++it)
 	{
-		if (lights[i].name != name || lights[i].type != lightType)
+		const RawLight& light = lights[it->second];
+		if (light.type != lightType)
 			continue;
 
 		// only care about cone angles for spot
-		if (lights[i].type == RAW_LIGHT_TYPE_SPOT)
+		if (light.type == RAW_LIGHT_TYPE_SPOT)
 		{
-			if (lights[i].innerConeAngle != innerConeAngle ||
-				lights[i].outerConeAngle != outerConeAngle)
+			if (light.innerConeAngle != innerConeAngle ||
+				light.outerConeAngle != outerConeAngle)
 			{
 				continue;
 			}
 		}
 
-		return (int)i;
+		// prefer the earliest match
+		if (match < 0 || it->second < match)
+			match = it->second;
 	}
+	if (match >= 0)
+		return match;
 
 	RawLight light{
 		name,
@@ -236,18 +322,22 @@ int RawModel::AddLight(
 	};
 
 	lights.push_back(light);
+	lightIndexByName.emplace(light.name, (int)lights.size() - 1);
 	return (int)lights.size() - 1;
 }
 
 int RawModel::AddSurface(const RawSurface& surface)
 {
-	for (size_t i = 0; i < surfaces.size(); i++)
+	const std::string foldedName = StringUtils::ToLower(surface.name);
+	auto it = surfaceIndexByName.find(foldedName);
+	if (it != surfaceIndexByName.end())
 	{
-		if (StringUtils::CompareNoCase(surfaces[i].name, surface.name) == 0)
-			return (int)i;
+		return it->second;
 	}
 
 	surfaces.emplace_back(surface);
+	surfaceIndexByName.emplace(foldedName, (int)surfaces.size() - 1);
+	surfaceIndexById.emplace(surface.id, (int)surfaces.size() - 1);
 	return (int)(surfaces.size() - 1);
 }
 
@@ -255,10 +345,10 @@ int RawModel::AddSurface(const char* name, const uint64_t surfaceId)
 {
 	assert(name[0] != '\0');
 
-	for (size_t i = 0; i < surfaces.size(); i++)
+	auto it = surfaceIndexById.find(surfaceId);
+	if (it != surfaceIndexById.end())
 	{
-		if (surfaces[i].id == surfaceId)
-			return (int)i;
+		return it->second;
 	}
 
 	RawSurface surface;
@@ -268,6 +358,8 @@ int RawModel::AddSurface(const char* name, const uint64_t surfaceId)
 	surface.discrete = false;
 
 	surfaces.emplace_back(surface);
+	surfaceIndexByName.emplace(StringUtils::ToLower(surface.name), (int)surfaces.size() - 1);
+	surfaceIndexById.emplace(surfaceId, (int)surfaces.size() - 1);
 	return (int)(surfaces.size() - 1);
 }
 
@@ -279,15 +371,14 @@ int RawModel::AddAnimation(const RawAnimation& animation)
 
 int RawModel::AddNode(const RawNode& node)
 {
-	for (size_t i = 0; i < nodes.size(); i++)
+	auto it = nodeIndexById.find(node.id);
+	if (it != nodeIndexById.end())
 	{
-		if (nodes[i].id == node.id)
-		{
-			return (int)i;
-		}
+		return it->second;
 	}
 
 	nodes.emplace_back(node);
+	nodeIndexById.emplace(node.id, (int)nodes.size() - 1);
 	return (int)nodes.size() - 1;
 }
 
@@ -337,10 +428,10 @@ int RawModel::AddNode(const uint64_t id, const char* name, const uint64_t parent
 {
 	assert(name[0] != '\0');
 
-	for (size_t i = 0; i < nodes.size(); i++)
+	auto it = nodeIndexById.find(id);
+	if (it != nodeIndexById.end())
 	{
-		if (nodes[i].id == id)
-			return (int)i;
+		return it->second;
 	}
 
 	RawNode joint;
@@ -355,91 +446,166 @@ int RawModel::AddNode(const uint64_t id, const char* name, const uint64_t parent
 	joint.scale = Vec3f(1, 1, 1);
 
 	nodes.emplace_back(joint);
+	nodeIndexById.emplace(id, (int)nodes.size() - 1);
 	return (int)nodes.size() - 1;
 }
 
-void RawModel::Condense()
+// Turn a usage mask into an old->new index map that preserves relative order; returns the
+// number of surviving entries.
+static int BuildRemap(const std::vector<bool>& used, std::vector<int>& remap)
+{
+	int count = 0;
+	remap.resize(used.size());
+	for (size_t i = 0; i < used.size(); i++)
+	{
+		remap[i] = used[i] ? count++ : -1;
+	}
+	return count;
+}
+
+// Move surviving entries down to their new slots and drop the rest. Every surviving entry
+// moves to an index no greater than its old one, so a single forward sweep suffices.
+template <typename T>
+static void CompactInPlace(std::vector<T>& items, const std::vector<int>& remap, const int count)
 {
-	// Only keep surfaces that are referenced by one or more triangles.
+	for (size_t i = 0; i < items.size(); i++)
 	{
-		std::vector<RawSurface> oldSurfaces = surfaces;
+		if (remap[i] >= 0 && remap[i] != (int)i)
+		{
+			items[remap[i]] = std::move(items[i]);
+		}
+	}
+	items.erase(items.begin() + count, items.end());
+}
 
-		surfaces.clear();
+void RawModel::Condense()
+{
+	std::vector<bool> usedSurfaces(surfaces.size(), false);
+	std::vector<bool> usedMaterials(materials.size(), false);
+	std::vector<bool> usedVertices(vertices.Size(), false);
+	for (const auto& triangle : triangles)
+	{
+		usedSurfaces[triangle.surfaceIndex] = true;
+		usedMaterials[triangle.materialIndex] = true;
+		for (const int vert : triangle.verts)
+		{
+			usedVertices[vert] = true;
+		}
+	}
 
-		std::set<uint64_t> survivingSurfaceIds;
-		for (auto& triangle : triangles)
+	// Only keep textures that are referenced by one or more surviving materials.
+	std::vector<bool> usedTextures(textures.size(), false);
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		if (!usedMaterials[i])
+			continue;
+		for (int j = 0; j < RAW_TEXTURE_USAGE_MAX; j++)
 		{
-			const RawSurface& surface = oldSurfaces[triangle.surfaceIndex];
-			const int surfaceIndex = AddSurface(surface.name.c_str(), surface.id);
-			surfaces[surfaceIndex] = surface;
-			triangle.surfaceIndex = surfaceIndex;
-			survivingSurfaceIds.emplace(surface.id);
+			if (materials[i].textures[j] >= 0)
+				usedTextures[materials[i].textures[j]] = true;
 		}
+	}
 
-		// clear out references to meshes that no longer exist
+	std::vector<int> surfaceRemap, materialRemap, textureRemap, vertexRemap;
+	const int surfaceCount = BuildRemap(usedSurfaces, surfaceRemap);
+	const int materialCount = BuildRemap(usedMaterials, materialRemap);
+	const int textureCount = BuildRemap(usedTextures, textureRemap);
+	const int vertexCount = BuildRemap(usedVertices, vertexRemap);
+
+	// clear out references to meshes that no longer exist
+	if (surfaceCount < (int)surfaces.size())
+	{
+		std::unordered_set<uint64_t> survivingSurfaceIds;
+		for (size_t i = 0; i < surfaces.size(); i++)
+		{
+			if (usedSurfaces[i])
+				survivingSurfaceIds.insert(surfaces[i].id);
+		}
 		for (auto& node : nodes)
 		{
-			if (node.surfaceId != 0 &&
-				survivingSurfaceIds.find(node.surfaceId) == survivingSurfaceIds.end())
+			if (node.surfaceId != 0 && survivingSurfaceIds.count(node.surfaceId) == 0)
 			{
 				node.surfaceId = 0;
 			}
 		}
 	}
 
-	// Only keep materials that are referenced by one or more triangles.
+	CompactInPlace(surfaces, surfaceRemap, surfaceCount);
+	CompactInPlace(materials, materialRemap, materialCount);
+	CompactInPlace(textures, textureRemap, textureCount);
+	for (auto& material : materials)
 	{
-		std::vector<RawMaterial> oldMaterials = materials;
-
-		materials.clear();
+		for (int j = 0; j < RAW_TEXTURE_USAGE_MAX; j++)
+		{
+			if (material.textures[j] >= 0)
+				material.textures[j] = textureRemap[material.textures[j]];
+		}
+	}
 
-		for (auto& triangle : triangles)
+	for (auto& triangle : triangles)
+	{
+		triangle.surfaceIndex = surfaceRemap[triangle.surfaceIndex];
+		triangle.materialIndex = materialRemap[triangle.materialIndex];
+		for (int& vert : triangle.verts)
 		{
-			const RawMaterial& material = oldMaterials[triangle.materialIndex];
-			const int materialIndex = AddMaterial(material);
-			materials[materialIndex] = material;
-			triangle.materialIndex = materialIndex;
+			vert = vertexRemap[vert];
 		}
 	}
 
-	// Only keep textures that are referenced by one or more materials.
+	// Vertices stay unique under compaction, so there is nothing to re-weld; the welding table
+	// is simply dropped and rebuilt by the next AddVertex(), if any.
+	if (vertexCount < (int)vertices.Size())
 	{
-		std::vector<RawTexture> oldTextures = textures;
+		vertices.Compact(vertexRemap, vertexCount);
+		blendDeltas.Remap(vertexRemap);
+		vertexTable.Release();
+	}
+	vertices.RemapBlendSurfaces(surfaceRemap);
 
-		textures.clear();
+	rebuildIndexes();
+}
 
-		for (auto& material : materials)
-		{
-			for (int j = 0; j < RAW_TEXTURE_USAGE_MAX; j++)
-			{
-				if (material.textures[j] >= 0)
-				{
-					const RawTexture& texture = oldTextures[material.textures[j]];
-					const int textureIndex =
-						AddTexture(texture.name, texture.fileName, texture.fileLocation, texture.usage);
-					textures[textureIndex] = texture;
-					material.textures[j] = textureIndex;
-				}
-			}
-		}
+void RawModel::rebuildIndexes()
+{
+	textureIndexByKey.clear();
+	for (size_t i = 0; i < textures.size(); i++)
+	{
+		const RawTexture& texture = textures[i];
+		textureIndexByKey.emplace(
+			GetTextureKey(texture.usage, texture.fileLocation, texture.name), (int)i);
+	}
+
+	materialIndexByHash.clear();
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		const RawMaterial& material = materials[i];
+		materialIndexByHash.emplace(
+			GetMaterialHash(material.name, material.textures, *material.info, material.userProperties),
+			(int)i);
 	}
 
-	// Only keep vertices that are referenced by one or more triangles.
+	lightIndexByName.clear();
+	for (size_t i = 0; i < lights.size(); i++)
 	{
-		std::vector<RawVertex> oldVertices = vertices;
+		lightIndexByName.emplace(lights[i].name, (int)i);
+	}
 
-		vertexHash.clear();
-		vertices.clear();
+	surfaceIndexById.clear();
+	surfaceIndexByName.clear();
+	for (size_t i = 0; i < surfaces.size(); i++)
+	{
+		surfaceIndexById.emplace(surfaces[i].id, (int)i);
+		surfaceIndexByName.emplace(StringUtils::ToLower(surfaces[i].name), (int)i);
+	}
 
-		for (auto& triangle : triangles)
-		{
-			for (int& vert : triangle.verts)
-				vert = AddVertex(oldVertices[vert]);
-		}
+	nodeIndexById.clear();
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		nodeIndexById.emplace(nodes[i].id, (int)i);
 	}
 }
 
-void RawModel::TransformGeometry(ComputeNormalsOption normals)
+void RawModel::TransformGeometry(ComputeNormalsOption normals, ComputeTangentsOption tangents)
 {
 	switch (normals)
 	{
@@ -453,8 +619,9 @@ void RawModel::TransformGeometry(ComputeNormalsOption normals)
 		// otherwise fall through
 	case ComputeNormalsOption::BROKEN:
 	case ComputeNormalsOption::ALWAYS:
+		// allocates a zero-filled normal column if there wasn't one yet
+		AddVertexAttribute(RAW_VERTEX_ATTRIBUTE_NORMAL);
 		size_t computedNormalsCount = this->CalculateNormals(normals == ComputeNormalsOption::BROKEN);
-		vertexAttributes |= RAW_VERTEX_ATTRIBUTE_NORMAL;
 
 		if (verboseOutput)
 		{
@@ -472,311 +639,1541 @@ void RawModel::TransformGeometry(ComputeNormalsOption normals)
 		}
 		break;
 	}
-}
 
-void RawModel::TransformTextures(const std::vector<std::function<Vec2f(Vec2f)>>& transforms)
-{
-	for (auto& vertice : vertices)
+	if (tangents != ComputeTangentsOption::NEVER)
 	{
-		if ((vertexAttributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0)
+		if ((vertexAttributes & RAW_VERTEX_ATTRIBUTE_NORMAL) == 0 ||
+			(vertexAttributes & RAW_VERTEX_ATTRIBUTE_UV0) == 0)
 		{
-			for (const auto& fun : transforms)
+			if (verboseOutput)
 			{
-				vertice.uv0 = fun(vertice.uv0);
+				fmt::printf("Warning: cannot compute tangents without normals and UV0.\n");
 			}
+			return;
 		}
-		if ((vertexAttributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0)
+		size_t computedTangentsCount =
+			this->CalculateTangents(tangents == ComputeTangentsOption::MISSING);
+		if (verboseOutput && computedTangentsCount > 0)
 		{
-			for (const auto& fun : transforms)
-			{
-				vertice.uv1 = fun(vertice.uv1);
-			}
+			fmt::printf("Computed %lu tangents.\n", computedTangentsCount);
 		}
 	}
 }
 
-struct TriangleModelSortPos
+void RawModel::TransformTextures(const std::vector<std::function<Vec2f(Vec2f)>>& transforms)
 {
-	static bool Compare(const RawTriangle& a, const RawTriangle& b)
+	for (auto& uv : vertices.uv0s)
 	{
-		if (a.materialIndex != b.materialIndex)
+		for (const auto& fun : transforms)
 		{
-			return a.materialIndex < b.materialIndex;
+			uv = fun(uv);
 		}
-		if (a.surfaceIndex != b.surfaceIndex)
+	}
+	for (auto& uv : vertices.uv1s)
+	{
+		for (const auto& fun : transforms)
 		{
-			return a.surfaceIndex < b.surfaceIndex;
+			uv = fun(uv);
 		}
-		return a.verts[0] < b.verts[0];
 	}
-};
+}
 
-struct TriangleModelSortNeg
+// The attributes a primitive of the given material keeps, before intersecting with the model's.
+static int GetKeepAttributes(const int keepAttribs, const RawMaterial& material)
 {
-	static bool Compare(const RawTriangle& a, const RawTriangle& b)
+	if (keepAttribs == -1)
 	{
-		if (a.materialIndex != b.materialIndex)
-			return a.materialIndex < b.materialIndex;
-
-		if (a.surfaceIndex != b.surfaceIndex)
-			return a.surfaceIndex < b.surfaceIndex;
-
-		return a.verts[0] > b.verts[0];
+		return -1;
 	}
-};
-
-void RawModel::CreateMaterialModels(
-	std::vector<RawModel>& materialModels,
-	bool shortIndices,
-	const int keepAttribs,
-	const bool forceDiscrete) const
-{
-	// Sort all triangles based on material first, then surface, then first vertex index.
-	std::vector<RawTriangle> sortedTriangles;
-
-	sortedTriangles = triangles;
-	std::sort(sortedTriangles.begin(), sortedTriangles.end(), TriangleModelSortPos::Compare);
-
-	// Overestimate the number of models that will be created to avoid massive reallocation.
-	int discreteCount = 0;
-	for (const auto& surface : surfaces)
-		discreteCount += surface.discrete ? 1 : 0;
-
-	materialModels.clear();
-	materialModels.reserve(materials.size() + discreteCount);
-
-	const RawVertex defaultVertex;
-
-	// Create a separate model for each material.
-	RawModel* model;
-	for (size_t i = 0; i < sortedTriangles.size(); i++)
+	int keep = keepAttribs;
+	if ((keepAttribs & RAW_VERTEX_ATTRIBUTE_POSITION) != 0)
 	{
-		if (sortedTriangles[i].materialIndex < 0 || sortedTriangles[i].surfaceIndex < 0)
-			continue;
+		keep |= RAW_VERTEX_ATTRIBUTE_JOINT_INDICES | RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS;
+	}
+	if ((keepAttribs & RAW_VERTEX_ATTRIBUTE_AUTO) != 0)
+	{
+		keep |= RAW_VERTEX_ATTRIBUTE_POSITION;
 
-		if (i == 0 || (shortIndices && model->GetVertexCount() >= 0xFFFE) ||
-			sortedTriangles[i].materialIndex != sortedTriangles[i - 1].materialIndex ||
-			(sortedTriangles[i].surfaceIndex != sortedTriangles[i - 1].surfaceIndex &&
-				(forceDiscrete || surfaces[sortedTriangles[i].surfaceIndex].discrete ||
-					surfaces[sortedTriangles[i - 1].surfaceIndex].discrete)))
+		if (material.textures[RAW_TEXTURE_USAGE_DIFFUSE] != -1)
 		{
-			materialModels.resize(materialModels.size() + 1);
-			model = &materialModels[materialModels.size() - 1];
+			keep |= RAW_VERTEX_ATTRIBUTE_UV0;
 		}
-
-		// FIXME: will have to unlink from the nodes, transform both surfaces into a
-		// common space, and reparent to a new node with appropriate transform.
-
-		const int prevSurfaceCount = model->GetSurfaceCount();
-		const int materialIndex = model->AddMaterial(materials[sortedTriangles[i].materialIndex]);
-		const int surfaceIndex = model->AddSurface(surfaces[sortedTriangles[i].surfaceIndex]);
-		RawSurface& rawSurface = model->GetSurface(surfaceIndex);
-
-		if (model->GetSurfaceCount() > prevSurfaceCount)
+		if (material.textures[RAW_TEXTURE_USAGE_NORMAL] != -1)
 		{
-			const std::vector<uint64_t>& jointIds = surfaces[sortedTriangles[i].surfaceIndex].jointIds;
-			for (const auto& jointId : jointIds)
-			{
-				const int nodeIndex = GetNodeById(jointId);
-				assert(nodeIndex != -1);
-				model->AddNode(GetNode(nodeIndex));
-			}
-			rawSurface.bounds.Clear();
+			keep |= RAW_VERTEX_ATTRIBUTE_NORMAL | RAW_VERTEX_ATTRIBUTE_TANGENT |
+				RAW_VERTEX_ATTRIBUTE_BINORMAL | RAW_VERTEX_ATTRIBUTE_UV0;
 		}
-
-		int verts[3];
-		for (int j = 0; j < 3; j++)
+		if (material.textures[RAW_TEXTURE_USAGE_BUMP] != -1)
 		{
-			RawVertex vertex = vertices[sortedTriangles[i].verts[j]];
-
-			if (keepAttribs != -1)
-			{
-				int keep = keepAttribs;
-				if ((keepAttribs & RAW_VERTEX_ATTRIBUTE_POSITION) != 0)
-				{
-					keep |= RAW_VERTEX_ATTRIBUTE_JOINT_INDICES | RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS;
-				}
-				if ((keepAttribs & RAW_VERTEX_ATTRIBUTE_AUTO) != 0)
-				{
-					keep |= RAW_VERTEX_ATTRIBUTE_POSITION;
-
-					const RawMaterial& mat = model->GetMaterial(materialIndex);
-					if (mat.textures[RAW_TEXTURE_USAGE_DIFFUSE] != -1)
-					{
-						keep |= RAW_VERTEX_ATTRIBUTE_UV0;
-					}
-					if (mat.textures[RAW_TEXTURE_USAGE_NORMAL] != -1)
-					{
-						keep |= RAW_VERTEX_ATTRIBUTE_NORMAL | RAW_VERTEX_ATTRIBUTE_TANGENT |
-							RAW_VERTEX_ATTRIBUTE_BINORMAL | RAW_VERTEX_ATTRIBUTE_UV0;
-					}
-					if (mat.textures[RAW_TEXTURE_USAGE_BUMP] != -1)
-					{
-						keep |= RAW_VERTEX_ATTRIBUTE_UV0;
-					}
-					if (mat.textures[RAW_TEXTURE_USAGE_SPECULAR] != -1)
-					{
-						keep |= RAW_VERTEX_ATTRIBUTE_NORMAL | RAW_VERTEX_ATTRIBUTE_UV0;
-					}
-					if (mat.textures[RAW_TEXTURE_USAGE_EMISSIVE] != -1)
-					{
-						keep |= RAW_VERTEX_ATTRIBUTE_UV1;
-					}
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_POSITION) == 0)
-				{
-					vertex.position = defaultVertex.position;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_NORMAL) == 0)
-				{
-					vertex.normal = defaultVertex.normal;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_TANGENT) == 0)
-				{
-					vertex.tangent = defaultVertex.tangent;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_BINORMAL) == 0)
-				{
-					vertex.binormal = defaultVertex.binormal;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_COLOR) == 0)
-				{
-					vertex.color = defaultVertex.color;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_UV0) == 0)
-				{
-					vertex.uv0 = defaultVertex.uv0;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_UV1) == 0)
-				{
-					vertex.uv1 = defaultVertex.uv1;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) == 0)
-				{
-					vertex.jointIndices = defaultVertex.jointIndices;
-				}
-				if ((keep & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) == 0)
-				{
-					vertex.jointWeights = defaultVertex.jointWeights;
-				}
-			}
-
-			verts[j] = model->AddVertex(vertex);
-			model->vertexAttributes |= vertex.Difference(defaultVertex);
-
-			rawSurface.bounds.AddPoint(vertex.position);
+			keep |= RAW_VERTEX_ATTRIBUTE_UV0;
+		}
+		if (material.textures[RAW_TEXTURE_USAGE_SPECULAR] != -1)
+		{
+			keep |= RAW_VERTEX_ATTRIBUTE_NORMAL | RAW_VERTEX_ATTRIBUTE_UV0;
+		}
+		if (material.textures[RAW_TEXTURE_USAGE_EMISSIVE] != -1)
+		{
+			keep |= RAW_VERTEX_ATTRIBUTE_UV1;
 		}
-
-		model->AddTriangle(verts[0], verts[1], verts[2], materialIndex, surfaceIndex);
 	}
+	return keep;
 }
 
-int RawModel::GetNodeById(const uint64_t nodeId) const
+// Reset the attributes outside the keep mask to their defaults.
+static void StripVertex(RawVertex& vertex, const int keep)
 {
-	for (size_t i = 0; i < nodes.size(); i++)
-	{
-		if (nodes[i].id == nodeId)
-		{
-			return (int)i;
-		}
-	}
-	return -1;
+	const RawVertex defaultVertex;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_POSITION) == 0)
+		vertex.position = defaultVertex.position;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_NORMAL) == 0)
+		vertex.normal = defaultVertex.normal;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_TANGENT) == 0)
+		vertex.tangent = defaultVertex.tangent;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_BINORMAL) == 0)
+		vertex.binormal = defaultVertex.binormal;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_COLOR) == 0)
+		vertex.color = defaultVertex.color;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_UV0) == 0)
+		vertex.uv0 = defaultVertex.uv0;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_UV1) == 0)
+		vertex.uv1 = defaultVertex.uv1;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) == 0)
+		vertex.jointIndices = defaultVertex.jointIndices;
+	if ((keep & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) == 0)
+		vertex.jointWeights = defaultVertex.jointWeights;
 }
 
-int RawModel::GetSurfaceById(const uint64_t surfaceId) const
+template <typename T>
+static bool AnyNonDefault(const std::vector<T>& column, const std::vector<int>& subset, const T& value)
 {
-	for (size_t i = 0; i < surfaces.size(); i++)
+	if (column.empty())
+	{
+		return false;
+	}
+	for (const int vertexIndex : subset)
 	{
-		if (surfaces[i].id == surfaceId)
+		if (column[vertexIndex] != value)
 		{
-			return (int)i;
+			return true;
 		}
 	}
-	return -1;
+	return false;
 }
 
-Vec3f RawModel::getFaceNormal(int verts[3]) const
+// Stable counting sort of triangle indices by key; keys must lie in [0, keyCount).
+template <typename KeyFn>
+static void CountingSort(std::vector<int>& items, const size_t keyCount, const KeyFn& key)
 {
-	const float l0 = (vertices[verts[1]].position - vertices[verts[0]].position).LengthSquared();
-	const float l1 = (vertices[verts[2]].position - vertices[verts[1]].position).LengthSquared();
-	const float l2 = (vertices[verts[0]].position - vertices[verts[2]].position).LengthSquared();
-	const int index = (l0 > l1) ? (l0 > l2 ? 2 : 1) : (l1 > l2 ? 0 : 1);
-
-	const Vec3f e0 = vertices[verts[(index + 1) % 3]].position - vertices[verts[index]].position;
-	const Vec3f e1 = vertices[verts[(index + 2) % 3]].position - vertices[verts[index]].position;
-	if (e0.LengthSquared() < FLT_MIN || e1.LengthSquared() < FLT_MIN)
+	std::vector<size_t> offsets(keyCount + 1, 0);
+	for (const int item : items)
 	{
-		return Vec3f{0.0f};
+		offsets[key(item) + 1]++;
 	}
-	auto result = Vec3f::CrossProduct(e0, e1);
-	auto resultLengthSquared = result.LengthSquared();
-	if (resultLengthSquared < FLT_MIN)
+	for (size_t k = 0; k < keyCount; k++)
 	{
-		return Vec3f{0.0f};
+		offsets[k + 1] += offsets[k];
+	}
+	std::vector<int> sorted(items.size());
+	for (const int item : items)
+	{
+		sorted[offsets[key(item)]++] = item;
 	}
-	float edgeDot = std::max(-1.0f, std::min(1.0f, Vec3f::DotProduct(e0, e1)));
-	float angle = acos(edgeDot);
-	float area = resultLengthSquared / 2.0f;
-	return result.Normalized() * angle * area;
+	items.swap(sorted);
 }
 
-size_t RawModel::CalculateNormals(bool onlyBroken)
+// Spread the low 10 bits of v so that there are two zero bits between each of them.
+static uint32_t SpreadMortonBits(uint32_t v)
+{
+	v &= 0x3FF;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+/**
+ * Reorder the triangles of a bucket into clusters of at most maxVertices distinct vertices, and
+ * return the offsets at which the second and later clusters start (nothing, if it all fits).
+ * uniqueVerts are the bucket's distinct model vertices, sorted.
+ *
+ * Each cluster grows from a seed across shared vertices, always taking the candidate triangle that
+ * adds the fewest new vertices, breadth-first among equals; this keeps clusters compact and their
+ * shared boundary short, which is what splitting duplicates. Seeds, and the jumps to unconnected
+ * pieces, are taken in Morton order of the triangle centroids, so those stay spatially coherent.
+ */
+static std::vector<size_t> ClusterTriangles(
+	const std::vector<RawTriangle>& triangles,
+	const std::vector<Vec3f>& positions,
+	int* bucketTriangles,
+	const size_t triangleCount,
+	const std::vector<int>& uniqueVerts,
+	const size_t maxVertices)
 {
-	Vec3f averagePos = Vec3f{0.0f};
-	std::set<int> brokenVerts;
-	for (int vertIx = 0; vertIx < vertices.size(); vertIx++)
+	if (uniqueVerts.size() <= maxVertices)
 	{
-		RawVertex& vertex = vertices[vertIx];
-		averagePos += (vertex.position / (float)vertices.size());
-		if (onlyBroken && (vertex.normal.LengthSquared() >= FLT_MIN))
+		return std::vector<size_t>();
+	}
+	// number the distinct vertices of the bucket
+	std::vector<int> cornerVerts(triangleCount * 3);
+	for (size_t triIx = 0; triIx < triangleCount; triIx++)
+	{
+		for (int corner = 0; corner < 3; corner++)
 		{
-			continue;
+			const int vertIx = triangles[bucketTriangles[triIx]].verts[corner];
+			cornerVerts[triIx * 3 + corner] =
+				(int)(std::lower_bound(uniqueVerts.begin(), uniqueVerts.end(), vertIx) - uniqueVerts.begin());
 		}
-		vertex.normal = Vec3f{0.0f};
-		if (onlyBroken)
+	}
+	const size_t vertexCount = uniqueVerts.size();
+
+	// vertex -> adjacent triangles, as CSR
+	std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (const int vertIx : cornerVerts)
+	{
+		adjacencyOffsets[vertIx + 1]++;
+	}
+	for (size_t vertIx = 0; vertIx < vertexCount; vertIx++)
+	{
+		adjacencyOffsets[vertIx + 1] += adjacencyOffsets[vertIx];
+	}
+	std::vector<uint32_t> adjacency(cornerVerts.size());
+	{
+		std::vector<uint32_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t cornerIx = 0; cornerIx < cornerVerts.size(); cornerIx++)
 		{
-			brokenVerts.emplace(vertIx);
+			adjacency[cursor[cornerVerts[cornerIx]]++] = (uint32_t)(cornerIx / 3);
 		}
 	}
 
-	for (auto& triangle : triangles)
+	// seed order: the Morton codes of the triangle centroids within the bucket's bounds
+	std::vector<Vec3f> centroids(triangleCount);
+	Boundsf centroidBounds;
+	for (size_t triIx = 0; triIx < triangleCount; triIx++)
+	{
+		centroids[triIx] = (positions[uniqueVerts[cornerVerts[triIx * 3 + 0]]] +
+			positions[uniqueVerts[cornerVerts[triIx * 3 + 1]]] +
+			positions[uniqueVerts[cornerVerts[triIx * 3 + 2]]]) * (1.0f / 3.0f);
+		centroidBounds.AddPoint(centroids[triIx]);
+	}
+	const Vec3f extent = centroidBounds.max - centroidBounds.min;
+	std::vector<std::pair<uint32_t, uint32_t>> seedOrder(triangleCount);
+	for (size_t triIx = 0; triIx < triangleCount; triIx++)
 	{
-		bool relevant = false;
-		for (int vertIx : triangle.verts)
+		uint32_t code = 0;
+		for (int axis = 0; axis < 3; axis++)
 		{
-			relevant |= (brokenVerts.count(vertIx) > 0);
+			const float t = (extent[axis] > 0.0f)
+				? (centroids[triIx][axis] - centroidBounds.min[axis]) / extent[axis]
+				: 0.0f;
+			code |= SpreadMortonBits((uint32_t)(t * 1023.0f)) << axis;
 		}
-		if (!relevant)
+		seedOrder[triIx] = std::make_pair(code, (uint32_t)triIx);
+	}
+	std::sort(seedOrder.begin(), seedOrder.end());
+
+	// the cluster a vertex was last taken into, and whether a triangle is spoken for
+	std::vector<uint32_t> vertexCluster(vertexCount, UINT32_MAX);
+	std::vector<bool> assigned(triangleCount, false);
+	uint32_t cluster = 0;
+	size_t clusterVertices = 0;
+	const auto newVertices = [&](const uint32_t triIx) {
+		int count = 0;
+		for (int corner = 0; corner < 3; corner++)
 		{
-			continue;
+			count += (vertexCluster[cornerVerts[triIx * 3 + corner]] != cluster) ? 1 : 0;
 		}
-		Vec3f faceNormal = this->getFaceNormal(triangle.verts);
-		for (int vertIx : triangle.verts)
+		return count;
+	};
+
+	// candidates by how many new vertices they add; entries go stale as that number drops, and
+	// are skipped when popped
+	std::deque<uint32_t> candidates[3];
+	std::vector<int> order;
+	order.reserve(triangleCount);
+	std::vector<size_t> clusterStarts;
+	size_t seedCursor = 0;
+
+	while (order.size() < triangleCount)
+	{
+		int next = -1;
+		bool full = false;
+		for (int level = 0; level < 3 && next < 0 && !full; level++)
 		{
-			if (!onlyBroken || brokenVerts.count(vertIx) > 0)
+			std::deque<uint32_t>& queue = candidates[level];
+			while (!queue.empty())
 			{
-				vertices[vertIx].normal += faceNormal;
+				const uint32_t triIx = queue.front();
+				if (assigned[triIx] || newVertices(triIx) < level)
+				{
+					queue.pop_front();
+					continue;
+				}
+				if (clusterVertices + level > maxVertices)
+				{
+					full = true;
+					break;
+				}
+				next = (int)triIx;
+				queue.pop_front();
+				break;
 			}
 		}
-	}
-
-	for (int vertIx = 0; vertIx < vertices.size(); vertIx++)
-	{
-		if (onlyBroken && brokenVerts.count(vertIx) == 0)
+		if (next < 0 && !full)
+		{
+			// nothing connected is left; continue with the next piece in space
+			while (assigned[seedOrder[seedCursor].second])
+			{
+				seedCursor++;
+			}
+			if (clusterVertices + 3 > maxVertices)
+			{
+				full = true;
+			}
+			else
+			{
+				next = (int)seedOrder[seedCursor].second;
+			}
+		}
+		if (full)
 		{
+			cluster++;
+			clusterVertices = 0;
+			for (auto& queue : candidates)
+			{
+				queue.clear();
+			}
+			clusterStarts.push_back(order.size());
 			continue;
 		}
-		RawVertex& vertex = vertices[vertIx];
-		if (vertex.normal.LengthSquared() < FLT_MIN)
+
+		assigned[next] = true;
+		order.push_back(bucketTriangles[next]);
+		for (int corner = 0; corner < 3; corner++)
 		{
-			vertex.normal = vertex.position - averagePos;
-			if (vertex.normal.LengthSquared() < FLT_MIN)
+			const int vertIx = cornerVerts[next * 3 + corner];
+			if (vertexCluster[vertIx] == cluster)
 			{
-				vertex.normal = Vec3f{0.0f, 1.0f, 0.0f};
 				continue;
 			}
+			vertexCluster[vertIx] = cluster;
+			clusterVertices++;
+			for (uint32_t ix = adjacencyOffsets[vertIx]; ix < adjacencyOffsets[vertIx + 1]; ix++)
+			{
+				const uint32_t neighbour = adjacency[ix];
+				if (!assigned[neighbour])
+				{
+					candidates[newVertices(neighbour)].push_back(neighbour);
+				}
+			}
+		}
+	}
+
+	std::copy(order.begin(), order.end(), bucketTriangles);
+	return clusterStarts;
+}
+
+void RawModel::CreateMaterialModels(
+	std::vector<RawPrimitive>& primitives,
+	const bool shortIndices,
+	const int keepAttribs) const
+{
+	// Bucket the triangles by (material, surface) with two stable counting sorts, which keeps
+	// the original triangle order within each bucket.
+	std::vector<int> sortedTriangles;
+	sortedTriangles.reserve(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		if (triangles[i].materialIndex >= 0 && triangles[i].surfaceIndex >= 0)
+		{
+			sortedTriangles.push_back((int)i);
+		}
+	}
+	CountingSort(sortedTriangles, surfaces.size(), [&](const int triIx) {
+		return triangles[triIx].surfaceIndex;
+	});
+	CountingSort(sortedTriangles, materials.size(), [&](const int triIx) {
+		return triangles[triIx].materialIndex;
+	});
+
+	std::vector<size_t> bucketStarts;
+	for (size_t i = 0; i < sortedTriangles.size(); i++)
+	{
+		const RawTriangle& triangle = triangles[sortedTriangles[i]];
+		if (i == 0 || triangle.materialIndex != triangles[sortedTriangles[i - 1]].materialIndex ||
+			triangle.surfaceIndex != triangles[sortedTriangles[i - 1]].surfaceIndex)
+		{
+			bucketStarts.push_back(i);
+		}
+	}
+	bucketStarts.push_back(sortedTriangles.size());
+	const size_t bucketCount = bucketStarts.size() - 1;
+
+	// the keep mask only depends on the material
+	std::vector<int> keepMasks(materials.size());
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		keepMasks[i] = GetKeepAttributes(keepAttribs, materials[i]) & vertexAttributes;
+	}
+
+	const RawVertex defaultVertex;
+	const size_t maxVertices = shortIndices ? 0xFFFE : std::numeric_limits<int>::max();
+
+	std::vector<std::vector<RawPrimitive>> bucketPrimitives(bucketCount);
+	ThreadUtils::ParallelFor(bucketCount, [&](const size_t bucketIx) {
+		const RawTriangle& first = triangles[sortedTriangles[bucketStarts[bucketIx]]];
+		const int keep = keepMasks[first.materialIndex];
+		// dropping stored attributes may make distinct model vertices identical
+		const bool weld = (vertexAttributes & ~keep) != 0;
+
+		// the distinct model vertices of the bucket, sorted, so that the model vertex -> local
+		// vertex map of the primitive under construction only needs a slot per bucket vertex; the
+		// touched slots are reset to -1 when a primitive is finished
+		const size_t bucketStart = bucketStarts[bucketIx];
+		std::vector<int> bucketVerts;
+		bucketVerts.reserve((bucketStarts[bucketIx + 1] - bucketStart) * 3);
+		for (size_t i = bucketStart; i < bucketStarts[bucketIx + 1]; i++)
+		{
+			const RawTriangle& triangle = triangles[sortedTriangles[i]];
+			bucketVerts.insert(bucketVerts.end(), triangle.verts, triangle.verts + 3);
+		}
+		std::sort(bucketVerts.begin(), bucketVerts.end());
+		bucketVerts.erase(std::unique(bucketVerts.begin(), bucketVerts.end()), bucketVerts.end());
+		std::vector<int> localIndices(bucketVerts.size(), -1);
+		std::vector<int> touched;
+		RawVertexTable weldTable;
+
+		// with short indices, a bucket with too many vertices is cut along coherent clusters
+		std::vector<size_t> clusterStarts;
+		if (shortIndices)
+		{
+			clusterStarts = ClusterTriangles(
+				triangles,
+				vertices.positions,
+				&sortedTriangles[bucketStart],
+				bucketStarts[bucketIx + 1] - bucketStart,
+				bucketVerts,
+				maxVertices);
+		}
+		size_t nextCluster = 0;
+
+		std::vector<RawPrimitive>& out = bucketPrimitives[bucketIx];
+		RawPrimitive* primitive = nullptr;
+
+		const auto finish = [&]() {
+			RawPrimitive& prim = *primitive;
+			for (const int slot : touched)
+			{
+				localIndices[slot] = -1;
+			}
+			touched.clear();
+			weldTable.Clear();
+
+			int attributes = 0;
+			if (AnyNonDefault(vertices.positions, prim.vertices, defaultVertex.position))
+				attributes |= RAW_VERTEX_ATTRIBUTE_POSITION;
+			if (AnyNonDefault(vertices.normals, prim.vertices, defaultVertex.normal))
+				attributes |= RAW_VERTEX_ATTRIBUTE_NORMAL;
+			if (AnyNonDefault(vertices.tangents, prim.vertices, defaultVertex.tangent))
+				attributes |= RAW_VERTEX_ATTRIBUTE_TANGENT;
+			if (AnyNonDefault(vertices.binormals, prim.vertices, defaultVertex.binormal))
+				attributes |= RAW_VERTEX_ATTRIBUTE_BINORMAL;
+			if (AnyNonDefault(vertices.colors, prim.vertices, defaultVertex.color))
+				attributes |= RAW_VERTEX_ATTRIBUTE_COLOR;
+			if (AnyNonDefault(vertices.uv0s, prim.vertices, defaultVertex.uv0))
+				attributes |= RAW_VERTEX_ATTRIBUTE_UV0;
+			if (AnyNonDefault(vertices.uv1s, prim.vertices, defaultVertex.uv1))
+				attributes |= RAW_VERTEX_ATTRIBUTE_UV1;
+			// Always need both or neither.
+			if (AnyNonDefault(vertices.jointIndices, prim.vertices, defaultVertex.jointIndices) ||
+				AnyNonDefault(vertices.jointWeights, prim.vertices, defaultVertex.jointWeights))
+				attributes |= RAW_VERTEX_ATTRIBUTE_JOINT_INDICES | RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS;
+			prim.vertexAttributes = attributes & keep;
+
+			prim.bounds.Clear();
+			for (const int vertexIndex : prim.vertices)
+			{
+				prim.bounds.AddPoint(
+					((keep & RAW_VERTEX_ATTRIBUTE_POSITION) != 0) ? vertices.positions[vertexIndex]
+					                                              : defaultVertex.position);
+			}
+
+			if (!vertices.blendFingerprints.empty())
+			{
+				for (size_t localIx = 0; localIx < prim.vertices.size(); localIx++)
+				{
+					const auto range = blendDeltas.GetVertexDeltas(prim.vertices[localIx]);
+					for (const RawBlendDelta* delta = range.first; delta != range.second; delta++)
+					{
+						RawBlendDelta localDelta = *delta;
+						localDelta.vertexIndex = (int)localIx;
+						prim.blendDeltas.Add(localDelta);
+					}
+				}
+			}
+		};
+
+		for (size_t i = bucketStart; i < bucketStarts[bucketIx + 1]; i++)
+		{
+			const RawTriangle& triangle = triangles[sortedTriangles[i]];
+
+			// a bucket, or each of its clusters, has at most maxVertices distinct model vertices, and
+			// welding only merges them, so the cluster starts are the only cuts needed
+			bool split = primitive == nullptr;
+			if (nextCluster < clusterStarts.size() && i - bucketStart == clusterStarts[nextCluster])
+			{
+				split = true;
+				nextCluster++;
+			}
+			if (split)
+			{
+				if (primitive != nullptr)
+				{
+					finish();
+				}
+				out.emplace_back();
+				primitive = &out.back();
+				primitive->materialIndex = triangle.materialIndex;
+				primitive->surfaceIndex = triangle.surfaceIndex;
+			}
+
+			for (const int vertexIndex : triangle.verts)
+			{
+				const int slot =
+					(int)(std::lower_bound(bucketVerts.begin(), bucketVerts.end(), vertexIndex) - bucketVerts.begin());
+				int& localIndex = localIndices[slot];
+				if (localIndex < 0)
+				{
+					const int newIndex = (int)primitive->vertices.size();
+					if (weld)
+					{
+						RawVertex vertex = vertices.Get(vertexIndex);
+						StripVertex(vertex, keep);
+						localIndex = weldTable.FindOrInsert(
+							RawVertexTable::Hash(vertex, keep), newIndex, [&](const int candidate) {
+								const int otherIndex = primitive->vertices[candidate];
+								RawVertex other = vertices.Get(otherIndex);
+								StripVertex(other, keep);
+								return other == vertex &&
+									(vertex.blendFingerprint == 0 || sameBlendDeltas(otherIndex, vertexIndex));
+							});
+					}
+					else
+					{
+						localIndex = newIndex;
+					}
+					if (localIndex == newIndex)
+					{
+						primitive->vertices.push_back(vertexIndex);
+					}
+					touched.push_back(slot);
+				}
+				primitive->indices.push_back((uint32_t)localIndex);
+			}
+		}
+		if (primitive != nullptr)
+		{
+			finish();
+		}
+	});
+
+	primitives.clear();
+	for (auto& bucket : bucketPrimitives)
+	{
+		for (auto& primitive : bucket)
+		{
+			primitives.emplace_back(std::move(primitive));
+		}
+	}
+}
+
+// The size of one vertex with the given attributes, as written out uncompressed.
+static size_t GetVertexByteSize(const int attributes)
+{
+	size_t size = 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_POSITION) != 0) ? sizeof(Vec3f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0) ? sizeof(Vec3f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0) ? sizeof(Vec4f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_BINORMAL) != 0) ? sizeof(Vec3f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_COLOR) != 0) ? sizeof(Vec4f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0) ? sizeof(Vec2f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0) ? sizeof(Vec2f) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0) ? sizeof(Vec4i) : 0;
+	size += ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0) ? sizeof(Vec4f) : 0;
+	return size;
+}
+
+RawDedupStats RawModel::DeduplicateSurfaces(const bool allowTranslation)
+{
+	RawDedupStats stats;
+
+	// the triangles of each surface, in their original order
+	std::vector<int> sortedTriangles(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		sortedTriangles[i] = (int)i;
+	}
+	CountingSort(sortedTriangles, surfaces.size(), [&](const int triIx) {
+		return triangles[triIx].surfaceIndex;
+	});
+	std::vector<size_t> surfaceStarts(surfaces.size() + 1, 0);
+	for (const RawTriangle& triangle : triangles)
+	{
+		surfaceStarts[triangle.surfaceIndex + 1]++;
+	}
+	for (size_t surfaceIx = 0; surfaceIx < surfaces.size(); surfaceIx++)
+	{
+		surfaceStarts[surfaceIx + 1] += surfaceStarts[surfaceIx];
+	}
+
+	// Positions are compared relative to the minimum corner of their surface when translations
+	// are allowed, on a grid of 2^-20 of its extent rounded up to a power of two; copies that
+	// were moved by baking a transform into them rarely agree down to the last bit otherwise.
+	std::vector<Vec3f> origins(surfaces.size(), Vec3f{0.0f});
+	std::vector<float> gridSteps(surfaces.size(), 0.0f);
+	const auto normalizedVertex = [&](const int surfaceIx, const int vertexIndex) {
+		RawVertex vertex = vertices.Get(vertexIndex);
+		if (allowTranslation)
+		{
+			for (int axis = 0; axis < 3; axis++)
+			{
+				vertex.position[axis] =
+					std::round((vertex.position[axis] - origins[surfaceIx][axis]) / gridSteps[surfaceIx]);
+			}
+		}
+		return vertex;
+	};
+
+	std::vector<uint64_t> fingerprints(surfaces.size(), 0);
+	ThreadUtils::ParallelFor(surfaces.size(), [&](const size_t surfaceIx) {
+		const RawSurface& surface = surfaces[surfaceIx];
+		const size_t begin = surfaceStarts[surfaceIx];
+		const size_t end = surfaceStarts[surfaceIx + 1];
+		if (begin == end || !surface.jointIds.empty() || !surface.blendChannels.empty())
+		{
+			return;
+		}
+		if (allowTranslation)
+		{
+			Boundsf bounds;
+			for (size_t i = begin; i < end; i++)
+			{
+				for (const int vertexIndex : triangles[sortedTriangles[i]].verts)
+				{
+					bounds.AddPoint(vertices.positions[vertexIndex]);
+				}
+			}
+			const Vec3f extent = bounds.max - bounds.min;
+			const float maxExtent = std::max(extent[0], std::max(extent[1], extent[2]));
+			origins[surfaceIx] = bounds.min;
+			gridSteps[surfaceIx] = (maxExtent > 0.0f)
+				? std::ldexp(1.0f, (int)std::ceil(std::log2(maxExtent)) - 20)
+				: 1.0f;
+		}
+		uint64_t fingerprint = end - begin;
+		for (size_t i = begin; i < end; i++)
+		{
+			const RawTriangle& triangle = triangles[sortedTriangles[i]];
+			HashUtils::Combine(fingerprint, (uint64_t)triangle.materialIndex);
+			for (const int vertexIndex : triangle.verts)
+			{
+				HashUtils::Combine(
+					fingerprint,
+					RawVertexTable::Hash(normalizedVertex((int)surfaceIx, vertexIndex), vertexAttributes));
+			}
+		}
+		// zero is reserved for surfaces that are never merged
+		fingerprints[surfaceIx] = (fingerprint != 0) ? fingerprint : 1;
+	});
+
+	const auto sameGeometry = [&](const int surfaceA, const int surfaceB) {
+		const size_t countA = surfaceStarts[surfaceA + 1] - surfaceStarts[surfaceA];
+		if (countA != surfaceStarts[surfaceB + 1] - surfaceStarts[surfaceB])
+		{
+			return false;
+		}
+		for (size_t i = 0; i < countA; i++)
+		{
+			const RawTriangle& a = triangles[sortedTriangles[surfaceStarts[surfaceA] + i]];
+			const RawTriangle& b = triangles[sortedTriangles[surfaceStarts[surfaceB] + i]];
+			if (a.materialIndex != b.materialIndex)
+			{
+				return false;
+			}
+			for (int corner = 0; corner < 3; corner++)
+			{
+				const bool sameIndex = !allowTranslation && a.verts[corner] == b.verts[corner];
+				if (!sameIndex &&
+					!(normalizedVertex(surfaceA, a.verts[corner]) ==
+					  normalizedVertex(surfaceB, b.verts[corner])))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	// moving a surface means moving the nodes that hold it, which must not carry anything else
+	std::vector<bool> movableNodes(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		movableNodes[i] = !nodes[i].isJoint && nodes[i].childIds.empty() && nodes[i].lightIx < 0;
+	}
+	for (const RawAnimation& animation : animations)
+	{
+		for (const RawChannel& channel : animation.channels)
+		{
+			movableNodes[channel.nodeIndex] = false;
+		}
+	}
+	for (const RawCamera& camera : cameras)
+	{
+		const int nodeIx = GetNodeById(camera.nodeId);
+		if (nodeIx >= 0)
+		{
+			movableNodes[nodeIx] = false;
+		}
+	}
+	std::unordered_map<uint64_t, std::vector<int>> nodesBySurfaceId;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		if (nodes[i].surfaceId != 0)
+		{
+			nodesBySurfaceId[nodes[i].surfaceId].push_back((int)i);
+		}
+	}
+
+	// each surface is compared with the distinct geometries seen so far under its fingerprint
+	std::unordered_map<uint64_t, std::vector<int>> originalsByFingerprint;
+	std::vector<bool> mergedSurfaces(surfaces.size(), false);
+	for (size_t surfaceIx = 0; surfaceIx < surfaces.size(); surfaceIx++)
+	{
+		if (fingerprints[surfaceIx] == 0)
+		{
+			continue;
+		}
+		std::vector<int>& originals = originalsByFingerprint[fingerprints[surfaceIx]];
+		int original = -1;
+		for (const int candidate : originals)
+		{
+			if (sameGeometry(candidate, (int)surfaceIx))
+			{
+				original = candidate;
+				break;
+			}
+		}
+
+		const Vec3f offset = origins[surfaceIx] - ((original >= 0) ? origins[original] : Vec3f{0.0f});
+		const auto& holders = nodesBySurfaceId[surfaces[surfaceIx].id];
+		if (original >= 0 && offset != Vec3f{0.0f} &&
+			std::any_of(holders.begin(), holders.end(), [&](const int nodeIx) { return !movableNodes[nodeIx]; }))
+		{
+			original = -1;
+		}
+		if (original < 0)
+		{
+			originals.push_back((int)surfaceIx);
+			continue;
+		}
+
+		// T * R * S * (p + offset) = (T + R * (S * offset)) * R * S * p
+		for (const int nodeIx : holders)
+		{
+			RawNode& node = nodes[nodeIx];
+			node.surfaceId = surfaces[original].id;
+			node.translation += node.rotation * (node.scale * offset);
+		}
+		mergedSurfaces[surfaceIx] = true;
+		stats.mergedSurfaces++;
+	}
+	if (stats.mergedSurfaces == 0)
+	{
+		return stats;
+	}
+
+	const size_t triangleCount = triangles.size();
+	const int vertexCount = GetVertexCount();
+	triangles.erase(
+		std::remove_if(
+			triangles.begin(),
+			triangles.end(),
+			[&](const RawTriangle& triangle) { return mergedSurfaces[triangle.surfaceIndex]; }),
+		triangles.end());
+	Condense();
+
+	stats.droppedTriangles = (int)(triangleCount - triangles.size());
+	stats.droppedVertices = vertexCount - GetVertexCount();
+	stats.droppedBytes = stats.droppedVertices * GetVertexByteSize(vertexAttributes) +
+		stats.droppedTriangles * 3 * sizeof(uint32_t);
+	return stats;
+}
+
+// keep only the selected keyframes of a property, and their times, which may be sourceTimes itself
+template <typename T>
+static void SelectKeyframes(
+	std::vector<T>& values,
+	std::vector<float>& times,
+	const std::vector<float>& sourceTimes,
+	const std::vector<uint32_t>& kept)
+{
+	if (kept.size() == values.size())
+	{
+		return;
+	}
+	std::vector<T> keptValues(kept.size());
+	std::vector<float> keptTimes(kept.size());
+	for (size_t ix = 0; ix < kept.size(); ix++)
+	{
+		keptValues[ix] = values[kept[ix]];
+		keptTimes[ix] = sourceTimes[kept[ix]];
+	}
+	values.swap(keptValues);
+	times.swap(keptTimes);
+}
+
+// the keyframes and bytes of an animation's translations, rotations and scales as they'd be written
+static void CountKeyframes(const RawAnimation& animation, size_t& keyframes, size_t& bytes)
+{
+	bool usesAnimationTimes = false;
+	for (const RawChannel& channel : animation.channels)
+	{
+		keyframes += channel.translations.size() + channel.rotations.size() + channel.scales.size();
+		bytes += channel.translations.size() * sizeof(Vec3f) + channel.rotations.size() * sizeof(Quatf) +
+			channel.scales.size() * sizeof(Vec3f);
+		bytes += (channel.translationTimes.size() + channel.rotationTimes.size() + channel.scaleTimes.size()) *
+			sizeof(float);
+		usesAnimationTimes |= !channel.weights.empty() ||
+			(!channel.translations.empty() && channel.translationTimes.empty()) ||
+			(!channel.rotations.empty() && channel.rotationTimes.empty()) ||
+			(!channel.scales.empty() && channel.scaleTimes.empty());
+	}
+	if (usesAnimationTimes)
+	{
+		bytes += animation.times.size() * sizeof(float);
+	}
+}
+
+RawKeyframeStats RawModel::ReduceKeyframes(
+	const float translationTolerance,
+	const float rotationToleranceDegrees,
+	const float scaleTolerance)
+{
+	RawKeyframeStats stats;
+	std::vector<std::pair<size_t, size_t>> channelIxs;
+	for (size_t animIx = 0; animIx < animations.size(); animIx++)
+	{
+		CountKeyframes(animations[animIx], stats.keyframesBefore, stats.bytesBefore);
+		for (size_t channelIx = 0; channelIx < animations[animIx].channels.size(); channelIx++)
+		{
+			channelIxs.emplace_back(animIx, channelIx);
+		}
+	}
+
+	ThreadUtils::ParallelFor(channelIxs.size(), [&](const size_t ix) {
+		const RawAnimation& animation = animations[channelIxs[ix].first];
+		RawChannel& channel = animations[channelIxs[ix].first].channels[channelIxs[ix].second];
+		// properties sampled off the animation's frames have times of their own; STEP and
+		// CUBICSPLINE keys read from the source are left as they are
+		if (channel.translationInterpolation == RAW_INTERPOLATION_LINEAR)
+		{
+			const std::vector<float>& times =
+				channel.translationTimes.empty() ? animation.times : channel.translationTimes;
+			SelectKeyframes(
+				channel.translations,
+				channel.translationTimes,
+				times,
+				KeyframeReducer::ReduceTranslations(times, channel.translations, translationTolerance));
+		}
+		if (channel.rotationInterpolation == RAW_INTERPOLATION_LINEAR)
+		{
+			const std::vector<float>& times = channel.rotationTimes.empty() ? animation.times : channel.rotationTimes;
+			SelectKeyframes(
+				channel.rotations,
+				channel.rotationTimes,
+				times,
+				KeyframeReducer::ReduceRotations(times, channel.rotations, rotationToleranceDegrees));
+		}
+		if (channel.scaleInterpolation == RAW_INTERPOLATION_LINEAR)
+		{
+			const std::vector<float>& times = channel.scaleTimes.empty() ? animation.times : channel.scaleTimes;
+			SelectKeyframes(
+				channel.scales,
+				channel.scaleTimes,
+				times,
+				KeyframeReducer::ReduceScales(times, channel.scales, scaleTolerance));
+		}
+	});
+
+	for (const RawAnimation& animation : animations)
+	{
+		CountKeyframes(animation, stats.keyframesAfter, stats.bytesAfter);
+	}
+	return stats;
+}
+
+int RawModel::GetNodeById(const uint64_t nodeId) const
+{
+	auto it = nodeIndexById.find(nodeId);
+	return (it != nodeIndexById.end()) ? it->second : -1;
+}
+
+int RawModel::GetSurfaceById(const uint64_t surfaceId) const
+{
+	auto it = surfaceIndexById.find(surfaceId);
+	return (it != surfaceIndexById.end()) ? it->second : -1;
+}
+
+// Build the vertex -> triangle corner adjacency (CSR) of the vertices selected by the predicate:
+// the corners (3 * triangle + corner) of vertex v are corners[offsets[v]] .. corners[offsets[v + 1] - 1],
+// in triangle order, which keeps sums over them deterministic.
+template <typename VertexPredicate>
+static void BuildCornerAdjacency(
+	const std::vector<RawTriangle>& triangles,
+	const size_t vertexCount,
+	const VertexPredicate& selected,
+	std::vector<uint32_t>& offsets,
+	std::vector<uint32_t>& corners)
+{
+	offsets.assign(vertexCount + 1, 0);
+	for (const RawTriangle& triangle : triangles)
+	{
+		for (const int vertIx : triangle.verts)
+		{
+			if (selected(vertIx))
+			{
+				offsets[vertIx + 1]++;
+			}
+		}
+	}
+	for (size_t vertIx = 0; vertIx < vertexCount; vertIx++)
+	{
+		offsets[vertIx + 1] += offsets[vertIx];
+	}
+	corners.resize(offsets[vertexCount]);
+	std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+	for (size_t triIx = 0; triIx < triangles.size(); triIx++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const int vertIx = triangles[triIx].verts[corner];
+			if (selected(vertIx))
+			{
+				corners[cursor[vertIx]++] = (uint32_t)(triIx * 3 + corner);
+			}
+		}
+	}
+}
+
+// Area-weighted face normal: unit normal scaled by the triangle's area, or zero if degenerate.
+static Vec3f GetFaceNormal(const std::vector<Vec3f>& positions, const int verts[3])
+{
+	const Vec3f e0 = positions[verts[1]] - positions[verts[0]];
+	const Vec3f e1 = positions[verts[2]] - positions[verts[0]];
+	if (e0.LengthSquared() < FLT_MIN || e1.LengthSquared() < FLT_MIN)
+	{
+		return Vec3f{0.0f};
+	}
+	const Vec3f cross = Vec3f::CrossProduct(e0, e1);
+	if (cross.LengthSquared() < FLT_MIN)
+	{
+		return Vec3f{0.0f};
+	}
+	return cross * 0.5f;
+}
+
+// The interior angle of a triangle at the given corner.
+static float GetCornerAngle(const std::vector<Vec3f>& positions, const int verts[3], const int corner)
+{
+	const Vec3f& p = positions[verts[corner]];
+	const Vec3f e0 = positions[verts[(corner + 1) % 3]] - p;
+	const Vec3f e1 = positions[verts[(corner + 2) % 3]] - p;
+	return atan2f(Vec3f::CrossProduct(e0, e1).Length(), Vec3f::DotProduct(e0, e1));
+}
+
+size_t RawModel::CalculateNormals(bool onlyBroken)
+{
+	const std::vector<Vec3f>& positions = vertices.positions;
+	std::vector<Vec3f>& normals = vertices.normals;
+	const size_t vertexCount = positions.size();
+	const size_t blockSize = 4096;
+
+	// one bit per vertex whose normal is (re)computed
+	std::vector<uint64_t> computeBits((vertexCount + 63) / 64, onlyBroken ? 0 : ~(uint64_t)0);
+	const auto needsNormal = [&](const int vertIx) {
+		return (computeBits[vertIx >> 6] >> (vertIx & 63)) & 1;
+	};
+
+	double positionSum[3] = {0.0, 0.0, 0.0};
+	size_t computedCount = onlyBroken ? 0 : vertexCount;
+	for (size_t vertIx = 0; vertIx < vertexCount; vertIx++)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			positionSum[axis] += positions[vertIx][axis];
+		}
+		if (onlyBroken && normals[vertIx].LengthSquared() < FLT_MIN)
+		{
+			computeBits[vertIx >> 6] |= (uint64_t)1 << (vertIx & 63);
+			computedCount++;
+		}
+	}
+	if (computedCount == 0)
+	{
+		return 0;
+	}
+	const Vec3f averagePos(
+		(float)(positionSum[0] / vertexCount),
+		(float)(positionSum[1] / vertexCount),
+		(float)(positionSum[2] / vertexCount));
+
+	std::vector<uint32_t> cornerOffsets, corners;
+	BuildCornerAdjacency(triangles, vertexCount, needsNormal, cornerOffsets, corners);
+
+	// face normals of the triangles that touch at least one of the vertices
+	std::vector<Vec3f> faceNormals(triangles.size());
+	ThreadUtils::ParallelForBlocks(triangles.size(), blockSize, [&](size_t begin, size_t end) {
+		for (size_t triIx = begin; triIx < end; triIx++)
+		{
+			const int* verts = triangles[triIx].verts;
+			if (needsNormal(verts[0]) || needsNormal(verts[1]) || needsNormal(verts[2]))
+			{
+				faceNormals[triIx] = GetFaceNormal(positions, verts);
+			}
+		}
+	});
+
+	// gather: every vertex only writes its own normal, so there is no contention
+	ThreadUtils::ParallelForBlocks(vertexCount, blockSize, [&](size_t begin, size_t end) {
+		for (size_t vertIx = begin; vertIx < end; vertIx++)
+		{
+			if (!needsNormal((int)vertIx))
+			{
+				continue;
+			}
+			Vec3f normal = Vec3f{0.0f};
+			for (uint32_t ix = cornerOffsets[vertIx]; ix < cornerOffsets[vertIx + 1]; ix++)
+			{
+				const uint32_t triIx = corners[ix] / 3;
+				const Vec3f& faceNormal = faceNormals[triIx];
+				if (faceNormal.LengthSquared() >= FLT_MIN)
+				{
+					normal += faceNormal * GetCornerAngle(positions, triangles[triIx].verts, corners[ix] % 3);
+				}
+			}
+			if (normal.LengthSquared() < FLT_MIN)
+			{
+				normal = positions[vertIx] - averagePos;
+				if (normal.LengthSquared() < FLT_MIN)
+				{
+					normals[vertIx] = Vec3f{0.0f, 1.0f, 0.0f};
+					continue;
+				}
+			}
+			normals[vertIx] = normal.Normalized();
+		}
+	});
+	return computedCount;
+}
+
+// The per-triangle state of the MikkTSpace generator (Morten S. Mikkelsen's reference
+// implementation, as used by Blender, xNormal and most bakers), ported for the triangles of a
+// surface. Corners are identified by a shared vertex id, equal for corners with the same position,
+// normal and UV0, just as the reference welds its input.
+static const int MIKK_DEGENERATE = 1;
+static const int MIKK_GROUP_WITH_ANY = 2;
+static const int MIKK_ORIENT_PRESERVING = 4;
+
+struct MikkTriangle
+{
+	int verts[3];
+	int neighbours[3]; // across the edge from corner i to corner i + 1, or -1
+	int groups[3]; // the vertex group of each corner, or -1
+	int flags;
+	Vec3f os; // normalized texture-space tangent of the face
+	Vec3f ot; // and bitangent, both flipped if the UV mapping is mirrored
+};
+
+// The faces around one shared vertex that MikkTSpace lets share a tangent space.
+struct MikkGroup
+{
+	int vertex;
+	bool orientPreserving;
+	std::vector<int> faces;
+};
+
+// The corner of a face whose entry is the given value.
+static int MikkCorner(const int values[3], const int value)
+{
+	return (values[0] == value) ? 0 : ((values[1] == value) ? 1 : 2);
+}
+
+static bool MikkNotZero(const float x)
+{
+	return fabsf(x) > FLT_MIN;
+}
+
+static bool MikkNotZero(const Vec3f& v)
+{
+	return MikkNotZero(v.x) || MikkNotZero(v.y) || MikkNotZero(v.z);
+}
+
+// Project v into the plane of the normal n, and normalize it unless nothing is left.
+static Vec3f MikkProject(const Vec3f& v, const Vec3f& n)
+{
+	const Vec3f projected = v - n * Vec3f::DotProduct(n, v);
+	return MikkNotZero(projected) ? projected * (1.0f / projected.Length()) : projected;
+}
+
+// The angle-weighted average tangent of the faces of a sub-group at the given shared vertex.
+static Vec3f MikkEvalTangent(
+	const std::vector<MikkTriangle>& mikk,
+	const std::vector<int>& faces,
+	const int vertex,
+	const std::vector<Vec3f>& positions,
+	const std::vector<Vec3f>& normals,
+	const std::vector<int>& sharedVertex)
+{
+	const Vec3f& n = normals[sharedVertex[vertex]];
+	Vec3f tangent = Vec3f{0.0f};
+	for (const int f : faces)
+	{
+		const MikkTriangle& face = mikk[f];
+		if ((face.flags & MIKK_GROUP_WITH_ANY) != 0)
+		{
+			continue;
+		}
+		const int i = MikkCorner(face.verts, vertex);
+		const Vec3f& p0 = positions[sharedVertex[face.verts[(i + 2) % 3]]];
+		const Vec3f& p1 = positions[sharedVertex[face.verts[i]]];
+		const Vec3f& p2 = positions[sharedVertex[face.verts[(i + 1) % 3]]];
+		const Vec3f v1 = MikkProject(p0 - p1, n);
+		const Vec3f v2 = MikkProject(p2 - p1, n);
+		const float angle = (float)acos(std::max(-1.0f, std::min(1.0f, Vec3f::DotProduct(v1, v2))));
+		tangent += MikkProject(face.os, n) * angle;
+	}
+	return MikkNotZero(tangent) ? tangent * (1.0f / tangent.Length()) : tangent;
+}
+
+// Run MikkTSpace over the given triangles and store the tangent of every corner, with the
+// handedness in w, at cornerTangents[3 * triangle + corner].
+static void GenerateMikkTSpace(
+	const RawVertexStore& vertices,
+	const std::vector<RawTriangle>& triangles,
+	const int* surfaceTriangles,
+	const size_t triangleCount,
+	std::vector<Vec4f>& cornerTangents)
+{
+	const std::vector<Vec3f>& positions = vertices.positions;
+	const std::vector<Vec3f>& normals = vertices.normals;
+	const std::vector<Vec2f>& uvs = vertices.uv0s;
+
+	// number the distinct vertices, then merge those with the same position, normal and UV0
+	std::vector<int> uniqueVerts;
+	uniqueVerts.reserve(triangleCount * 3);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		const RawTriangle& triangle = triangles[surfaceTriangles[t]];
+		uniqueVerts.insert(uniqueVerts.end(), triangle.verts, triangle.verts + 3);
+	}
+	std::sort(uniqueVerts.begin(), uniqueVerts.end());
+	uniqueVerts.erase(std::unique(uniqueVerts.begin(), uniqueVerts.end()), uniqueVerts.end());
+	const auto key = [&](const int vertIx) {
+		const Vec3f& p = positions[vertIx];
+		const Vec3f& n = normals[vertIx];
+		const Vec2f& uv = uvs[vertIx];
+		return std::make_tuple(p.x, p.y, p.z, n.x, n.y, n.z, uv.x, uv.y);
+	};
+	std::vector<int> byValue(uniqueVerts.size());
+	for (size_t ix = 0; ix < byValue.size(); ix++)
+	{
+		byValue[ix] = (int)ix;
+	}
+	std::sort(byValue.begin(), byValue.end(), [&](const int a, const int b) {
+		return key(uniqueVerts[a]) < key(uniqueVerts[b]);
+	});
+	std::vector<int> sharedIds(uniqueVerts.size());
+	std::vector<int> sharedVertex; // shared id -> a model vertex with its values
+	for (size_t ix = 0; ix < byValue.size(); ix++)
+	{
+		const int vertIx = uniqueVerts[byValue[ix]];
+		if (sharedVertex.empty() || key(sharedVertex.back()) != key(vertIx))
+		{
+			sharedVertex.push_back(vertIx);
+		}
+		sharedIds[byValue[ix]] = (int)sharedVertex.size() - 1;
+	}
+
+	// the texture-space frame of each face; those without one join any group of a neighbour
+	std::vector<MikkTriangle> mikk(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		MikkTriangle& face = mikk[t];
+		const RawTriangle& triangle = triangles[surfaceTriangles[t]];
+		for (int i = 0; i < 3; i++)
+		{
+			const auto unique = std::lower_bound(uniqueVerts.begin(), uniqueVerts.end(), triangle.verts[i]);
+			face.verts[i] = sharedIds[unique - uniqueVerts.begin()];
+			face.neighbours[i] = -1;
+			face.groups[i] = -1;
+		}
+		face.os = Vec3f{0.0f};
+		face.ot = Vec3f{0.0f};
+		const Vec3f& v1 = positions[triangle.verts[0]];
+		const Vec3f& v2 = positions[triangle.verts[1]];
+		const Vec3f& v3 = positions[triangle.verts[2]];
+		if (v1 == v2 || v1 == v3 || v2 == v3)
+		{
+			face.flags = MIKK_DEGENERATE;
+			continue;
+		}
+		face.flags = MIKK_GROUP_WITH_ANY;
+
+		const Vec2f& t1 = uvs[triangle.verts[0]];
+		const Vec2f& t2 = uvs[triangle.verts[1]];
+		const Vec2f& t3 = uvs[triangle.verts[2]];
+		const float t21x = t2.x - t1.x;
+		const float t21y = t2.y - t1.y;
+		const float t31x = t3.x - t1.x;
+		const float t31y = t3.y - t1.y;
+		const Vec3f d1 = v2 - v1;
+		const Vec3f d2 = v3 - v1;
+		const float signedAreaSTx2 = t21x * t31y - t21y * t31x;
+		const Vec3f os = d1 * t31y - d2 * t21y;
+		const Vec3f ot = d1 * -t31x + d2 * t21x;
+		face.flags |= (signedAreaSTx2 > 0.0f) ? MIKK_ORIENT_PRESERVING : 0;
+		if (MikkNotZero(signedAreaSTx2))
+		{
+			const float absArea = fabsf(signedAreaSTx2);
+			const float lenOs = os.Length();
+			const float lenOt = ot.Length();
+			const float sign = ((face.flags & MIKK_ORIENT_PRESERVING) != 0) ? 1.0f : -1.0f;
+			if (MikkNotZero(lenOs))
+			{
+				face.os = os * (sign / lenOs);
+			}
+			if (MikkNotZero(lenOt))
+			{
+				face.ot = ot * (sign / lenOt);
+			}
+			if (MikkNotZero(lenOs / absArea) && MikkNotZero(lenOt / absArea))
+			{
+				face.flags &= ~MIKK_GROUP_WITH_ANY;
+			}
+		}
+	}
+
+	// pair up the faces across their edges, in edge order, the first free match winning
+	struct MikkEdge
+	{
+		int lo, hi, face, edge;
+		bool operator<(const MikkEdge& other) const
+		{
+			return std::tie(lo, hi, face, edge) < std::tie(other.lo, other.hi, other.face, other.edge);
+		}
+	};
+	std::vector<MikkEdge> edges;
+	edges.reserve(triangleCount * 3);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if ((mikk[t].flags & MIKK_DEGENERATE) == 0)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				const int a = mikk[t].verts[i];
+				const int b = mikk[t].verts[(i + 1) % 3];
+				edges.push_back({std::min(a, b), std::max(a, b), (int)t, i});
+			}
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t ix = 0; ix < edges.size(); ix++)
+	{
+		const MikkEdge& edge = edges[ix];
+		MikkTriangle& face = mikk[edge.face];
+		if (face.neighbours[edge.edge] >= 0)
+		{
+			continue;
+		}
+		const int from = face.verts[edge.edge];
+		const int to = face.verts[(edge.edge + 1) % 3];
+		for (size_t other = ix + 1;
+			 other < edges.size() && edges[other].lo == edge.lo && edges[other].hi == edge.hi;
+			 other++)
+		{
+			MikkTriangle& neighbour = mikk[edges[other].face];
+			const int otherEdge = edges[other].edge;
+			// a consistently wound neighbour walks the shared edge the other way
+			if (neighbour.verts[otherEdge] == to && neighbour.verts[(otherEdge + 1) % 3] == from &&
+				neighbour.neighbours[otherEdge] < 0)
+			{
+				face.neighbours[edge.edge] = edges[other].face;
+				neighbour.neighbours[otherEdge] = edge.face;
+				break;
+			}
+		}
+	}
+
+	// grow a group from every corner of a face with a frame, across the two edges at the corner,
+	// into neighbours of the same UV orientation; the reference recurses, this keeps its order
+	std::vector<MikkGroup> groups;
+	std::vector<int> pending;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		if ((mikk[t].flags & (MIKK_DEGENERATE | MIKK_GROUP_WITH_ANY)) != 0)
+		{
+			continue;
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			if (mikk[t].groups[i] >= 0)
+			{
+				continue;
+			}
+			const int groupIx = (int)groups.size();
+			groups.push_back({mikk[t].verts[i], (mikk[t].flags & MIKK_ORIENT_PRESERVING) != 0, {(int)t}});
+			MikkGroup& group = groups.back();
+			mikk[t].groups[i] = groupIx;
+			pending.push_back(mikk[t].neighbours[(i + 2) % 3]);
+			pending.push_back(mikk[t].neighbours[i]);
+			while (!pending.empty())
+			{
+				const int f = pending.back();
+				pending.pop_back();
+				if (f < 0)
+				{
+					continue;
+				}
+				MikkTriangle& face = mikk[f];
+				const int j = MikkCorner(face.verts, group.vertex);
+				if (face.groups[j] >= 0)
+				{
+					continue;
+				}
+				if ((face.flags & MIKK_GROUP_WITH_ANY) != 0 && face.groups[0] < 0 && face.groups[1] < 0 &&
+					face.groups[2] < 0)
+				{
+					// the first group to take a face without a frame decides its orientation
+					face.flags &= ~MIKK_ORIENT_PRESERVING;
+					face.flags |= group.orientPreserving ? MIKK_ORIENT_PRESERVING : 0;
+				}
+				if (((face.flags & MIKK_ORIENT_PRESERVING) != 0) != group.orientPreserving)
+				{
+					continue;
+				}
+				group.faces.push_back(f);
+				face.groups[j] = groupIx;
+				pending.push_back(face.neighbours[(j + 2) % 3]);
+				pending.push_back(face.neighbours[j]);
+			}
+		}
+	}
+
+	// Within a group, the faces whose projected frames agree share one tangent. With the reference's
+	// default angular threshold of 180 degrees, only exactly opposing frames are kept apart.
+	const float thresholdCos = -1.0f;
+	std::vector<Vec4f> faceTangents(triangleCount * 3, Vec4f(1.0f, 0.0f, 0.0f, -1.0f));
+	std::vector<std::vector<int>> subGroups;
+	std::vector<Vec3f> subGroupTangents;
+	std::vector<int> members;
+	for (size_t groupIx = 0; groupIx < groups.size(); groupIx++)
+	{
+		const MikkGroup& group = groups[groupIx];
+		const Vec3f& n = normals[sharedVertex[group.vertex]];
+		subGroups.clear();
+		subGroupTangents.clear();
+		for (const int f : group.faces)
+		{
+			const MikkTriangle& face = mikk[f];
+			const int index = MikkCorner(face.groups, (int)groupIx);
+			const Vec3f os = MikkProject(face.os, n);
+			const Vec3f ot = MikkProject(face.ot, n);
+			members.clear();
+			for (const int t : group.faces)
+			{
+				const MikkTriangle& other = mikk[t];
+				const bool any = ((face.flags | other.flags) & MIKK_GROUP_WITH_ANY) != 0;
+				if (any || t == f ||
+					(Vec3f::DotProduct(os, MikkProject(other.os, n)) > thresholdCos &&
+					 Vec3f::DotProduct(ot, MikkProject(other.ot, n)) > thresholdCos))
+				{
+					members.push_back(t);
+				}
+			}
+			std::sort(members.begin(), members.end());
+			size_t subGroupIx = 0;
+			while (subGroupIx < subGroups.size() && subGroups[subGroupIx] != members)
+			{
+				subGroupIx++;
+			}
+			if (subGroupIx == subGroups.size())
+			{
+				subGroups.push_back(members);
+				subGroupTangents.push_back(
+					MikkEvalTangent(mikk, members, group.vertex, positions, normals, sharedVertex));
+			}
+			const float handedness = group.orientPreserving ? 1.0f : -1.0f;
+			faceTangents[f * 3 + index] = Vec4f(subGroupTangents[subGroupIx], handedness);
+		}
+	}
+
+	// a degenerate face takes the tangent of the first proper corner at the same shared vertex
+	std::vector<int> firstCorner(sharedVertex.size(), -1);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			if ((mikk[t].flags & MIKK_DEGENERATE) == 0 && firstCorner[mikk[t].verts[i]] < 0)
+			{
+				firstCorner[mikk[t].verts[i]] = (int)(t * 3 + i);
+			}
+		}
+	}
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			const int source = firstCorner[mikk[t].verts[i]];
+			if ((mikk[t].flags & MIKK_DEGENERATE) != 0 && source >= 0)
+			{
+				faceTangents[t * 3 + i] = faceTangents[source];
+			}
+			cornerTangents[surfaceTriangles[t] * 3 + i] = faceTangents[t * 3 + i];
+		}
+	}
+}
+
+size_t RawModel::CalculateTangents(bool onlyMissing)
+{
+	if ((vertexAttributes & RAW_VERTEX_ATTRIBUTE_NORMAL) == 0 ||
+		(vertexAttributes & RAW_VERTEX_ATTRIBUTE_UV0) == 0)
+	{
+		return 0;
+	}
+	// allocates a zero-filled tangent column if there wasn't one yet
+	AddVertexAttribute(RAW_VERTEX_ATTRIBUTE_TANGENT);
+
+	std::vector<Vec4f>& tangents = vertices.tangents;
+	std::vector<Vec3f>& binormals = vertices.binormals;
+	const size_t vertexCount = vertices.Size();
+
+	// one bit per vertex whose tangent is (re)computed
+	std::vector<uint64_t> computeBits((vertexCount + 63) / 64, onlyMissing ? 0 : ~(uint64_t)0);
+	const auto needsTangent = [&](const int vertIx) {
+		return (computeBits[vertIx >> 6] >> (vertIx & 63)) & 1;
+	};
+	if (onlyMissing)
+	{
+		bool anyMissing = false;
+		for (size_t vertIx = 0; vertIx < vertexCount; vertIx++)
+		{
+			const Vec4f& t = tangents[vertIx];
+			if (t.x * t.x + t.y * t.y + t.z * t.z < FLT_MIN)
+			{
+				computeBits[vertIx >> 6] |= (uint64_t)1 << (vertIx & 63);
+				anyMissing = true;
+			}
+		}
+		if (!anyMissing)
+		{
+			return 0;
+		}
+	}
+
+	// MikkTSpace runs per surface, like a baker on the mesh the artist exported, and the surfaces
+	// go in parallel
+	std::vector<int> sortedTriangles(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		sortedTriangles[i] = (int)i;
+	}
+	CountingSort(sortedTriangles, surfaces.size(), [&](const int triIx) {
+		return triangles[triIx].surfaceIndex;
+	});
+	std::vector<size_t> surfaceStarts(surfaces.size() + 1, 0);
+	for (const RawTriangle& triangle : triangles)
+	{
+		surfaceStarts[triangle.surfaceIndex + 1]++;
+	}
+	for (size_t surfaceIx = 0; surfaceIx < surfaces.size(); surfaceIx++)
+	{
+		surfaceStarts[surfaceIx + 1] += surfaceStarts[surfaceIx];
+	}
+	std::vector<Vec4f> cornerTangents(triangles.size() * 3);
+	ThreadUtils::ParallelFor(surfaces.size(), [&](const size_t surfaceIx) {
+		const size_t begin = surfaceStarts[surfaceIx];
+		const size_t end = surfaceStarts[surfaceIx + 1];
+		bool needed = false;
+		for (size_t i = begin; i < end && !needed; i++)
+		{
+			const RawTriangle& triangle = triangles[sortedTriangles[i]];
+			needed = needsTangent(triangle.verts[0]) || needsTangent(triangle.verts[1]) ||
+				needsTangent(triangle.verts[2]);
+		}
+		if (needed)
+		{
+			GenerateMikkTSpace(vertices, triangles, &sortedTriangles[begin], end - begin, cornerTangents);
+		}
+	});
+
+	// The tangents are per corner. Where the corners of a vertex disagree, at a tangent space seam
+	// that welding could not see, the vertex is split, morph target deltas and all.
+	std::vector<bool> assigned(vertexCount, false);
+	std::vector<int> nextVariant(vertexCount, -1);
+	std::vector<RawBlendDelta> variantDeltas;
+	size_t computedCount = 0;
+	for (size_t triIx = 0; triIx < triangles.size(); triIx++)
+	{
+		for (int corner = 0; corner < 3; corner++)
+		{
+			const int vertIx = triangles[triIx].verts[corner];
+			if (!needsTangent(vertIx))
+			{
+				continue;
+			}
+			const Vec4f& tangent = cornerTangents[triIx * 3 + corner];
+			if (!assigned[vertIx])
+			{
+				assigned[vertIx] = true;
+				tangents[vertIx] = tangent;
+				if (!binormals.empty())
+				{
+					// glTF: bitangent = cross(normal, tangent.xyz) * tangent.w
+					const Vec3f& normal = vertices.normals[vertIx];
+					binormals[vertIx] = Vec3f::CrossProduct(normal, tangent.xyz()) * tangent.w;
+				}
+				computedCount++;
+				continue;
+			}
+			int variant = vertIx;
+			while (variant >= 0 && tangents[variant] != tangent)
+			{
+				variant = nextVariant[variant];
+			}
+			if (variant < 0)
+			{
+				RawVertex vertex = vertices.Get(vertIx);
+				vertex.tangent = tangent;
+				if (!binormals.empty())
+				{
+					vertex.binormal = Vec3f::CrossProduct(vertex.normal, tangent.xyz()) * tangent.w;
+				}
+				variant = (int)vertices.Size();
+				vertices.PushBack(vertex);
+				nextVariant.push_back(nextVariant[vertIx]);
+				nextVariant[vertIx] = variant;
+
+				const auto range = blendDeltas.GetVertexDeltas(vertIx);
+				variantDeltas.assign(range.first, range.second);
+				for (RawBlendDelta& delta : variantDeltas)
+				{
+					delta.vertexIndex = variant;
+					blendDeltas.Add(delta);
+				}
+				computedCount++;
+			}
+			triangles[triIx].verts[corner] = variant;
 		}
-		vertex.normal.Normalize();
 	}
-	return onlyBroken ? brokenVerts.size() : vertices.size();
+	return computedCount;
 }
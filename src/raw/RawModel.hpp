@@ -13,6 +13,9 @@
 #include <unordered_map>
 
 #include "FBX2glTF.h"
+#include "RawBlendDeltaStore.hpp"
+#include "RawVertexTable.hpp"
+#include "utils/Hash_Utils.hpp"
 
 enum RawVertexAttribute
 {
@@ -29,18 +32,6 @@ enum RawVertexAttribute
 	RAW_VERTEX_ATTRIBUTE_AUTO = 1 << 31
 };
 
-struct RawBlendVertex
-{
-	Vec3f position{};
-	Vec3f normal{};
-	Vec4f tangent{};
-
-	bool operator==(const RawBlendVertex& other) const
-	{
-		return position == other.position && normal == other.normal && tangent == other.tangent;
-	}
-};
-
 struct RawVertex
 {
 	RawVertex() : polarityUv0(false), pad1(false), pad2(false), pad3(false)
@@ -61,9 +52,10 @@ struct RawVertex
 	// if this vertex participates in a blend shape setup, the surfaceIx of its dedicated mesh;
 	// otherwise, -1
 	int blendSurfaceIx = -1;
-	// the size of this vector is always identical to the size of the corresponding
-	// RawSurface.blendChannels
-	std::vector<RawBlendVertex> blends{};
+	// RawBlendDeltaStore::Fingerprint() of this vertex's morph target deltas, which live in the
+	// model's blend delta store; 0 if it has none. Welding confirms equal fingerprints against the
+	// deltas themselves, which operator== can't see.
+	uint64_t blendFingerprint = 0;
 
 	bool polarityUv0;
 	bool pad1;
@@ -74,18 +66,71 @@ struct RawVertex
 	size_t Difference(const RawVertex& other) const;
 };
 
-class VertexHasher
+/**
+ * Structure-of-arrays storage for the vertices of a RawModel.
+ *
+ * Every attribute lives in its own contiguous column, and a column is only allocated while its
+ * RawVertexAttribute bit is set; vertices read back through Get() carry default values for the
+ * attributes that aren't stored. The positions column always exists. The bookkeeping members
+ * (blend surface, blend fingerprint, UV polarity) are allocated the first time a vertex uses them.
+ */
+class RawVertexStore
 {
 public:
-	size_t operator()(const RawVertex& v) const
+	RawVertexStore() : attributes(RAW_VERTEX_ATTRIBUTE_POSITION) {}
+
+	int GetAttributes() const
 	{
-		size_t seed = 5381;
-		const auto hasher = std::hash<float>{};
-		seed ^= hasher(v.position[0]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-		seed ^= hasher(v.position[1]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-		seed ^= hasher(v.position[2]) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-		return seed;
+		return attributes;
 	}
+
+	// Allocate (default-filled) columns for newly set bits and release columns for cleared bits.
+	void SetAttributes(int attributes);
+
+	size_t Size() const
+	{
+		return positions.size();
+	}
+
+	void Reserve(size_t count);
+	// Remove all vertices but keep the attribute set.
+	void Clear();
+
+	void PushBack(const RawVertex& vertex);
+	// Keep only vertices with remap[i] >= 0, moving each to index remap[i]; the remap must
+	// preserve relative order.
+	void Compact(const std::vector<int>& remap, int count);
+	// Renumber the blend surface of every vertex through an old->new surface map.
+	void RemapBlendSurfaces(const std::vector<int>& surfaceRemap);
+	RawVertex Get(int index) const;
+	// Compares the stored attributes of a vertex against the corresponding members of another.
+	bool Equals(int index, const RawVertex& vertex) const;
+
+	// Approximate heap footprint of the columns, in bytes.
+	size_t GetMemoryUsage() const;
+
+	// Returns the column backing the given RawVertex member, or nullptr if it isn't stored.
+	const std::vector<Vec2f>* GetColumn(const Vec2f RawVertex::*member) const;
+	const std::vector<Vec3f>* GetColumn(const Vec3f RawVertex::*member) const;
+	const std::vector<Vec4f>* GetColumn(const Vec4f RawVertex::*member) const;
+	const std::vector<Vec4i>* GetColumn(const Vec4i RawVertex::*member) const;
+
+	std::vector<Vec3f> positions;
+	std::vector<Vec3f> normals;
+	std::vector<Vec3f> binormals;
+	std::vector<Vec4f> tangents;
+	std::vector<Vec4f> colors;
+	std::vector<Vec2f> uv0s;
+	std::vector<Vec2f> uv1s;
+	std::vector<Vec4i> jointIndices;
+	std::vector<Vec4f> jointWeights;
+
+	std::vector<int> blendSurfaceIxs;
+	std::vector<uint64_t> blendFingerprints;
+	std::vector<uint8_t> polarityUv0s;
+
+private:
+	int attributes;
 };
 
 struct RawTriangle
@@ -182,6 +227,20 @@ struct RawTexture
 	std::string fileLocation; // inferred path in local filesystem, or ""
 };
 
+template <int N>
+inline void HashCombine(uint64_t& seed, const mathfu::Vector<float, N>& v)
+{
+	for (int i = 0; i < N; i++)
+	{
+		HashUtils::Combine(seed, HashUtils::FloatBits(v[i]));
+	}
+}
+
+inline void HashCombine(uint64_t& seed, const float f)
+{
+	HashUtils::Combine(seed, HashUtils::FloatBits(f));
+}
+
 struct RawMatProps
 {
 	explicit RawMatProps(RawShadingModel shadingModel, float alphaTest, bool isDoubleSided) :
@@ -206,6 +265,15 @@ struct RawMatProps
 			alphaTest == other.alphaTest &&
 			isDoubleSided == other.isDoubleSided;
 	};
+
+	// Content hash; properties that compare equal must hash equal.
+	virtual uint64_t Hash() const
+	{
+		uint64_t seed = (uint64_t)shadingModel;
+		HashCombine(seed, alphaTest);
+		HashUtils::Combine(seed, isDoubleSided ? 1 : 0);
+		return seed;
+	}
 };
 
 struct RawTraditionalMatProps : RawMatProps
@@ -253,6 +321,19 @@ struct RawTraditionalMatProps : RawMatProps
 		}
 		return false;
 	}
+
+	uint64_t Hash() const override
+	{
+		uint64_t seed = RawMatProps::Hash();
+		HashCombine(seed, diffuseFactor);
+		HashCombine(seed, emissiveFactor);
+		HashCombine(seed, specularFactor);
+		HashCombine(seed, specularLevel);
+		HashCombine(seed, shininess);
+		HashCombine(seed, bumpFactor);
+		HashUtils::Combine(seed, invertNormalMapY ? 1 : 0);
+		return seed;
+	}
 };
 
 struct RawVRayMatProps : RawMatProps
@@ -327,6 +408,23 @@ struct RawVRayMatProps : RawMatProps
 		}
 		return false;
 	}
+
+	uint64_t Hash() const override
+	{
+		uint64_t seed = RawMatProps::Hash();
+		HashCombine(seed, diffuseColor);
+		HashCombine(seed, reflectionColor);
+		HashCombine(seed, roughness);
+		HashCombine(seed, roughnessMapMin);
+		HashCombine(seed, roughnessMapMax);
+		HashCombine(seed, metalness);
+		HashCombine(seed, refractionColor);
+		HashCombine(seed, selfIlluminationColor);
+		HashCombine(seed, selfIlluminationMultiplier);
+		HashCombine(seed, bumpMultiplier);
+		HashUtils::Combine(seed, invertNormalMapY ? 1 : 0);
+		return seed;
+	}
 };
 
 struct RawUnlitMatProps : RawMatProps
@@ -360,6 +458,15 @@ struct RawUnlitMatProps : RawMatProps
 		}
 		return false;
 	}
+
+	uint64_t Hash() const override
+	{
+		uint64_t seed = RawMatProps::Hash();
+		HashCombine(seed, diffuseColor);
+		HashCombine(seed, selfIlluminationColor);
+		HashCombine(seed, selfIlluminationMultiplier);
+		return seed;
+	}
 };
 
 struct RawMaterial
@@ -410,6 +517,38 @@ struct RawSurface
 	bool discrete;
 };
 
+// A material/surface partition of a RawModel's triangles, as produced by CreateMaterialModels().
+// Vertices are referenced rather than copied: local vertex i is model vertex vertices[i].
+struct RawPrimitive
+{
+	int materialIndex;
+	int surfaceIndex;
+	int vertexAttributes; // the kept attributes that have non-default values in this primitive
+	std::vector<int> vertices; // local -> model vertex index
+	std::vector<uint32_t> indices; // three local vertex indices per triangle
+	std::vector<std::vector<uint32_t>> lodIndices; // simplified triangle lists, coarsest last
+	Bounds<float, 3> bounds;
+	RawBlendDeltaStore blendDeltas; // indexed by local vertex
+
+	int GetVertexCount() const
+	{
+		return (int)vertices.size();
+	}
+
+	int GetTriangleCount() const
+	{
+		return (int)indices.size() / 3;
+	}
+};
+
+enum RawInterpolation
+{
+	RAW_INTERPOLATION_LINEAR,
+	RAW_INTERPOLATION_STEP,
+	// each keyframe holds an in-tangent, a value and an out-tangent, in that order
+	RAW_INTERPOLATION_CUBICSPLINE
+};
+
 struct RawChannel
 {
 	int nodeIndex;
@@ -417,6 +556,16 @@ struct RawChannel
 	std::vector<Quatf> rotations;
 	std::vector<Vec3f> scales;
 	std::vector<float> weights;
+
+	// the keyframe times of each property, where they are not those of the whole animation
+	std::vector<float> translationTimes;
+	std::vector<float> rotationTimes;
+	std::vector<float> scaleTimes;
+
+	// properties with times of their own may also interpolate in other ways
+	RawInterpolation translationInterpolation = RAW_INTERPOLATION_LINEAR;
+	RawInterpolation rotationInterpolation = RAW_INTERPOLATION_LINEAR;
+	RawInterpolation scaleInterpolation = RAW_INTERPOLATION_LINEAR;
 };
 
 struct RawAnimation
@@ -466,6 +615,25 @@ struct RawNode
 	std::vector<std::string> userProperties;
 };
 
+// What RawModel::DeduplicateSurfaces() merged away.
+struct RawDedupStats
+{
+	int mergedSurfaces = 0;
+	int droppedTriangles = 0;
+	int droppedVertices = 0;
+	size_t droppedBytes = 0; // of float vertex attributes and 32-bit indices
+};
+
+// What RawModel::ReduceKeyframes() dropped, counting keyframes of translations, rotations and
+// scales, and bytes of their values and times.
+struct RawKeyframeStats
+{
+	size_t keyframesBefore = 0;
+	size_t keyframesAfter = 0;
+	size_t bytesBefore = 0;
+	size_t bytesAfter = 0;
+};
+
 class RawModel
 {
 public:
@@ -474,6 +642,15 @@ public:
 	// Add geometry.
 	void AddVertexAttribute(const RawVertexAttribute attrib);
 	int AddVertex(const RawVertex& vertex);
+	// Add a vertex with its morph target deltas, which are stored for it unless it welds to an
+	// existing vertex with the same deltas.
+	int AddVertex(const RawVertex& vertex, const std::vector<RawBlendDelta>& deltas);
+	// Record a morph target delta for a vertex that was just added; deltas must arrive in
+	// increasing vertex order and are expected to be non-zero.
+	void AddBlendDelta(const RawBlendDelta& delta)
+	{
+		blendDeltas.Add(delta);
+	}
 	int AddTriangle(
 		const int v0,
 		const int v1,
@@ -534,12 +711,30 @@ public:
 	// materials or surfaces.
 	void Condense();
 
-	void TransformGeometry(ComputeNormalsOption);
+	// Merge surfaces whose triangles, materials and vertices are identical into the first of them,
+	// pointing their nodes there and dropping the copies. With allowTranslation, surfaces that are
+	// identical up to a translation merge too, if the offset can move into the nodes that hold
+	// them. Surfaces with skins or blend shapes are left alone. Fingerprinting runs in parallel.
+	RawDedupStats DeduplicateSurfaces(bool allowTranslation);
+
+	// Drop the keyframes of linearly interpolated translations, rotations and scales that
+	// interpolating between their neighbours reproduces within the given tolerances: in scene
+	// units, degrees, and as a ratio of the scale. Properties that lose keyframes get their own
+	// times. Runs in parallel across channels; morph target weights are left alone.
+	RawKeyframeStats
+	ReduceKeyframes(float translationTolerance, float rotationToleranceDegrees, float scaleTolerance);
+
+	void TransformGeometry(ComputeNormalsOption, ComputeTangentsOption);
 
 	void TransformTextures(const std::vector<std::function<Vec2f(Vec2f)>>& transforms);
 
 	size_t CalculateNormals(bool);
 
+	// Compute MikkTSpace tangents (handedness in w) from the normals and UV0, either for every
+	// vertex or only for those whose tangent is zero-length, splitting vertices at tangent seams.
+	// Needs both attributes; returns the number of vertices given a tangent.
+	size_t CalculateTangents(bool onlyMissing);
+
 	// Get the attributes stored per vertex.
 	int GetVertexAttributes() const
 	{
@@ -549,12 +744,25 @@ public:
 	// Iterate over the vertices.
 	int GetVertexCount() const
 	{
-		return (int)vertices.size();
+		return (int)vertices.Size();
+	}
+
+	// Assembles a single vertex from the attribute columns; prefer GetVertexStore() for
+	// per-attribute passes.
+	RawVertex GetVertex(const int index) const
+	{
+		return vertices.Get(index);
 	}
 
-	const RawVertex& GetVertex(const int index) const
+	const RawVertexStore& GetVertexStore() const
 	{
-		return vertices[index];
+		return vertices;
+	}
+
+	// The sparse morph target deltas of all vertices.
+	const RawBlendDeltaStore& GetBlendDeltas() const
+	{
+		return blendDeltas;
 	}
 
 	// Iterate over the triangles.
@@ -659,28 +867,56 @@ public:
 
 	int GetNodeById(uint64_t nodeId) const;
 
+	// Print collision and probe-length statistics of the vertex welding table.
+	void PrintVertexTableStats(const char* label) const
+	{
+		vertexTable.PrintStats(label);
+	}
+
+	// The stored values of an attribute, indexed by vertex, or null if the vertices don't store it
+	// and all hold the RawVertex default.
+	template <typename _attrib_type_>
+	const std::vector<_attrib_type_>* GetAttributeColumn(const _attrib_type_ RawVertex::* ptr) const
+	{
+		return vertices.GetColumn(ptr);
+	}
+
 	// Create individual attribute arrays.
 	// Returns true if the vertices store the particular attribute.
 	template <typename _attrib_type_>
 	void GetAttributeArray(std::vector<_attrib_type_>& out, const _attrib_type_ RawVertex::* ptr)
 	const;
 
-	// Create an array with a raw model for each material.
-	// Multiple surfaces with the same material will turn into a single model.
-	// However, surfaces that are marked as 'discrete' will turn into separate models.
+	// Gather an attribute for a subset of the vertices, e.g. RawPrimitive::vertices.
+	template <typename _attrib_type_>
+	void GetAttributeArray(
+		std::vector<_attrib_type_>& out,
+		const _attrib_type_ RawVertex::* ptr,
+		const std::vector<int>& vertexIndices) const;
+
+	// Partition the triangles into one primitive per (material, surface) pair, ordered by
+	// material and then surface. Attributes not selected by keepAttribs (-1 for all) are ignored,
+	// which may weld vertices within a primitive. With shortIndices, primitives are split so that
+	// none references more than 0xFFFE vertices. Buckets are processed in parallel.
 	void CreateMaterialModels(
-		std::vector<RawModel>& materialModels,
+		std::vector<RawPrimitive>& primitives,
 		bool shortIndices,
-		int keepAttribs,
-		bool forceDiscrete) const;
+		int keepAttribs) const;
 
 private:
-	Vec3f getFaceNormal(int verts[3]) const;
+	void rebuildVertexTable();
+	// Whether two stored vertices have the same morph target deltas.
+	bool sameBlendDeltas(int vertexA, int vertexB) const;
+	void rebuildIndexes();
 
 	uint64_t rootNodeId;
 	int vertexAttributes;
-	std::unordered_map<RawVertex, int, VertexHasher> vertexHash;
-	std::vector<RawVertex> vertices;
+	// the welding table hashes exactly the attributes in vertexTableAttributes; it is rebuilt
+	// whenever vertexAttributes changes or it no longer covers every vertex
+	RawVertexTable vertexTable;
+	int vertexTableAttributes;
+	RawVertexStore vertices;
+	RawBlendDeltaStore blendDeltas;
 	std::vector<RawTriangle> triangles;
 	std::vector<RawTexture> textures;
 	std::vector<RawMaterial> materials;
@@ -689,6 +925,14 @@ private:
 	std::vector<RawAnimation> animations;
 	std::vector<RawCamera> cameras;
 	std::vector<RawNode> nodes;
+
+	// lookup indexes, kept in sync by the Add*() methods and rebuilt by Condense()
+	std::unordered_map<std::string, int> textureIndexByKey; // usage, folded location and name
+	std::unordered_multimap<uint64_t, int> materialIndexByHash;
+	std::unordered_multimap<std::string, int> lightIndexByName;
+	std::unordered_map<uint64_t, int> surfaceIndexById;
+	std::unordered_map<std::string, int> surfaceIndexByName; // case-folded
+	std::unordered_map<uint64_t, int> nodeIndexById;
 };
 
 template <typename _attrib_type_>
@@ -696,9 +940,34 @@ void RawModel::GetAttributeArray(
 	std::vector<_attrib_type_>& out,
 	const _attrib_type_ RawVertex::* ptr) const
 {
-	out.resize(vertices.size());
-	for (size_t i = 0; i < vertices.size(); i++)
+	const std::vector<_attrib_type_>* column = vertices.GetColumn(ptr);
+	if (column != nullptr)
+	{
+		out = *column;
+	}
+	else
+	{
+		out.assign(vertices.Size(), RawVertex().*ptr);
+	}
+}
+
+template <typename _attrib_type_>
+void RawModel::GetAttributeArray(
+	std::vector<_attrib_type_>& out,
+	const _attrib_type_ RawVertex::* ptr,
+	const std::vector<int>& vertexIndices) const
+{
+	const std::vector<_attrib_type_>* column = vertices.GetColumn(ptr);
+	if (column != nullptr)
+	{
+		out.resize(vertexIndices.size());
+		for (size_t i = 0; i < vertexIndices.size(); i++)
+		{
+			out[i] = (*column)[vertexIndices[i]];
+		}
+	}
+	else
 	{
-		out[i] = vertices[i].*ptr;
+		out.assign(vertexIndices.size(), RawVertex().*ptr);
 	}
 }
@@ -0,0 +1,293 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "RawModel.hpp"
+
+template <typename T>
+static void ResizeColumn(std::vector<T>& column, const bool keep, const size_t count, const T& value)
+{
+	if (keep)
+	{
+		column.resize(count, value);
+	}
+	else
+	{
+		std::vector<T>().swap(column);
+	}
+}
+
+template <typename T>
+static size_t ColumnBytes(const std::vector<T>& column)
+{
+	return column.capacity() * sizeof(T);
+}
+
+void RawVertexStore::SetAttributes(const int newAttributes)
+{
+	const RawVertex defaultVertex;
+	const size_t count = positions.size();
+
+	attributes = (newAttributes & ~RAW_VERTEX_ATTRIBUTE_AUTO) | RAW_VERTEX_ATTRIBUTE_POSITION;
+	ResizeColumn(normals, (attributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0, count, defaultVertex.normal);
+	ResizeColumn(
+		binormals, (attributes & RAW_VERTEX_ATTRIBUTE_BINORMAL) != 0, count, defaultVertex.binormal);
+	ResizeColumn(tangents, (attributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0, count, defaultVertex.tangent);
+	ResizeColumn(colors, (attributes & RAW_VERTEX_ATTRIBUTE_COLOR) != 0, count, defaultVertex.color);
+	ResizeColumn(uv0s, (attributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0, count, defaultVertex.uv0);
+	ResizeColumn(uv1s, (attributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0, count, defaultVertex.uv1);
+	ResizeColumn(
+		jointIndices,
+		(attributes & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0,
+		count,
+		defaultVertex.jointIndices);
+	ResizeColumn(
+		jointWeights,
+		(attributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0,
+		count,
+		defaultVertex.jointWeights);
+}
+
+void RawVertexStore::Reserve(const size_t count)
+{
+	positions.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0)
+		normals.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_BINORMAL) != 0)
+		binormals.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0)
+		tangents.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_COLOR) != 0)
+		colors.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0)
+		uv0s.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0)
+		uv1s.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0)
+		jointIndices.reserve(count);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0)
+		jointWeights.reserve(count);
+}
+
+void RawVertexStore::Clear()
+{
+	positions.clear();
+	normals.clear();
+	binormals.clear();
+	tangents.clear();
+	colors.clear();
+	uv0s.clear();
+	uv1s.clear();
+	jointIndices.clear();
+	jointWeights.clear();
+	std::vector<int>().swap(blendSurfaceIxs);
+	std::vector<uint64_t>().swap(blendFingerprints);
+	std::vector<uint8_t>().swap(polarityUv0s);
+}
+
+void RawVertexStore::PushBack(const RawVertex& vertex)
+{
+	const size_t index = positions.size();
+
+	positions.push_back(vertex.position);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0)
+		normals.push_back(vertex.normal);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_BINORMAL) != 0)
+		binormals.push_back(vertex.binormal);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0)
+		tangents.push_back(vertex.tangent);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_COLOR) != 0)
+		colors.push_back(vertex.color);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0)
+		uv0s.push_back(vertex.uv0);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0)
+		uv1s.push_back(vertex.uv1);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0)
+		jointIndices.push_back(vertex.jointIndices);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0)
+		jointWeights.push_back(vertex.jointWeights);
+
+	// the bookkeeping columns only materialize once a vertex deviates from the default
+	if (!blendSurfaceIxs.empty() || vertex.blendSurfaceIx != -1)
+	{
+		blendSurfaceIxs.resize(index, -1);
+		blendSurfaceIxs.push_back(vertex.blendSurfaceIx);
+	}
+	if (!blendFingerprints.empty() || vertex.blendFingerprint != 0)
+	{
+		blendFingerprints.resize(index, 0);
+		blendFingerprints.push_back(vertex.blendFingerprint);
+	}
+	if (!polarityUv0s.empty() || vertex.polarityUv0)
+	{
+		polarityUv0s.resize(index, 0);
+		polarityUv0s.push_back(vertex.polarityUv0 ? 1 : 0);
+	}
+}
+
+template <typename T>
+static void CompactColumn(std::vector<T>& column, const std::vector<int>& remap, const int count)
+{
+	if (column.empty())
+	{
+		return;
+	}
+	for (size_t i = 0; i < column.size(); i++)
+	{
+		if (remap[i] >= 0)
+		{
+			column[remap[i]] = column[i];
+		}
+	}
+	// lazily allocated columns may be shorter than the vertex count
+	size_t newSize = 0;
+	for (size_t i = column.size(); i > 0; i--)
+	{
+		if (remap[i - 1] >= 0)
+		{
+			newSize = (size_t)remap[i - 1] + 1;
+			break;
+		}
+	}
+	column.resize(std::min(newSize, (size_t)count));
+}
+
+void RawVertexStore::Compact(const std::vector<int>& remap, const int count)
+{
+	CompactColumn(positions, remap, count);
+	CompactColumn(normals, remap, count);
+	CompactColumn(binormals, remap, count);
+	CompactColumn(tangents, remap, count);
+	CompactColumn(colors, remap, count);
+	CompactColumn(uv0s, remap, count);
+	CompactColumn(uv1s, remap, count);
+	CompactColumn(jointIndices, remap, count);
+	CompactColumn(jointWeights, remap, count);
+	CompactColumn(blendSurfaceIxs, remap, count);
+	CompactColumn(blendFingerprints, remap, count);
+	CompactColumn(polarityUv0s, remap, count);
+}
+
+void RawVertexStore::RemapBlendSurfaces(const std::vector<int>& surfaceRemap)
+{
+	for (int& surfaceIx : blendSurfaceIxs)
+	{
+		if (surfaceIx >= 0)
+		{
+			surfaceIx = surfaceRemap[surfaceIx];
+		}
+	}
+}
+
+RawVertex RawVertexStore::Get(const int index) const
+{
+	RawVertex vertex;
+	vertex.position = positions[index];
+	if (!normals.empty())
+		vertex.normal = normals[index];
+	if (!binormals.empty())
+		vertex.binormal = binormals[index];
+	if (!tangents.empty())
+		vertex.tangent = tangents[index];
+	if (!colors.empty())
+		vertex.color = colors[index];
+	if (!uv0s.empty())
+		vertex.uv0 = uv0s[index];
+	if (!uv1s.empty())
+		vertex.uv1 = uv1s[index];
+	if (!jointIndices.empty())
+		vertex.jointIndices = jointIndices[index];
+	if (!jointWeights.empty())
+		vertex.jointWeights = jointWeights[index];
+	if ((size_t)index < blendSurfaceIxs.size())
+		vertex.blendSurfaceIx = blendSurfaceIxs[index];
+	if ((size_t)index < blendFingerprints.size())
+		vertex.blendFingerprint = blendFingerprints[index];
+	if ((size_t)index < polarityUv0s.size())
+		vertex.polarityUv0 = polarityUv0s[index] != 0;
+	return vertex;
+}
+
+bool RawVertexStore::Equals(const int index, const RawVertex& vertex) const
+{
+	if (positions[index] != vertex.position)
+		return false;
+	if (!normals.empty() && normals[index] != vertex.normal)
+		return false;
+	if (!binormals.empty() && binormals[index] != vertex.binormal)
+		return false;
+	if (!tangents.empty() && tangents[index] != vertex.tangent)
+		return false;
+	if (!colors.empty() && colors[index] != vertex.color)
+		return false;
+	if (!uv0s.empty() && uv0s[index] != vertex.uv0)
+		return false;
+	if (!uv1s.empty() && uv1s[index] != vertex.uv1)
+		return false;
+	if (!jointIndices.empty() && jointIndices[index] != vertex.jointIndices)
+		return false;
+	if (!jointWeights.empty() && jointWeights[index] != vertex.jointWeights)
+		return false;
+
+	const int blendSurfaceIx = ((size_t)index < blendSurfaceIxs.size()) ? blendSurfaceIxs[index] : -1;
+	const bool polarityUv0 = ((size_t)index < polarityUv0s.size()) && polarityUv0s[index] != 0;
+	const uint64_t blendFingerprint =
+		((size_t)index < blendFingerprints.size()) ? blendFingerprints[index] : 0;
+	return blendSurfaceIx == vertex.blendSurfaceIx && blendFingerprint == vertex.blendFingerprint &&
+		polarityUv0 == vertex.polarityUv0;
+}
+
+size_t RawVertexStore::GetMemoryUsage() const
+{
+	return ColumnBytes(positions) + ColumnBytes(normals) + ColumnBytes(binormals) +
+		ColumnBytes(tangents) + ColumnBytes(colors) + ColumnBytes(uv0s) + ColumnBytes(uv1s) +
+		ColumnBytes(jointIndices) + ColumnBytes(jointWeights) + ColumnBytes(blendSurfaceIxs) +
+		ColumnBytes(blendFingerprints) + ColumnBytes(polarityUv0s);
+}
+
+const std::vector<Vec2f>* RawVertexStore::GetColumn(const Vec2f RawVertex::*member) const
+{
+	const std::vector<Vec2f>* column = nullptr;
+	if (member == &RawVertex::uv0)
+		column = &uv0s;
+	else if (member == &RawVertex::uv1)
+		column = &uv1s;
+	return (column != nullptr && column->size() == Size()) ? column : nullptr;
+}
+
+const std::vector<Vec3f>* RawVertexStore::GetColumn(const Vec3f RawVertex::*member) const
+{
+	const std::vector<Vec3f>* column = nullptr;
+	if (member == &RawVertex::position)
+		column = &positions;
+	else if (member == &RawVertex::normal)
+		column = &normals;
+	else if (member == &RawVertex::binormal)
+		column = &binormals;
+	return (column != nullptr && column->size() == Size()) ? column : nullptr;
+}
+
+const std::vector<Vec4f>* RawVertexStore::GetColumn(const Vec4f RawVertex::*member) const
+{
+	const std::vector<Vec4f>* column = nullptr;
+	if (member == &RawVertex::tangent)
+		column = &tangents;
+	else if (member == &RawVertex::color)
+		column = &colors;
+	else if (member == &RawVertex::jointWeights)
+		column = &jointWeights;
+	return (column != nullptr && column->size() == Size()) ? column : nullptr;
+}
+
+const std::vector<Vec4i>* RawVertexStore::GetColumn(const Vec4i RawVertex::*member) const
+{
+	if (member == &RawVertex::jointIndices && jointIndices.size() == Size())
+	{
+		return &jointIndices;
+	}
+	return nullptr;
+}
@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "RawVertexTable.hpp"
+
+#include "RawModel.hpp"
+#include "utils/Hash_Utils.hpp"
+
+// position, normal, binormal, tangent, color, uv0, uv1, joint indices/weights and the trailer
+static const size_t MAX_HASH_WORDS = 3 + 3 + 3 + 4 + 4 + 2 + 2 + 2 + 4 + 4;
+
+template <int N>
+static inline size_t AppendFloats(uint32_t* words, size_t n, const mathfu::Vector<float, N>& v)
+{
+	for (int i = 0; i < N; i++)
+	{
+		words[n++] = HashUtils::FloatBits(v[i]);
+	}
+	return n;
+}
+
+uint32_t RawVertexTable::Hash(const RawVertex& vertex, const int attributes)
+{
+	uint32_t words[MAX_HASH_WORDS];
+	size_t n = 0;
+
+	n = AppendFloats(words, n, vertex.position);
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_NORMAL) != 0)
+	{
+		n = AppendFloats(words, n, vertex.normal);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_BINORMAL) != 0)
+	{
+		n = AppendFloats(words, n, vertex.binormal);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_TANGENT) != 0)
+	{
+		n = AppendFloats(words, n, vertex.tangent);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_COLOR) != 0)
+	{
+		n = AppendFloats(words, n, vertex.color);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_UV0) != 0)
+	{
+		n = AppendFloats(words, n, vertex.uv0);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_UV1) != 0)
+	{
+		n = AppendFloats(words, n, vertex.uv1);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_INDICES) != 0)
+	{
+		words[n++] = (uint32_t)vertex.jointIndices[0] | ((uint32_t)vertex.jointIndices[1] << 16);
+		words[n++] = (uint32_t)vertex.jointIndices[2] | ((uint32_t)vertex.jointIndices[3] << 16);
+	}
+	if ((attributes & RAW_VERTEX_ATTRIBUTE_JOINT_WEIGHTS) != 0)
+	{
+		n = AppendFloats(words, n, vertex.jointWeights);
+	}
+	words[n++] = (uint32_t)vertex.blendSurfaceIx;
+	words[n++] = (uint32_t)vertex.blendFingerprint;
+	words[n++] = (uint32_t)(vertex.blendFingerprint >> 32);
+	words[n++] = vertex.polarityUv0 ? 1 : 0;
+
+	return HashUtils::HashWords(words, n, (uint32_t)attributes);
+}
+
+void RawVertexTable::Clear()
+{
+	std::fill(slots.begin(), slots.end(), Slot{0, -1});
+	count = 0;
+}
+
+void RawVertexTable::Release()
+{
+	std::vector<Slot>().swap(slots);
+	count = 0;
+}
+
+void RawVertexTable::Reserve(const size_t entryCount)
+{
+	if (entryCount * 2 > slots.size())
+	{
+		Grow(entryCount * 2);
+	}
+}
+
+void RawVertexTable::Insert(const uint32_t hash, const int index)
+{
+	if ((count + 1) * 2 > slots.size())
+	{
+		Grow((count + 1) * 2);
+	}
+	const size_t mask = slots.size() - 1;
+	size_t slotIx = hash & mask;
+	while (slots[slotIx].index >= 0)
+	{
+		slotIx = (slotIx + 1) & mask;
+	}
+	slots[slotIx] = Slot{hash, index};
+	count++;
+}
+
+void RawVertexTable::Grow(const size_t minCapacity)
+{
+	size_t capacity = std::max<size_t>(slots.size(), 64);
+	while (capacity < minCapacity)
+	{
+		capacity *= 2;
+	}
+	if (capacity == slots.size())
+	{
+		return;
+	}
+
+	std::vector<Slot> oldSlots(capacity, Slot{0, -1});
+	oldSlots.swap(slots);
+	stats.rehashes++;
+
+	const size_t mask = capacity - 1;
+	for (const Slot& slot : oldSlots)
+	{
+		if (slot.index < 0)
+		{
+			continue;
+		}
+		size_t slotIx = slot.hash & mask;
+		while (slots[slotIx].index >= 0)
+		{
+			slotIx = (slotIx + 1) & mask;
+		}
+		slots[slotIx] = slot;
+	}
+}
+
+void RawVertexTable::PrintStats(const char* label) const
+{
+	if (stats.lookups == 0)
+	{
+		return;
+	}
+	fmt::printf(
+		"%s: %llu vertex lookups, %.2f average / %llu max probe length, %llu hash collisions, "
+		"%llu rehashes, %lu of %lu slots in use.\n",
+		label,
+		(unsigned long long)stats.lookups,
+		(double)stats.probes / (double)stats.lookups,
+		(unsigned long long)stats.maxProbeLength,
+		(unsigned long long)stats.hashCollisions,
+		(unsigned long long)stats.rehashes,
+		(unsigned long)count,
+		(unsigned long)slots.size());
+}
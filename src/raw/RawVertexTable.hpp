@@ -0,0 +1,128 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+struct RawVertex;
+
+/**
+ * Flat open-addressing hash table used to weld identical vertices in RawModel::AddVertex().
+ *
+ * The table never stores vertices itself; each slot holds the full 32-bit hash of a vertex and
+ * its index into the owning model's vertex array. Lookups use linear probing over a power-of-two
+ * slot array that is kept at most half full, and only run the (expensive) vertex comparison when
+ * the stored hash matches exactly.
+ */
+class RawVertexTable
+{
+public:
+	struct Stats
+	{
+		uint64_t lookups = 0; // number of FindOrInsert() calls
+		uint64_t probes = 0; // total slots inspected across all lookups
+		uint64_t maxProbeLength = 0; // longest single probe sequence
+		uint64_t hashCollisions = 0; // equal 32-bit hashes that turned out to be different vertices
+		uint64_t rehashes = 0; // number of times the table was grown or rebuilt
+	};
+
+	RawVertexTable() = default;
+
+	// Hash the attributes of a vertex named in the given RawVertexAttribute mask. The position,
+	// the blend surface and fingerprint, and the UV polarity are always included.
+	static uint32_t Hash(const RawVertex& vertex, int attributes);
+
+	// Forget all entries, keeping the slot allocation and the accumulated statistics.
+	void Clear();
+	// Forget all entries and free the slots, keeping the accumulated statistics.
+	void Release();
+
+	// Make room for at least the given number of entries without further growth.
+	void Reserve(size_t count);
+
+	// Add an entry that is known not to be present yet.
+	void Insert(uint32_t hash, int index);
+
+	// Returns the index of an entry with the given hash for which equal(index) holds; otherwise
+	// inserts newIndex and returns it.
+	template <typename Equal>
+	int FindOrInsert(uint32_t hash, int newIndex, const Equal& equal);
+
+	size_t GetCount() const
+	{
+		return count;
+	}
+
+	size_t GetCapacity() const
+	{
+		return slots.size();
+	}
+
+	const Stats& GetStats() const
+	{
+		return stats;
+	}
+
+	void PrintStats(const char* label) const;
+
+private:
+	struct Slot
+	{
+		uint32_t hash;
+		int32_t index; // -1 when the slot is empty
+	};
+
+	void Grow(size_t minCapacity);
+
+	std::vector<Slot> slots;
+	size_t count = 0;
+	Stats stats;
+};
+
+template <typename Equal>
+int RawVertexTable::FindOrInsert(const uint32_t hash, const int newIndex, const Equal& equal)
+{
+	if ((count + 1) * 2 > slots.size())
+	{
+		Grow((count + 1) * 2);
+	}
+
+	const size_t mask = slots.size() - 1;
+	size_t slotIx = hash & mask;
+	uint64_t probeLength = 1;
+	for (;; slotIx = (slotIx + 1) & mask, probeLength++)
+	{
+		Slot& slot = slots[slotIx];
+		if (slot.index < 0)
+		{
+			slot.hash = hash;
+			slot.index = newIndex;
+			count++;
+			break;
+		}
+		if (slot.hash == hash)
+		{
+			if (equal(slot.index))
+			{
+				stats.lookups++;
+				stats.probes += probeLength;
+				stats.maxProbeLength = std::max(stats.maxProbeLength, probeLength);
+				return slot.index;
+			}
+			stats.hashCollisions++;
+		}
+	}
+
+	stats.lookups++;
+	stats.probes += probeLength;
+	stats.maxProbeLength = std::max(stats.maxProbeLength, probeLength);
+	return newIndex;
+}
@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace HashUtils
+{
+	const uint32_t PRIME32_1 = 0x9E3779B1U;
+	const uint32_t PRIME32_2 = 0x85EBCA77U;
+	const uint32_t PRIME32_3 = 0xC2B2AE3DU;
+	const uint32_t PRIME32_4 = 0x27D4EB2FU;
+	const uint32_t PRIME32_5 = 0x165667B1U;
+
+	inline uint32_t RotateLeft(uint32_t x, int r)
+	{
+		return (x << r) | (x >> (32 - r));
+	}
+
+	inline uint32_t Round(uint32_t acc, uint32_t word)
+	{
+		acc += word * PRIME32_2;
+		acc = RotateLeft(acc, 13);
+		return acc * PRIME32_1;
+	}
+
+	inline uint32_t Avalanche(uint32_t h)
+	{
+		h ^= h >> 15;
+		h *= PRIME32_2;
+		h ^= h >> 13;
+		h *= PRIME32_3;
+		h ^= h >> 16;
+		return h;
+	}
+
+	/**
+	 * Hashes a run of 32-bit words (xxHash32 layout). The main loop keeps four independent
+	 * accumulators that each consume one word per iteration, which compilers turn into a single
+	 * SIMD multiply/rotate per 16 bytes.
+	 */
+	inline uint32_t HashWords(const uint32_t* words, size_t count, uint32_t seed = 0)
+	{
+		size_t ix = 0;
+		uint32_t h;
+		if (count >= 4)
+		{
+			uint32_t acc[4] = {
+				seed + PRIME32_1 + PRIME32_2, seed + PRIME32_2, seed, seed - PRIME32_1};
+			for (; ix + 4 <= count; ix += 4)
+			{
+				for (int lane = 0; lane < 4; lane++)
+				{
+					acc[lane] = Round(acc[lane], words[ix + lane]);
+				}
+			}
+			h = RotateLeft(acc[0], 1) + RotateLeft(acc[1], 7) + RotateLeft(acc[2], 12) +
+				RotateLeft(acc[3], 18);
+		}
+		else
+		{
+			h = seed + PRIME32_5;
+		}
+		h += (uint32_t)(count * 4);
+		for (; ix < count; ix++)
+		{
+			h += words[ix] * PRIME32_3;
+			h = RotateLeft(h, 17) * PRIME32_4;
+		}
+		return Avalanche(h);
+	}
+
+	/**
+	 * Hashes an arbitrary byte buffer; the tail that doesn't fill a whole word is zero-padded.
+	 */
+	inline uint32_t HashBytes(const void* data, size_t length, uint32_t seed = 0)
+	{
+		const size_t wordCount = length / 4;
+		uint32_t h = HashWords(static_cast<const uint32_t*>(data), wordCount, seed);
+		const size_t tail = length - wordCount * 4;
+		if (tail > 0)
+		{
+			uint32_t last = 0;
+			memcpy(&last, static_cast<const uint8_t*>(data) + wordCount * 4, tail);
+			h = Avalanche(Round(h, last) ^ (uint32_t)length);
+		}
+		return h;
+	}
+
+	/**
+	 * The bit pattern of a float as used for hashing; -0.0f is folded onto 0.0f so that values
+	 * that compare equal also hash equal.
+	 */
+	inline uint32_t FloatBits(float f)
+	{
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return (bits == 0x80000000U) ? 0 : bits;
+	}
+
+	inline void Combine(uint64_t& seed, uint64_t value)
+	{
+		seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+	}
+} // namespace HashUtils
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace ThreadUtils
+{
+	inline size_t GetThreadCount()
+	{
+		const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		return (hardwareThreads > 0) ? hardwareThreads : 1;
+	}
+
+	/**
+	 * Calls fn(index) for every index in [0, count) on a pool of worker threads. Indices are
+	 * handed out one at a time, so uneven work items balance themselves; fn must be safe to call
+	 * concurrently for different indices. Runs inline when there is nothing to parallelize.
+	 */
+	template <typename Fn>
+	void ParallelFor(const size_t count, const Fn& fn)
+	{
+		const size_t threadCount = std::min(GetThreadCount(), count);
+		if (threadCount <= 1)
+		{
+			for (size_t index = 0; index < count; index++)
+			{
+				fn(index);
+			}
+			return;
+		}
+
+		std::atomic<size_t> next(0);
+		const auto worker = [&]()
+		{
+			for (size_t index = next++; index < count; index = next++)
+			{
+				fn(index);
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(threadCount - 1);
+		for (size_t i = 0; i + 1 < threadCount; i++)
+		{
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+	}
+
+	/**
+	 * Calls fn(begin, end) for consecutive blocks of at most blockSize indices covering [0, count),
+	 * for loops whose per-index work is too small to be handed out one index at a time.
+	 */
+	template <typename Fn>
+	void ParallelForBlocks(const size_t count, const size_t blockSize, const Fn& fn)
+	{
+		const size_t blockCount = (count + blockSize - 1) / blockSize;
+		ParallelFor(blockCount, [&](const size_t blockIx)
+		{
+			const size_t begin = blockIx * blockSize;
+			fn(begin, std::min(begin + blockSize, count));
+		});
+	}
+} // namespace ThreadUtils